@@ -4,23 +4,38 @@
 #include "Tools/ReadParameters.h"
 #include "FilledBamParamsParser.h"
 #include "FilteringBamProcessor.h"
+#include "ParallelBamReader.h"
 #include "ReadMapParamsParser.h"
 #include "Estimation/ReadInfo.h"
 
 #include <api/BamReader.h>
 
+#include <Tools/BlockingConcurrentQueue.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+#include <utility>
+
 namespace Estimation
 {
 namespace BamProcessing
 {
 	BamController::BamController(const BamTags &tags, bool filled_bam, const std::string &read_param_filenames,
-	                             const std::string &gtf_path, bool gene_in_chromosome_name, int min_barcode_quality)
+	                             const std::string &gtf_path, bool gene_in_chromosome_name, int min_barcode_quality,
+	                             size_t threads_num, bool split_sorted_bam)
 		: _tags(tags)
 		, _filled_bam(filled_bam)
 		, _gene_in_chromosome_name(gene_in_chromosome_name)
 		, _read_param_filenames(read_param_filenames)
 		, _gtf_path(gtf_path)
 		, _min_barcode_quality(min_barcode_quality)
+		, _threads_num(std::max(threads_num, size_t(1)))
+		, _split_sorted_bam(split_sorted_bam)
 	{}
 
 	void BamController::parse_bam_files(const std::vector<std::string> &bam_files, bool print_result_bams,
@@ -60,54 +75,559 @@ namespace BamProcessing
 			}
 		}
 
+		std::vector<std::shared_ptr<BamProcessorAbstract>> partial_processors;
+		if (bam_files.size() > 1 && this->_threads_num > 1 &&
+			BamController::create_partial_processors(*processor, bam_files.size(), partial_processors))
+		{
+			const size_t files_threads_num = std::min(this->_threads_num, bam_files.size());
+			const size_t file_threads_num = std::max(this->_threads_num / files_threads_num, size_t(1));
+			L_TRACE << "Parse " << files_threads_num << " BAM files concurrently";
+
+			this->parse_parts(partial_processors, files_threads_num, processor,
+			                  [&](size_t file_ind) {
+				                  this->parse_bam_file(bam_files[file_ind], partial_processors[file_ind], parser, false,
+				                                       file_threads_num);
+			                  },
+			                  [&](size_t file_ind) { processor->trace_state(bam_files[file_ind]); });
+			return;
+		}
+
+		std::vector<AlignmentsRegion> regions;
+		BamTools::RefVector references;
+		if (bam_files.size() == 1 && this->_threads_num > 1 && this->_split_sorted_bam && !processor->writes_alignments() &&
+			this->split_to_regions(bam_files[0], regions, references) &&
+			BamController::create_partial_processors(*processor, regions.size(), partial_processors))
+		{
+			L_TRACE << "BAM file " << bam_files[0] << " is sorted and indexed, so its " << regions.size()
+			        << " regions are parsed concurrently";
+
+			this->parse_parts(partial_processors, this->_threads_num, processor,
+			                  [&](size_t region_ind) {
+				                  this->parse_bam_region(bam_files[0], regions[region_ind], references,
+				                                         partial_processors[region_ind], parser);
+			                  },
+			                  [&](size_t region_ind) {
+				                  if (region_ind + 1 == regions.size())
+				                  {
+					                  processor->trace_state(bam_files[0]);
+				                  }
+			                  });
+			return;
+		}
+
 		for (size_t i = 0; i < bam_files.size(); ++i)
 		{
-			this->parse_bam_file(bam_files[i], processor, parser, bam_files.size() == 1);
+			this->parse_bam_file(bam_files[i], processor, parser, bam_files.size() == 1, this->_threads_num);
 			processor->trace_state(bam_files[i]);
 		}
 	}
 
-	void BamController::parse_bam_file(const std::string &bam_name, std::shared_ptr<BamProcessorAbstract> &processor,
-									   std::shared_ptr<ReadParamsParser> &parser, bool trace) const
+	bool BamController::create_partial_processors(const BamProcessorAbstract &processor, size_t parts_num,
+	                                              std::vector<std::shared_ptr<BamProcessorAbstract>> &partial_processors)
 	{
-		using namespace BamTools;
+		partial_processors.clear();
+		for (size_t i = 0; i < parts_num; ++i)
+		{
+			auto partial_processor = processor.create_partial();
+			if (partial_processor == nullptr)
+			{
+				partial_processors.clear();
+				return false;
+			}
+
+			partial_processors.push_back(partial_processor);
+		}
+
+		return true;
+	}
+
+	void BamController::parse_parts(std::vector<std::shared_ptr<BamProcessorAbstract>> &partial_processors,
+	                                size_t threads_num, std::shared_ptr<BamProcessorAbstract> processor,
+	                                const std::function<void(size_t)> &parse_part,
+	                                const std::function<void(size_t)> &part_merged) const
+	{
+		const size_t parts_num = partial_processors.size();
+		std::mutex parts_mutex;
+		std::condition_variable part_parsed;
+		std::vector<bool> parsed_parts(parts_num, false);
+		size_t next_part_ind = 0;
+		std::exception_ptr error;
+
+		std::vector<std::thread> parsing_threads;
+		for (size_t thread_ind = 0; thread_ind < std::min(threads_num, parts_num); ++thread_ind)
+		{
+			parsing_threads.emplace_back([&]{
+				while (true)
+				{
+					size_t part_ind;
+					{
+						std::lock_guard<std::mutex> lock(parts_mutex);
+						if (error || next_part_ind == parts_num)
+							break;
+
+						part_ind = next_part_ind++;
+					}
+
+					try
+					{
+						parse_part(part_ind);
+					}
+					catch (...)
+					{
+						std::lock_guard<std::mutex> lock(parts_mutex);
+						if (!error)
+						{
+							error = std::current_exception();
+						}
+					}
+
+					{
+						std::lock_guard<std::mutex> lock(parts_mutex);
+						parsed_parts[part_ind] = true;
+					}
+					part_parsed.notify_all();
+				}
+			});
+		}
+
+		// Merging in the order of the parts gives the same container as the sequential parsing
+		for (size_t i = 0; i < parts_num; ++i)
+		{
+			{
+				std::unique_lock<std::mutex> lock(parts_mutex);
+				part_parsed.wait(lock, [&]{ return error || parsed_parts[i]; });
+				if (error)
+					break;
+			}
+
+			try
+			{
+				processor->merge_partial(*partial_processors[i]);
+				partial_processors[i].reset();
+				part_merged(i);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(parts_mutex);
+				error = std::current_exception();
+				break;
+			}
+		}
 
-		BamReader reader;
+		for (auto &thread : parsing_threads)
+		{
+			thread.join();
+		}
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	bool BamController::split_to_regions(const std::string &bam_name, std::vector<AlignmentsRegion> &regions,
+	                                     BamTools::RefVector &references) const
+	{
+		BamTools::BamReader reader;
 		if (!reader.Open(bam_name))
 			throw std::runtime_error("Can't open BAM file: " + bam_name);
 
-		processor->update_bam(bam_name, reader);
+		if (reader.GetHeader().SortOrder != "coordinate")
+			return false;
+
+		references = reader.GetReferenceData();
+		reader.Close();
+
+		uint64_t total_length = 0;
+		for (auto const &reference : references)
+		{
+			total_length += reference.RefLength;
+		}
+
+		if (total_length == 0)
+			return false;
+
+		// Reads aren't distributed uniformly over the genome, so there are more regions than threads
+		const uint64_t region_length = std::max(total_length / (BamController::regions_per_thread * this->_threads_num),
+		                                        uint64_t(1));
+
+		regions.clear();
+		AlignmentsRegion region;
+		uint64_t cur_length = 0;
+		for (int32_t ref_id = 0; ref_id < int32_t(references.size()); ++ref_id)
+		{
+			for (int32_t position = 0; position < references[ref_id].RefLength; )
+			{
+				int32_t step = int32_t(std::min(uint64_t(references[ref_id].RefLength - position), region_length - cur_length));
+				position += step;
+				cur_length += step;
+				if (cur_length < region_length)
+					continue;
+
+				region.end = (position == references[ref_id].RefLength) ? std::make_pair(ref_id + 1, 0)
+				                                                        : std::make_pair(ref_id, position);
+				regions.push_back(region);
+				region.start = region.end;
+				cur_length = 0;
+			}
+		}
+
+		if (cur_length > 0 || regions.empty())
+		{
+			region.end = std::make_pair(int32_t(references.size()), 0);
+			regions.push_back(region);
+		}
+		else
+		{
+			regions.back().end = std::make_pair(int32_t(references.size()), 0);
+		}
+
+		std::vector<std::pair<int32_t, int32_t>> starts;
+		for (auto const &cur_region : regions)
+		{
+			starts.push_back(cur_region.start);
+		}
+
+		std::vector<uint64_t> offsets;
+		if (!ParallelBamReader::index_offsets(bam_name, starts, offsets))
+			return false;
+
+		for (size_t i = 0; i < regions.size(); ++i)
+		{
+			regions[i].start_offset = offsets[i];
+		}
+
+		return true;
+	}
+
+	void BamController::parse_bam_region(const std::string &bam_name, const AlignmentsRegion &region,
+	                                     const BamTools::RefVector &references,
+	                                     std::shared_ptr<BamProcessorAbstract> &processor,
+	                                     std::shared_ptr<ReadParamsParser> &parser) const
+	{
+		using namespace BamTools;
+
+		// The index gives only a lower bound for the region start, so alignments are filtered by the start position
+		// Regions are parsed concurrently, so each of them gets a single thread, which inflates and parses it
+		std::unique_ptr<ParallelBamReader> reader(region.start_offset == 0
+		                                          ? new ParallelBamReader(bam_name, 0)
+		                                          : new ParallelBamReader(bam_name, references, region.start_offset, 0));
+
+		const bool last_region = region.end.first >= int32_t(references.size());
+		auto next_alignment_core = [&reader, &region, last_region](BamAlignment &alignment) {
+			while (reader->get_next_alignment_core(alignment))
+			{
+				// Reads without coordinates are in the end of a sorted file. They're passed from the last region
+				// and reported by parse_alignments, as in the sequential parsing
+				if (alignment.RefID < 0)
+					return last_region;
+
+				auto position = std::make_pair(alignment.RefID, alignment.Position);
+				if (position < region.start)
+					continue;
+
+				return position < region.end;
+			}
+
+			return false;
+		};
+
+		int fields = parser->used_fields();
+		this->parse_alignments(bam_name, next_alignment_core,
+		                       [&](BamAlignment &alignment) {
+			                       this->decode_alignment(*reader, *parser, references, fields, alignment);
+		                       },
+		                       references, processor, parser, false, 1);
+	}
+
+	void BamController::parse_bam_file(const std::string &bam_name, std::shared_ptr<BamProcessorAbstract> &processor,
+									   std::shared_ptr<ReadParamsParser> &parser, bool trace, size_t threads_num) const
+	{
+		using namespace BamTools;
+
+		// BamReader provides the header for the output, and alignments are inflated and decoded by ParallelBamReader
+		{
+			BamReader header_reader;
+			if (!header_reader.Open(bam_name))
+				throw std::runtime_error("Can't open BAM file: " + bam_name);
+
+			processor->update_bam(bam_name, header_reader);
+			header_reader.Close();
+		}
+
+		// The tagged BAM output needs all fields, and otherwise only the fields used by the parser are decoded
+		int fields = processor->writes_alignments() ? ParallelBamReader::ALL_FIELDS : parser->used_fields();
+
+		// The threads are split between inflating of BGZF blocks and parsing, so they don't exceed threads_num in total
+		const size_t inflate_threads_num = threads_num / 2;
+		ParallelBamReader reader(bam_name, inflate_threads_num);
+		this->parse_alignments(bam_name,
+		                       [&reader](BamAlignment &alignment) { return reader.get_next_alignment_core(alignment); },
+		                       [&](BamAlignment &alignment) {
+			                       this->decode_alignment(reader, *parser, reader.references(), fields, alignment);
+		                       },
+		                       reader.references(), processor, parser, trace, threads_num - inflate_threads_num);
+	}
+
+	void BamController::decode_alignment(const ParallelBamReader &reader, const ReadParamsParser &parser,
+	                                     const BamTools::RefVector &references, int fields,
+	                                     BamTools::BamAlignment &alignment) const
+	{
+		reader.decode_fields(alignment, fields);
+
+#ifndef NDEBUG
+		if ((fields & ParallelBamReader::ALL_FIELDS) == ParallelBamReader::ALL_FIELDS)
+			return;
+
+		BamTools::BamAlignment full_alignment(alignment);
+		reader.decode_fields(full_alignment, ParallelBamReader::ALL_FIELDS);
+
+		auto const &chr_name = references[alignment.RefID].RefName;
+		auto annotate = [&parser, &chr_name](const BamTools::BamAlignment &cur_alignment) {
+			std::string gene;
+			try
+			{
+				auto mark = parser.get_gene(chr_name, cur_alignment, gene);
+				return gene + " " + std::to_string(mark.check(UMI::Mark::HAS_EXONS)) +
+				       std::to_string(mark.check(UMI::Mark::HAS_INTRONS)) +
+				       std::to_string(mark.check(UMI::Mark::HAS_NOT_ANNOTATED));
+			}
+			catch (Tools::GeneAnnotation::RefGenesContainer::ChrNotFoundException &ex)
+			{
+				return "unknown chromosome " + ex.chr_name;
+			}
+		};
+
+		if (annotate(alignment) != annotate(full_alignment))
+			throw std::runtime_error("Gene of read '" + full_alignment.Name + "' depends on BAM fields, which aren't decoded");
+#endif
+	}
+
+	void BamController::parse_alignments(const std::string &bam_name,
+	                                     const std::function<bool(BamTools::BamAlignment&)> &next_alignment_core,
+	                                     const std::function<void(BamTools::BamAlignment&)> &decode_alignment,
+	                                     const BamTools::RefVector &references,
+	                                     std::shared_ptr<BamProcessorAbstract> &processor,
+	                                     std::shared_ptr<ReadParamsParser> &parser, bool trace, size_t threads_num) const
+	{
+		using namespace BamTools;
 
-		BamAlignment alignment;
 		std::unordered_set<std::string> unexpected_chromosomes;
 		std::unordered_set<int32_t> unexpected_chromosome_ids;
+		auto read_batch = [&](AlignmentsBatch &batch) {
+			BamAlignment alignment;
+			while (batch.reads_num < BamController::alignments_batch_size && next_alignment_core(alignment))
+			{
+				if (alignment.RefID < 0 || size_t(alignment.RefID) >= references.size())
+				{
+					if (unexpected_chromosome_ids.emplace(alignment.RefID).second)
+					{
+						L_ERR << "ERROR: can't find chromosome, id: " << alignment.RefID;
+					}
+					continue;
+				}
+
+				batch.reads_num++;
+				if (!alignment.IsMapped() || !alignment.IsPrimaryAlignment()) // Such reads aren't annotated anyway
+					continue;
+
+				decode_alignment(alignment);
+				batch.chr_names.push_back(references[alignment.RefID].RefName);
+				batch.alignments.push_back(std::move(alignment));
+			}
 
-		while (reader.GetNextAlignment(alignment))
+			return batch.reads_num != 0;
+		};
+
+		// The calling thread saves the batches and one more thread reads them, so the rest of the threads annotate.
+		// With fewer threads, the reading thread annotates the batches, or all stages are run by the calling thread.
+		if (threads_num < 2)
 		{
-			std::string chr_name;
-			try
+			for (size_t batch_id = 0; ; ++batch_id)
+			{
+				AlignmentsBatch batch;
+				batch.id = batch_id;
+				if (!read_batch(batch))
+					break;
+
+				this->annotate_batch(*parser, unexpected_chromosomes, batch);
+				this->save_batch(batch, *processor, bam_name, trace);
+			}
+			return;
+		}
+
+		const size_t annotation_threads_num = threads_num - 2;
+
+		// read -> annotate -> save. Number of batches in flight is limited, so memory doesn't depend on the file size
+		const size_t max_batches_in_flight = 4 * threads_num;
+		Tools::BlockingConcurrentQueue<AlignmentsBatch> batches(2 * std::max(annotation_threads_num, size_t(1)));
+		std::mutex ready_mutex;
+		std::condition_variable batch_ready, batch_saved;
+		std::map<size_t, AlignmentsBatch> ready_batches;
+		size_t saved_batches_num = 0, read_batches_num = 0;
+		bool reading_finished = false, stopped = false;
+		std::exception_ptr error;
+
+		auto set_error = [&](const std::exception_ptr &new_error) {
 			{
-				chr_name = reader.GetReferenceData().at(alignment.RefID).RefName;
+				std::lock_guard<std::mutex> lock(ready_mutex);
+				if (!error)
+				{
+					error = new_error;
+				}
+				stopped = true;
 			}
-			catch (std::exception &error)
+			batches.close();
+			batch_ready.notify_all();
+			batch_saved.notify_all();
+		};
+
+		std::thread reading_thread([&]{
+			try
 			{
-				if (unexpected_chromosome_ids.emplace(alignment.RefID).second)
+				for (size_t batch_id = 0; ; ++batch_id)
 				{
-					L_ERR << "ERROR: can't find chromosome, id: " << alignment.RefID;
+					{
+						std::unique_lock<std::mutex> lock(ready_mutex);
+						batch_saved.wait(lock, [&]{ return stopped || batch_id < saved_batches_num + max_batches_in_flight; });
+						if (stopped)
+							break;
+					}
+
+					AlignmentsBatch batch;
+					batch.id = batch_id;
+					if (!read_batch(batch))
+						break;
+
+					if (annotation_threads_num == 0)
+					{
+						this->annotate_batch(*parser, unexpected_chromosomes, batch);
+						{
+							std::lock_guard<std::mutex> lock(ready_mutex);
+							ready_batches.emplace(batch_id, std::move(batch));
+							read_batches_num = batch_id + 1;
+						}
+						batch_ready.notify_all();
+						continue;
+					}
+
+					if (!batches.push_wait(std::move(batch)))
+						break;
+
+					std::lock_guard<std::mutex> lock(ready_mutex);
+					read_batches_num = batch_id + 1;
 				}
-				continue;
 			}
+			catch (...)
+			{
+				set_error(std::current_exception());
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(ready_mutex);
+				reading_finished = true;
+			}
+			batches.close();
+			batch_ready.notify_all();
+		});
+
+		std::vector<std::thread> annotation_threads;
+		for (size_t thread_ind = 0; thread_ind < annotation_threads_num; ++thread_ind)
+		{
+			annotation_threads.emplace_back([&]{
+				try
+				{
+					AlignmentsBatch batch;
+					while (batches.pop_wait(batch))
+					{
+						this->annotate_batch(*parser, unexpected_chromosomes, batch);
+
+						{
+							std::lock_guard<std::mutex> lock(ready_mutex);
+							size_t batch_id = batch.id;
+							ready_batches.emplace(batch_id, std::move(batch));
+						}
+						batch_ready.notify_all();
+					}
+				}
+				catch (...)
+				{
+					set_error(std::current_exception());
+				}
+			});
+		}
 
-			processor->inc_reads(); // reads with unknown chromosome are not counted
-			if (trace && processor->total_reads_num() % 10000000 == 0)
+		try
+		{
+			while (true)
 			{
-				processor->trace_state(bam_name);
+				AlignmentsBatch batch;
+				{
+					std::unique_lock<std::mutex> lock(ready_mutex);
+					batch_ready.wait(lock, [&]{
+						return stopped || ready_batches.count(saved_batches_num) != 0 ||
+								(reading_finished && saved_batches_num == read_batches_num);
+					});
+
+					auto batch_it = ready_batches.find(saved_batches_num);
+					if (stopped || batch_it == ready_batches.end())
+						break;
+
+					batch = std::move(batch_it->second);
+					ready_batches.erase(batch_it);
+				}
+
+				this->save_batch(batch, *processor, bam_name, trace);
+
+				{
+					std::lock_guard<std::mutex> lock(ready_mutex);
+					saved_batches_num++;
+				}
+				batch_saved.notify_all();
 			}
+		}
+		catch (...)
+		{
+			set_error(std::current_exception());
+		}
 
-			this->process_alignment(parser, processor, unexpected_chromosomes, chr_name, alignment);
+		reading_thread.join();
+		for (auto &thread : annotation_threads)
+		{
+			thread.join();
 		}
 
-		reader.Close();
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	void BamController::annotate_batch(ReadParamsParser &parser, std::unordered_set<std::string> &unexpected_chromosomes,
+	                                   AlignmentsBatch &batch) const
+	{
+		for (size_t i = 0; i < batch.alignments.size(); ++i)
+		{
+			this->annotate_alignment(parser, unexpected_chromosomes, batch.chr_names[i], batch.alignments[i], i, batch);
+		}
+	}
+
+	void BamController::save_batch(AlignmentsBatch &batch, BamProcessorAbstract &processor, const std::string &bam_name,
+	                               bool trace) const
+	{
+		processor.inc_cant_parse_num(batch.cant_parse_num);
+		processor.inc_low_quality_num(batch.low_quality_num);
+
+		for (size_t i = 0; i < batch.reads_num; ++i)
+		{
+			processor.inc_reads(); // reads with unknown chromosome are not counted
+			if (trace && processor.total_reads_num() % 10000000 == 0)
+			{
+				processor.trace_state(bam_name);
+			}
+		}
+
+		for (auto const &read : batch.reads)
+		{
+			processor.write_alignment(batch.alignments[read.alignment_ind], read.read_info);
+			processor.save_read(read.read_info);
+		}
 	}
 
 	std::shared_ptr<ReadParamsParser> BamController::get_parser() const
@@ -119,7 +639,7 @@ namespace BamProcessing
 		if (this->_read_param_filenames != "")
 			return std::make_shared<ReadMapParamsParser>(this->_gtf_path, this->_read_param_filenames,
 			                                             this->_tags, this->_gene_in_chromosome_name,
-			                                             this->_min_barcode_quality);
+			                                             this->_min_barcode_quality, this->_threads_num);
 
 		return std::make_shared<ReadParamsParser>(this->_gtf_path, this->_tags, this->_gene_in_chromosome_name);
 	}
@@ -128,42 +648,59 @@ namespace BamProcessing
 	                                      std::shared_ptr<BamProcessorAbstract> processor,
 	                                      std::unordered_set<std::string> &unexpected_chromosomes,
 	                                      const std::string &chr_name, const BamTools::BamAlignment &alignment) const
+	{
+		AlignmentsBatch batch;
+		this->annotate_alignment(*parser, unexpected_chromosomes, chr_name, alignment, 0, batch);
+		processor->inc_cant_parse_num(batch.cant_parse_num);
+		processor->inc_low_quality_num(batch.low_quality_num);
+
+		for (auto const &read : batch.reads)
+		{
+			processor->write_alignment(alignment, read.read_info);
+			processor->save_read(read.read_info);
+		}
+	}
+
+	bool BamController::annotate_alignment(ReadParamsParser &parser,
+	                                       std::unordered_set<std::string> &unexpected_chromosomes,
+	                                       const std::string &chr_name, const BamTools::BamAlignment &alignment,
+	                                       size_t alignment_ind, AlignmentsBatch &batch) const
 	{
 		if (!alignment.IsMapped() || !alignment.IsPrimaryAlignment())
-			return;
+			return false;
 
 		Tools::ReadParameters read_params;
-		if (!parser->get_read_params(alignment, read_params))
+		if (!parser.get_read_params(alignment, read_params))
 		{
-			processor->inc_cant_parse_num();
-			return;
+			batch.cant_parse_num++;
+			return false;
 		}
 
 		if (!read_params.pass_quality_threshold())
 		{
-			processor->inc_low_quality_num();
-			return;
+			batch.low_quality_num++;
+			return false;
 		}
 
 		std::string gene;
 		UMI::Mark mark;
 		try
 		{
-			mark = parser->get_gene(chr_name, alignment, gene);
+			mark = parser.get_gene(chr_name, alignment, gene);
 		}
 		catch (Tools::GeneAnnotation::RefGenesContainer::ChrNotFoundException ex)
 		{
+			std::lock_guard<std::mutex> lock(this->_unexpected_chromosomes_mutex);
 			if (unexpected_chromosomes.emplace(ex.chr_name).second)
 			{
 				L_WARN << "WARNING: Can't find chromosome '" << ex.chr_name << "'";
 			}
-			processor->inc_cant_parse_num();
-			return;
+			batch.cant_parse_num++;
+			return false;
 		}
 
-		ReadInfo read_info(read_params, gene, chr_name, mark);
-		processor->write_alignment(alignment, read_info);
-		processor->save_read(read_info);
+		batch.reads.push_back(AnnotatedRead{alignment_ind, ReadInfo(read_params, gene, chr_name, mark)});
+		return true;
 	}
 }
 }
@@ -4,7 +4,11 @@
 #include "Tools/GeneAnnotation/RefGenesContainer.h"
 #include "BamProcessorAbstract.h"
 
+#include <functional>
+#include <mutex>
 #include <string>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace Tools
@@ -17,18 +21,56 @@ namespace TestEstimator
 	struct testGeneMatchLevelUmiExclusion;
 	struct testGeneMatchLevelUmiExclusion2;
 	struct testPseudoAlignersGenes;
+	struct testBamRegionsParsing;
+	struct testParallelAnnotation;
 }
 
 namespace Estimation
 {
 	namespace BamProcessing
 	{
+		class ParallelBamReader;
 		class ReadParamsParser;
 		class BamController
 		{
 			friend struct TestEstimator::testGeneMatchLevelUmiExclusion;
 			friend struct TestEstimator::testGeneMatchLevelUmiExclusion2;
 			friend struct TestEstimator::testPseudoAlignersGenes;
+			friend struct TestEstimator::testBamRegionsParsing;
+			friend struct TestEstimator::testParallelAnnotation;
+
+		private:
+			// Alignments of a BAM file are read in batches, annotated by a pool of threads, and passed to the
+			// processor in the original order
+			struct AnnotatedRead
+			{
+				size_t alignment_ind;
+				ReadInfo read_info;
+			};
+
+			struct AlignmentsBatch
+			{
+				size_t id = 0;
+				size_t reads_num = 0; // Including unmapped and secondary alignments, which aren't decoded
+				std::vector<BamTools::BamAlignment> alignments;
+				std::vector<std::string> chr_names;
+				std::vector<AnnotatedRead> reads;
+				size_t cant_parse_num = 0;
+				size_t low_quality_num = 0;
+			};
+
+			static const size_t alignments_batch_size = 10000;
+
+			// Part of a coordinate-sorted BAM file with alignments, which start in [start, end). Bounds are (ref_id, position).
+			// The last region also has the reads without coordinates from the end of the file.
+			struct AlignmentsRegion
+			{
+				std::pair<int32_t, int32_t> start = std::make_pair(0, 0);
+				std::pair<int32_t, int32_t> end;
+				uint64_t start_offset = 0; // Virtual offset of the file, before which no alignments of the region start
+			};
+
+			static const size_t regions_per_thread = 8;
 
 		private:
 			const BamTags _tags;
@@ -37,10 +79,44 @@ namespace Estimation
 			const std::string _read_param_filenames;
 			const std::string _gtf_path;
 			const int _min_barcode_quality;
+			const size_t _threads_num;
+			const bool _split_sorted_bam;
+
+			mutable std::mutex _unexpected_chromosomes_mutex;
 
 		private:
 			void parse_bam_file(const std::string &bam_name, std::shared_ptr<BamProcessorAbstract> &processor,
-			                    std::shared_ptr<ReadParamsParser> &parser, bool trace) const;
+			                    std::shared_ptr<ReadParamsParser> &parser, bool trace, size_t threads_num) const;
+
+			// Decodes the fields, which are used by the parser. Debug builds check that the gene doesn't change, if all
+			// fields are decoded. Read parameters can be consumed by get_read_params(), so they aren't checked here.
+			void decode_alignment(const ParallelBamReader &reader, const ReadParamsParser &parser,
+			                      const BamTools::RefVector &references, int fields,
+			                      BamTools::BamAlignment &alignment) const;
+
+			// Parses alignments with threads_num threads, including the calling thread
+			void parse_alignments(const std::string &bam_name,
+			                      const std::function<bool(BamTools::BamAlignment&)> &next_alignment_core,
+			                      const std::function<void(BamTools::BamAlignment&)> &decode_alignment,
+			                      const BamTools::RefVector &references, std::shared_ptr<BamProcessorAbstract> &processor,
+			                      std::shared_ptr<ReadParamsParser> &parser, bool trace, size_t threads_num) const;
+
+			// Returns false if the file isn't sorted by coordinate or doesn't have an index
+			bool split_to_regions(const std::string &bam_name, std::vector<AlignmentsRegion> &regions,
+			                      BamTools::RefVector &references) const;
+			void parse_bam_region(const std::string &bam_name, const AlignmentsRegion &region,
+			                      const BamTools::RefVector &references, std::shared_ptr<BamProcessorAbstract> &processor,
+			                      std::shared_ptr<ReadParamsParser> &parser) const;
+
+			// Returns false if the processor doesn't support partial processing
+			static bool create_partial_processors(const BamProcessorAbstract &processor, size_t parts_num,
+			                                      std::vector<std::shared_ptr<BamProcessorAbstract>> &partial_processors);
+
+			// Each part (a file or a region) is parsed by its partial processor, and the partial results are merged
+			// in the order of the parts
+			void parse_parts(std::vector<std::shared_ptr<BamProcessorAbstract>> &partial_processors, size_t threads_num,
+			                 std::shared_ptr<BamProcessorAbstract> processor, const std::function<void(size_t)> &parse_part,
+			                 const std::function<void(size_t)> &part_merged) const;
 
 			std::shared_ptr<ReadParamsParser> get_parser() const;
 
@@ -52,6 +128,17 @@ namespace Estimation
 			                       std::unordered_set<std::string> &unexpected_chromosomes,
 			                       const std::string &chr_name, const BamTools::BamAlignment &alignment) const;
 
+			void annotate_batch(ReadParamsParser &parser, std::unordered_set<std::string> &unexpected_chromosomes,
+			                    AlignmentsBatch &batch) const;
+
+			// Returns false if the read must be skipped. Rejected reads are counted in the batch
+			bool annotate_alignment(ReadParamsParser &parser, std::unordered_set<std::string> &unexpected_chromosomes,
+			                        const std::string &chr_name, const BamTools::BamAlignment &alignment,
+			                        size_t alignment_ind, AlignmentsBatch &batch) const;
+
+			void save_batch(AlignmentsBatch &batch, BamProcessorAbstract &processor, const std::string &bam_name,
+			                bool trace) const;
+
 		public:
 			void parse_bam_files(const std::vector<std::string> &bam_files, bool print_result_bams,
 			                     CellsDataContainer &container) const;
@@ -60,7 +147,8 @@ namespace Estimation
 			                              const CellsDataContainer &container) const;
 
 			BamController(const BamTags &tags, bool filled_bam, const std::string &read_param_filenames,
-			              const std::string &gtf_path, bool gene_in_chromosome_name, int min_barcode_quality);
+			              const std::string &gtf_path, bool gene_in_chromosome_name, int min_barcode_quality,
+			              size_t threads_num = 1, bool split_sorted_bam = true);
 		};
 	}
 }
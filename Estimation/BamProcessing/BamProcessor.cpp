@@ -16,6 +16,15 @@ namespace Estimation
 			, _total_intergenic_reads(0)
 		{}
 
+		BamProcessor::BamProcessor(std::unique_ptr<CellsDataContainer> &&partial_container, const BamTags &tags,
+		                           bool print_bam)
+			: BamProcessorAbstract(tags)
+			, _partial_container(std::move(partial_container))
+			, _container(*this->_partial_container)
+			, _print_bam(print_bam)
+			, _total_intergenic_reads(0)
+		{}
+
 		void BamProcessor::save_read(const ReadInfo &read_info)
 		{
 			if (read_info.gene == "")
@@ -73,5 +82,25 @@ namespace Estimation
 		{
 			return this->_container;
 		}
+
+		bool BamProcessor::writes_alignments() const
+		{
+			return this->_print_bam;
+		}
+
+		std::shared_ptr<BamProcessorAbstract> BamProcessor::create_partial() const
+		{
+			return std::shared_ptr<BamProcessorAbstract>(new BamProcessor(this->_container.create_partial(), this->tags(),
+			                                                              this->_print_bam));
+		}
+
+		void BamProcessor::merge_partial(const BamProcessorAbstract &partial)
+		{
+			BamProcessorAbstract::merge_partial(partial);
+
+			auto const &bam_partial = dynamic_cast<const BamProcessor&>(partial);
+			this->_total_intergenic_reads += bam_partial._total_intergenic_reads;
+			this->_container.add_records(bam_partial._container);
+		}
 	}
 }
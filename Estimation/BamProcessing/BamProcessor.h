@@ -14,6 +14,7 @@ namespace Estimation
 		class BamProcessor : public BamProcessorAbstract
 		{
 		private:
+			std::unique_ptr<CellsDataContainer> _partial_container; // Set only for the processors of partial results
 			CellsDataContainer &_container;
 			const bool _print_bam;
 			size_t _total_intergenic_reads;
@@ -21,6 +22,9 @@ namespace Estimation
 		protected:
 			std::string get_result_bam_name(const std::string &bam_name) const override;
 
+		private:
+			BamProcessor(std::unique_ptr<CellsDataContainer> &&partial_container, const BamTags &tags, bool print_bam);
+
 		public:
 			BamProcessor(CellsDataContainer &container, const BamTags &tags, bool print_bam);
 
@@ -33,6 +37,10 @@ namespace Estimation
 			void write_alignment(BamTools::BamAlignment alignment, const ReadInfo &read_info) override;
 
 			const CellsDataContainer& container() const override;
+			bool writes_alignments() const override;
+
+			std::shared_ptr<BamProcessorAbstract> create_partial() const override;
+			void merge_partial(const BamProcessorAbstract &partial) override;
 		};
 	}
 }
\ No newline at end of file
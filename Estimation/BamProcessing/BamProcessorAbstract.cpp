@@ -41,6 +41,11 @@ namespace BamProcessing
 			throw std::runtime_error("Could not open BAM file to write: " + result_bam_name);
 	}
 
+	const BamTags &BamProcessorAbstract::tags() const
+	{
+		return this->_tags;
+	}
+
 	size_t BamProcessorAbstract::total_reads_num() const
 	{
 		return this->_total_reads_num;
@@ -107,14 +112,26 @@ namespace BamProcessing
 		this->_writer.SaveAlignment(alignment);
 	}
 
-	void BamProcessorAbstract::inc_cant_parse_num()
+	void BamProcessorAbstract::inc_cant_parse_num(size_t reads_num)
+	{
+		this->_cant_parse_reads_num += reads_num;
+	}
+
+	void BamProcessorAbstract::inc_low_quality_num(size_t reads_num)
+	{
+		this->_low_quality_reads_num += reads_num;
+	}
+
+	std::shared_ptr<BamProcessorAbstract> BamProcessorAbstract::create_partial() const
 	{
-		++this->_cant_parse_reads_num;
+		return nullptr;
 	}
 
-	void BamProcessorAbstract::inc_low_quality_num()
+	void BamProcessorAbstract::merge_partial(const BamProcessorAbstract &partial)
 	{
-		++this->_low_quality_reads_num;
+		this->_total_reads_num += partial._total_reads_num;
+		this->_cant_parse_reads_num += partial._cant_parse_reads_num;
+		this->_low_quality_reads_num += partial._low_quality_reads_num;
 	}
 }
 }
@@ -6,6 +6,7 @@
 #include <Estimation/ReadInfo.h>
 
 #include <cstdlib>
+#include <memory>
 #include <string>
 #include <api/BamWriter.h>
 #include <api/BamReader.h>
@@ -34,6 +35,7 @@ namespace Estimation
 			void save_alignment(BamTools::BamAlignment alignment, const ReadInfo &read_info_raw,
 			                    const std::string &cell_barcode_corrected="", const std::string &umi_corrected="");
 			virtual std::string get_result_bam_name(const std::string &bam_name) const = 0;
+			const BamTags& tags() const;
 
 		public:
 			explicit BamProcessorAbstract(const BamTags &tags_info);
@@ -43,8 +45,8 @@ namespace Estimation
 			size_t cant_parse_reads_num() const;
 			size_t low_quality_reads_num() const;
 			void inc_reads();
-			void inc_cant_parse_num();
-			void inc_low_quality_num();
+			void inc_cant_parse_num(size_t reads_num = 1);
+			void inc_low_quality_num(size_t reads_num = 1);
 			virtual void update_bam(const std::string& bam_file, const BamTools::BamReader &reader);
 
 			virtual void trace_state(const std::string& trace_prefix) const = 0;
@@ -52,6 +54,12 @@ namespace Estimation
 			virtual void write_alignment(BamTools::BamAlignment alignment, const ReadInfo &read_info) = 0;
 
 			virtual const CellsDataContainer& container() const = 0;
+			virtual bool writes_alignments() const = 0;
+
+			// Processor of a single file, which can be run concurrently with the processors of other files.
+			// Returns nullptr if the files must be processed sequentially.
+			virtual std::shared_ptr<BamProcessorAbstract> create_partial() const;
+			virtual void merge_partial(const BamProcessorAbstract &partial);
 		};
 	}
 }
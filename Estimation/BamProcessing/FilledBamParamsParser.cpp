@@ -1,5 +1,6 @@
 #include "FilledBamParamsParser.h"
 #include "BamController.h"
+#include "ParallelBamReader.h"
 
 #include <Tools/Logs.h>
 #include <Tools/ReadParameters.h>
@@ -12,23 +13,17 @@ namespace BamProcessing
 	bool FilledBamParamsParser::get_read_params(const BamTools::BamAlignment &alignment,
 	                                            Tools::ReadParameters &read_params)
 	{
-		std::string cell_barcode;
-		if (!alignment.GetTag(this->tags.cell_barcode, cell_barcode))
-			return false;
+		const std::string *const tags[] = {&this->tags.cell_barcode, &this->tags.umi, &this->tags.cell_barcode_quality,
+		                                   &this->tags.umi_quality};
+		std::string values[4]; // Cell barcode, UMI and their qualities
 
-		std::string umi;
-		if (!alignment.GetTag(this->tags.umi, umi))
+		unsigned found_tags = ReadParamsParser::get_string_tags(alignment, tags, values, 4);
+		if ((found_tags & 3u) != 3u) // Barcode and UMI are required
 			return false;
 
-		std::string cb_quality;
-		alignment.GetTag(this->tags.cell_barcode_quality, cb_quality);
-
-		std::string umi_quality;
-		alignment.GetTag(this->tags.umi_quality, umi_quality);
-
 		try
 		{
-			read_params = Tools::ReadParameters(cell_barcode, umi, cb_quality, umi_quality, this->_min_barcode_quality);
+			read_params = Tools::ReadParameters(values[0], values[1], values[2], values[3], this->_min_barcode_quality);
 		}
 		catch (std::runtime_error &error)
 		{
@@ -39,6 +34,11 @@ namespace BamProcessing
 		return true;
 	}
 
+	int FilledBamParamsParser::used_fields() const
+	{
+		return ParallelBamReader::TAGS | this->gene_fields();
+	}
+
 	FilledBamParamsParser::FilledBamParamsParser(const std::string &gtf_path, const BamTags &tags,
 	                                             bool gene_in_chromosome_name, int min_barcode_quality)
 		: ReadParamsParser(gtf_path, tags, gene_in_chromosome_name)
@@ -16,6 +16,7 @@ namespace BamProcessing
 		FilledBamParamsParser(const std::string &gtf_path, const BamTags &tags, bool gene_in_chromosome_name,
 		                      int min_barcode_quality);
 		bool get_read_params(const BamTools::BamAlignment &alignment, Tools::ReadParameters &read_params) override;
+		int used_fields() const override;
 	};
 }
 }
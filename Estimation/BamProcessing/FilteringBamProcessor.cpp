@@ -114,5 +114,10 @@ namespace Estimation
 			return this->_container;
 		}
 
+		bool FilteringBamProcessor::writes_alignments() const
+		{
+			return true;
+		}
+
 	}
 }
@@ -35,6 +35,7 @@ namespace Estimation
 			void write_alignment(BamTools::BamAlignment alignment, const ReadInfo &read_info) override;
 
 			const CellsDataContainer& container() const override;
+			bool writes_alignments() const override;
 		};
 	}
 }
@@ -0,0 +1,323 @@
+#include "ParallelBamReader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace Estimation
+{
+namespace BamProcessing
+{
+	namespace
+	{
+		template<typename T>
+		T value_at(const char *data)
+		{
+			T value;
+			std::memcpy(&value, data, sizeof(T)); // BAM is little-endian, as the supported platforms
+			return value;
+		}
+	}
+
+	ParallelBamReader::ParallelBamReader(const std::string &filename, size_t threads_num)
+		: _filename(filename)
+		, _in_reader(filename, threads_num)
+	{
+		this->read_header();
+	}
+
+	ParallelBamReader::ParallelBamReader(const std::string &filename, const BamTools::RefVector &references,
+	                                     uint64_t virtual_offset, size_t threads_num)
+		: _filename(filename)
+		, _in_reader(filename, threads_num, size_t(virtual_offset >> 16))
+		, _references(references)
+	{
+		// The lower 16 bits are the offset in the inflated BGZF block
+		std::vector<char> skipped(size_t(virtual_offset & 0xFFFF));
+		if (!this->read_exactly(skipped.data(), skipped.size()))
+			throw std::runtime_error("BAM file '" + filename + "' ended prematurely");
+	}
+
+	bool ParallelBamReader::index_offsets(const std::string &filename,
+	                                      const std::vector<std::pair<int32_t, int32_t>> &positions,
+	                                      std::vector<uint64_t> &offsets)
+	{
+		const std::string bam_extension = ".bam";
+		std::ifstream index_in(filename + ".bai", std::ios_base::in | std::ios_base::binary);
+		if (!index_in && filename.size() > bam_extension.size() &&
+			filename.compare(filename.size() - bam_extension.size(), bam_extension.size(), bam_extension) == 0)
+		{
+			index_in.open(filename.substr(0, filename.size() - bam_extension.size()) + ".bai",
+			              std::ios_base::in | std::ios_base::binary);
+		}
+
+		if (!index_in)
+			return false;
+
+		auto read_value = [&index_in, &filename](char *buffer, size_t size) {
+			if (!index_in.read(buffer, size))
+				throw std::runtime_error("Index of BAM file '" + filename + "' is corrupted");
+		};
+
+		char buffer[sizeof(int32_t)];
+		read_value(buffer, sizeof(buffer));
+		if (std::memcmp(buffer, "BAI\1", sizeof(buffer)) != 0)
+			throw std::runtime_error("Index of BAM file '" + filename + "' isn't a BAI file");
+
+		read_value(buffer, sizeof(buffer));
+		std::vector<std::vector<uint64_t>> linear_index(size_t(std::max(value_at<int32_t>(buffer), 0)));
+		for (auto &ref_offsets : linear_index)
+		{
+			// Bins are skipped. Each entry of the linear index is the offset of the first alignment, which overlaps
+			// a 16Kb window. As alignments are sorted by start, it's a lower bound for all alignments, which start
+			// after the window.
+			read_value(buffer, sizeof(buffer));
+			auto bins_num = value_at<int32_t>(buffer);
+			for (int32_t i = 0; i < bins_num; ++i)
+			{
+				char bin_buffer[2 * sizeof(int32_t)];
+				read_value(bin_buffer, sizeof(bin_buffer));
+				index_in.ignore(std::streamsize(value_at<int32_t>(bin_buffer + 4)) * 2 * sizeof(uint64_t));
+			}
+
+			read_value(buffer, sizeof(buffer));
+			ref_offsets.resize(size_t(std::max(value_at<int32_t>(buffer), 0)));
+			read_value(reinterpret_cast<char*>(ref_offsets.data()), ref_offsets.size() * sizeof(uint64_t));
+		}
+
+		// Empty windows have zero offsets, so the maximum of all previous offsets is used
+		std::vector<uint64_t> previous_refs_offsets(linear_index.size() + 1, 0);
+		for (size_t ref_id = 0; ref_id < linear_index.size(); ++ref_id)
+		{
+			auto &ref_offsets = linear_index[ref_id];
+			for (size_t i = 1; i < ref_offsets.size(); ++i)
+			{
+				ref_offsets[i] = std::max(ref_offsets[i], ref_offsets[i - 1]);
+			}
+
+			previous_refs_offsets[ref_id + 1] = std::max(previous_refs_offsets[ref_id],
+			                                             ref_offsets.empty() ? 0 : ref_offsets.back());
+		}
+
+		offsets.clear();
+		for (auto const &position : positions)
+		{
+			auto ref_id = size_t(std::max(position.first, 0));
+			if (ref_id >= linear_index.size())
+			{
+				offsets.push_back(previous_refs_offsets.back());
+				continue;
+			}
+
+			uint64_t offset = previous_refs_offsets[ref_id];
+			auto const &ref_offsets = linear_index[ref_id];
+			if (!ref_offsets.empty())
+			{
+				auto window = std::min(size_t(std::max(position.second, 0) >> 14), ref_offsets.size() - 1);
+				offset = std::max(offset, ref_offsets[window]);
+			}
+
+			offsets.push_back(offset);
+		}
+
+		return true;
+	}
+
+	bool ParallelBamReader::read_exactly(char *buffer, size_t size)
+	{
+		size_t read_size = this->_in_reader.read(buffer, size);
+		if (read_size == 0 && size != 0)
+			return false;
+
+		if (read_size != size)
+			throw std::runtime_error("BAM file '" + this->_filename + "' ended prematurely");
+
+		return true;
+	}
+
+	int32_t ParallelBamReader::read_int()
+	{
+		char buffer[sizeof(int32_t)];
+		if (!this->read_exactly(buffer, sizeof(buffer)))
+			throw std::runtime_error("BAM file '" + this->_filename + "' ended prematurely");
+
+		return value_at<int32_t>(buffer);
+	}
+
+	void ParallelBamReader::read_header()
+	{
+		char magic[4];
+		if (!this->read_exactly(magic, sizeof(magic)) || std::memcmp(magic, "BAM\1", sizeof(magic)) != 0)
+			throw std::runtime_error("File '" + this->_filename + "' isn't a BAM file");
+
+		std::vector<char> text(size_t(std::max(this->read_int(), 0)));
+		this->read_exactly(text.data(), text.size());
+
+		int32_t references_num = this->read_int();
+		for (int32_t i = 0; i < references_num; ++i)
+		{
+			std::vector<char> name(size_t(std::max(this->read_int(), 0)));
+			this->read_exactly(name.data(), name.size());
+
+			BamTools::RefData reference;
+			reference.RefName.assign(name.data(), name.empty() ? 0 : name.size() - 1); // Without the null terminator
+			reference.RefLength = this->read_int();
+			this->_references.push_back(reference);
+		}
+	}
+
+	const BamTools::RefVector &ParallelBamReader::references() const
+	{
+		return this->_references;
+	}
+
+	bool ParallelBamReader::get_next_alignment(BamTools::BamAlignment &alignment)
+	{
+		if (!this->get_next_alignment_core(alignment))
+			return false;
+
+		this->decode_fields(alignment, ALL_FIELDS);
+		return true;
+	}
+
+	bool ParallelBamReader::get_next_alignment_core(BamTools::BamAlignment &alignment)
+	{
+		char size_buffer[sizeof(int32_t)];
+		if (!this->read_exactly(size_buffer, sizeof(size_buffer)))
+			return false;
+
+		int32_t block_size = value_at<int32_t>(size_buffer);
+		if (block_size < 32)
+			throw std::runtime_error("BAM file '" + this->_filename + "' is corrupted");
+
+		this->_record.resize(size_t(block_size));
+		this->read_exactly(this->_record.data(), this->_record.size());
+
+		const char *data = this->_record.data();
+		alignment.RefID = value_at<int32_t>(data);
+		alignment.Position = value_at<int32_t>(data + 4);
+		alignment.MapQuality = uint8_t(data[9]);
+		alignment.Bin = value_at<uint16_t>(data + 10);
+		alignment.AlignmentFlag = value_at<uint16_t>(data + 14);
+		alignment.Length = value_at<int32_t>(data + 16);
+		alignment.MateRefID = value_at<int32_t>(data + 20);
+		alignment.MatePosition = value_at<int32_t>(data + 24);
+		alignment.InsertSize = value_at<int32_t>(data + 28);
+		alignment.Filename = this->_filename;
+
+		alignment.Name.clear();
+		alignment.CigarData.clear();
+		alignment.QueryBases.clear();
+		alignment.AlignedBases.clear();
+		alignment.Qualities.clear();
+		alignment.TagData.clear();
+
+		return true;
+	}
+
+	void ParallelBamReader::decode_fields(BamTools::BamAlignment &alignment, int fields) const
+	{
+		static const char cigar_types[] = "MIDNSHP=X";
+		static const char bases[] = "=ACMGRSVTWYHKDBN";
+
+		const char *data = this->_record.data();
+		auto name_length = size_t(uint8_t(data[8]));
+		auto cigar_ops_num = size_t(value_at<uint16_t>(data + 12));
+		auto sequence_length = value_at<int32_t>(data + 16);
+
+		size_t cigar_offset = 32 + name_length;
+		size_t sequence_offset = cigar_offset + 4 * cigar_ops_num;
+		size_t quality_offset = sequence_offset + (size_t(std::max(sequence_length, 0)) + 1) / 2;
+		size_t tags_offset = quality_offset + size_t(std::max(sequence_length, 0));
+		if (sequence_length < 0 || tags_offset > this->_record.size())
+			throw std::runtime_error("BAM file '" + this->_filename + "' is corrupted");
+
+		if (fields & NAME)
+		{
+			alignment.Name.assign(data + 32, (name_length == 0) ? 0 : name_length - 1);
+		}
+
+		if (fields & (CIGAR | BASES)) // Aligned bases are built from CIGAR
+		{
+			alignment.CigarData.clear();
+			for (size_t i = 0; i < cigar_ops_num; ++i)
+			{
+				auto op = value_at<uint32_t>(data + cigar_offset + 4 * i);
+				BamTools::CigarOp cigar_op;
+				cigar_op.Type = ((op & 0xf) < sizeof(cigar_types) - 1) ? cigar_types[op & 0xf] : '?';
+				cigar_op.Length = op >> 4;
+				alignment.CigarData.push_back(cigar_op);
+			}
+		}
+
+		if (fields & BASES)
+		{
+			alignment.QueryBases.resize(size_t(sequence_length));
+			for (size_t i = 0; i < alignment.QueryBases.size(); ++i)
+			{
+				auto packed = uint8_t(data[sequence_offset + i / 2]);
+				alignment.QueryBases[i] = bases[(i % 2 == 0) ? (packed >> 4) : (packed & 0xf)];
+			}
+
+			// Reads without sequence have no aligned bases, even for deletions, as in BamTools
+			alignment.AlignedBases.clear();
+			size_t query_pos = 0;
+			for (size_t i = 0; i < alignment.CigarData.size() && !alignment.QueryBases.empty(); ++i)
+			{
+				auto const &op = alignment.CigarData[i];
+				switch (op.Type)
+				{
+					case 'M':
+					case 'I':
+					case '=':
+					case 'X':
+						if (query_pos < alignment.QueryBases.size())
+						{
+							alignment.AlignedBases.append(alignment.QueryBases, query_pos, op.Length);
+						}
+						query_pos += op.Length;
+						break;
+					case 'S':
+						query_pos += op.Length;
+						break;
+					case 'D':
+						alignment.AlignedBases.append(op.Length, '-');
+						break;
+					case 'P':
+						alignment.AlignedBases.append(op.Length, '*');
+						break;
+					case 'N':
+						alignment.AlignedBases.append(op.Length, 'N');
+						break;
+					default:
+						break;
+				}
+			}
+		}
+
+		if (fields & QUALITIES)
+		{
+			// Missing qualities are kept as 0xFF, as BamReader does
+			const char *qualities = data + quality_offset;
+			if (sequence_length > 0 && uint8_t(qualities[0]) == 0xFF)
+			{
+				alignment.Qualities.assign(size_t(sequence_length), char(0xFF));
+			}
+			else
+			{
+				alignment.Qualities.resize(size_t(sequence_length));
+				for (size_t i = 0; i < alignment.Qualities.size(); ++i)
+				{
+					alignment.Qualities[i] = char(qualities[i] + 33);
+				}
+			}
+		}
+
+		if (fields & TAGS)
+		{
+			alignment.TagData.assign(data + tags_offset, this->_record.size() - tags_offset);
+		}
+	}
+}
+}
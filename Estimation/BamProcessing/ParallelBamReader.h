@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Tools/ParallelGzReader.h>
+#include <api/BamAlignment.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Estimation
+{
+	namespace BamProcessing
+	{
+		// Reads alignments of a BAM file, which BGZF blocks are inflated ahead of the consumer by a pool of threads.
+		// Records are decoded in the original order and have the same fields as after
+		// BamTools::BamReader::GetNextAlignment. Header text isn't kept, as it's read by BamReader for the output.
+		class ParallelBamReader
+		{
+		public:
+			// Variable-length fields of a record, which can be decoded on demand
+			enum Field
+			{
+				NAME = 1,
+				CIGAR = 2,
+				BASES = 4, // QueryBases and AlignedBases
+				QUALITIES = 8,
+				TAGS = 16,
+				ALL_FIELDS = NAME | CIGAR | BASES | QUALITIES | TAGS
+			};
+
+		private:
+			const std::string _filename;
+			Tools::ParallelGzReader _in_reader;
+			BamTools::RefVector _references;
+			std::vector<char> _record;
+
+		private:
+			bool read_exactly(char *buffer, size_t size);
+			int32_t read_int();
+			void read_header();
+
+		public:
+			// threads_num threads inflate BGZF blocks. With zero threads, they're inflated by the reading thread
+			ParallelBamReader(const std::string &filename, size_t threads_num);
+
+			// Reads alignments from a virtual offset (see index_offsets()). The header isn't read, so the references
+			// must be provided.
+			ParallelBamReader(const std::string &filename, const BamTools::RefVector &references, uint64_t virtual_offset,
+			                  size_t threads_num);
+
+			// Finds virtual offsets, from which all alignments, which start at or after each of the (ref_id, position),
+			// can be read in a coordinate-sorted file. Offsets are taken from the linear index of the .bai file, and 0
+			// means that the alignments must be read from the beginning. Returns false if the file has no .bai index.
+			static bool index_offsets(const std::string &filename, const std::vector<std::pair<int32_t, int32_t>> &positions,
+			                          std::vector<uint64_t> &offsets);
+
+			const BamTools::RefVector& references() const;
+			bool get_next_alignment(BamTools::BamAlignment &alignment);
+
+			// Decodes only the fixed-length fields, as BamReader::GetNextAlignmentCore. The rest of the fields are empty
+			// and can be decoded with decode_fields() before the next record is read.
+			bool get_next_alignment_core(BamTools::BamAlignment &alignment);
+			void decode_fields(BamTools::BamAlignment &alignment, int fields) const;
+		};
+	}
+}
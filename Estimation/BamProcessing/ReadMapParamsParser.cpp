@@ -1,5 +1,6 @@
 #include "ReadMapParamsParser.h"
 
+#include <Tools/BinaryReadParams.h>
 #include <Tools/Logs.h>
 #include <Tools/UtilFunctions.h>
 
@@ -7,16 +8,25 @@
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/algorithm/string.hpp>
 
+#include <algorithm>
+#include <condition_variable>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 namespace Estimation
 {
 namespace BamProcessing
 {
 	ReadMapParamsParser::ReadMapParamsParser(const std::string &gtf_path, const std::string &read_param_filenames,
-	                                         const BamTags &tags, bool gene_in_chromosome_name, int min_quality)
+	                                         const BamTags &tags, bool gene_in_chromosome_name, int min_quality,
+	                                         size_t threads_num)
 		: ReadParamsParser(gtf_path, tags, gene_in_chromosome_name)
 		, _min_quality(min_quality)
+		, _loaded_reads_num(0)
 	{
-		this->init(read_param_filenames);
+		this->init(read_param_filenames, std::max(threads_num, size_t(1)));
 	}
 
 	bool ReadMapParamsParser::get_read_params(const BamTools::BamAlignment &alignment,
@@ -24,89 +34,392 @@ namespace BamProcessing
 	{
 		const std::string &read_name = (alignment.Name[0] == '@') ? alignment.Name.substr(1) : alignment.Name;
 
-		auto iter = this->_read_params.find(read_name);
-		bool read_not_found = (iter == this->_read_params.end());
-
-		if (!read_not_found)
-		{
-			read_params = iter->second.parameters(this->_barcode_indexer, this->_umi_indexer, this->_umi_quality_indexer);
-			this->_read_params.erase(iter);
-		}
-
-		if (read_not_found)
+		auto params = this->_params_index.take(read_name);
+		if (params == nullptr)
 		{
 			L_WARN << "WARNING: can't find read name: " << read_name;
 			return false;
 		}
 
-		if (read_params.is_empty())
+		if (params->is_empty())
 		{
 			L_WARN << "WARNING: empty parameters for read name: " << read_name;
 			return false;
 		}
 
+		read_params = params->parameters(this->_params_index.barcode_indexer, this->_params_index.umi_indexer,
+		                                 this->_params_index.umi_quality_indexer);
 		return true;
 	}
 
-	void ReadMapParamsParser::init(const std::string &read_param_filenames)
+	void ReadMapParamsParser::init(const std::string &read_param_filenames, size_t threads_num)
 	{
 		std::vector<std::string> param_filenames;
 		boost::split(param_filenames, read_param_filenames, boost::is_any_of(" \t"));
-		size_t total_reads_count = 0;
+		param_filenames.erase(std::remove(param_filenames.begin(), param_filenames.end(), ""), param_filenames.end());
+
+		// Files are parsed concurrently into separate indexes, which are merged in the order of the files,
+		// so the first record of a duplicated read is kept, as in sequential loading. The rest of the threads
+		// decompress each file.
+		const size_t files_threads_num = std::min(threads_num, std::max<size_t>(param_filenames.size(), 1));
+		const size_t reader_threads_num = std::max<size_t>(threads_num / files_threads_num, 1);
+
+		std::vector<std::unique_ptr<ParamsIndex>> file_indexes(param_filenames.size());
+		std::vector<std::exception_ptr> file_errors(param_filenames.size());
+		std::atomic<size_t> next_file_ind(0);
+		std::mutex loaded_mutex;
+		std::condition_variable file_loaded;
+
 		L_TRACE << "Start loading read parameters";
-		for (auto const &name : param_filenames)
+		std::vector<std::thread> threads;
+		for (size_t thread_ind = 0; thread_ind < files_threads_num; ++thread_ind)
 		{
-			if (name.empty())
-				continue;
-
-			auto name_full = Tools::expand_tilde_in_path(name);
-			L_TRACE << "Start reading file: " << name_full;
-			std::ifstream ifs(name_full);
+			threads.emplace_back([&, reader_threads_num]{
+				for (size_t file_ind = next_file_ind++; file_ind < param_filenames.size(); file_ind = next_file_ind++)
+				{
+					std::unique_ptr<ParamsIndex> index(new ParamsIndex());
+					std::exception_ptr error;
+					try
+					{
+						this->load_file(Tools::expand_tilde_in_path(param_filenames[file_ind]), reader_threads_num, *index);
+					}
+					catch (...)
+					{
+						error = std::current_exception();
+					}
 
-			if (!ifs)
-				throw std::runtime_error("Can't open file with read parameters'" + name_full + "'");
+					{
+						std::lock_guard<std::mutex> lock(loaded_mutex);
+						file_indexes[file_ind] = std::move(index);
+						file_errors[file_ind] = error;
+					}
+					file_loaded.notify_all();
+				}
+			});
+		}
 
-			boost::iostreams::filtering_istream gz_fs;
-			gz_fs.push(boost::iostreams::gzip_decompressor());
-			gz_fs.push(ifs);
-			std::string row;
-			while (std::getline(gz_fs, row))
+		std::exception_ptr error;
+		for (size_t file_ind = 0; file_ind < param_filenames.size(); ++file_ind)
+		{
+			std::unique_ptr<ParamsIndex> index;
 			{
-				if (row.empty())
-					continue;
-
-				total_reads_count++;
-				if (total_reads_count % 10000000 == 0)
+				std::unique_lock<std::mutex> lock(loaded_mutex);
+				file_loaded.wait(lock, [&]{ return file_indexes[file_ind] != nullptr; });
+				index = std::move(file_indexes[file_ind]);
+				if (file_errors[file_ind])
 				{
-					L_TRACE << "Total " << total_reads_count << " read records processed" << std::flush;
+					error = file_errors[file_ind];
+					next_file_ind = param_filenames.size(); // Other files aren't needed anymore
+					break;
 				}
+			}
+
+			this->_params_index.merge(std::move(*index));
+		}
+
+		for (auto &thread : threads)
+		{
+			thread.join();
+		}
+
+		if (error)
+			std::rethrow_exception(error);
+
+		this->_params_index.finalize();
+		L_TRACE << "All read parameters were loaded";
+	}
+
+	void ReadMapParamsParser::load_file(const std::string &filename, size_t threads_num, ParamsIndex &index)
+	{
+		L_TRACE << "Start reading file: " << filename;
+		std::ifstream ifs(filename);
+
+		if (!ifs)
+			throw std::runtime_error("Can't open file with read parameters'" + filename + "'");
+
+		if (Tools::BinaryReadParams::is_binary_file(filename))
+		{
+			this->load_binary(filename, threads_num, index);
+			return;
+		}
+
+		boost::iostreams::filtering_istream gz_fs;
+		gz_fs.push(boost::iostreams::gzip_decompressor());
+		gz_fs.push(ifs);
+		std::string row;
+		while (std::getline(gz_fs, row))
+		{
+			if (row.empty())
+				continue;
+
+			this->count_loaded_read();
+
+			try
+			{
+				auto params_pair = Tools::ReadParameters::parse_from_string(row, this->_min_quality);
+				auto params = ReadParametersEfficient(params_pair.second, index.barcode_indexer, index.umi_indexer,
+				                                      index.umi_quality_indexer);
+				index.add(params_pair.first, params);
+			}
+			catch (std::runtime_error &err)
+			{
+				L_ERR << err.what();
+				continue;
+			}
+
+		}
+
+		if (gz_fs.bad())
+			throw std::runtime_error("Can't read file with read parameters '" + filename + "'");
+	}
+
+	void ReadMapParamsParser::load_binary(const std::string &filename, size_t threads_num, ParamsIndex &index)
+	{
+		Tools::BinaryReadParams::Reader reader(filename, threads_num);
+		std::vector<Tools::BinaryReadParams::Record> records;
+		while (reader.next_block(records))
+		{
+			for (auto const &record : records)
+			{
+				this->count_loaded_read();
 
 				try
 				{
-					auto params_pair = Tools::ReadParameters::parse_from_string(row, this->_min_quality);
-					auto params = ReadParametersEfficient(params_pair.second, this->_barcode_indexer, this->_umi_indexer,
-					                                      this->_umi_quality_indexer);
-					auto ins_iter = this->_read_params.emplace(params_pair.first, params);
-
-					if (!ins_iter.second)
-					{
-						L_ERR << "Read name is already in map: " << ins_iter.first->first << ", old value: '"
-						      << ins_iter.first->second.parameters(this->_barcode_indexer, this->_umi_indexer,
-						                                           this->_umi_quality_indexer).to_string("").substr(1);
-						continue;
-					}
+					auto params = ReadParametersEfficient(record.parameters(this->_min_quality), index.barcode_indexer,
+					                                      index.umi_indexer, index.umi_quality_indexer);
+					index.add(reader.read_name_prefix(), size_t(record.read_number), params);
 				}
 				catch (std::runtime_error &err)
 				{
 					L_ERR << err.what();
-					continue;
 				}
+			}
+		}
+	}
+
+	void ReadMapParamsParser::count_loaded_read()
+	{
+		size_t reads_num = ++this->_loaded_reads_num;
+		if (reads_num % 10000000 == 0)
+		{
+			L_TRACE << "Total " << reads_num << " read records processed" << std::flush;
+		}
+	}
+
+	bool ReadMapParamsParser::ParamsIndex::split_read_name(const std::string &read_name, boost::string_ref &prefix,
+	                                                       size_t &read_number)
+	{
+		// Leading zeros aren't allowed, so each name has a single pair of prefix and number
+		size_t number_start = read_name.find_last_not_of("0123456789") + 1; // npos + 1 == 0
+		size_t number_length = read_name.length() - number_start;
+		if (number_length == 0 || number_length > 18 || read_name[number_start] == '0')
+			return false;
+
+		prefix = boost::string_ref(read_name).substr(0, number_start);
+		read_number = std::stoull(read_name.substr(number_start));
+		return true;
+	}
 
+	ReadMapParamsParser::ParamsIndex::IndexedParams*
+	ReadMapParamsParser::ParamsIndex::find_indexed(const boost::string_ref &prefix)
+	{
+		auto indexed_it = std::find_if(this->_indexed_params.begin(), this->_indexed_params.end(),
+		                               [&prefix](const IndexedParams &p) { return p.prefix == prefix; });
+		if (indexed_it == this->_indexed_params.end())
+			return nullptr;
+
+		return &(*indexed_it);
+	}
+
+	ReadMapParamsParser::ParamsIndex::IndexedParams*
+	ReadMapParamsParser::ParamsIndex::indexed_slot(const boost::string_ref &prefix, size_t read_number)
+	{
+		auto indexed_ptr = this->find_indexed(prefix);
+		if (indexed_ptr == nullptr)
+		{
+			// Names without a common prefix are kept in the map
+			if (this->_indexed_params.size() >= ParamsIndex::max_indexed_prefixes)
+				return nullptr;
+
+			this->_indexed_params.push_back(IndexedParams{prefix.to_string(), read_number, {}, {}, nullptr});
+			indexed_ptr = &this->_indexed_params.back();
+		}
+
+		auto &indexed = *indexed_ptr;
+		if (read_number >= indexed.first_number && read_number - indexed.first_number < indexed.params.size())
+			return &indexed;
+
+		// Numbers are dense for droptag reads, though a file can start from any number and threads write
+		// them slightly out of order. Sparse ones would waste memory, so they're kept in the map.
+		size_t max_gap = 2 * indexed.params.size() + ParamsIndex::max_index_gap;
+		if (read_number < indexed.first_number)
+		{
+			if (indexed.first_number - read_number > max_gap)
+				return nullptr;
+
+			// The front grows geometrically, so reads in the reverse order don't shift the vector each time.
+			// Numbers start from 1, and the unused slots are removed by finalize().
+			size_t front_size = std::min(std::max(indexed.first_number - read_number, indexed.params.size()),
+			                             indexed.first_number - 1);
+			indexed.params.insert(indexed.params.begin(), front_size, ReadParametersEfficient());
+			indexed.filled.insert(indexed.filled.begin(), front_size, false);
+			indexed.first_number -= front_size;
+		}
+		else
+		{
+			if (read_number - indexed.first_number > max_gap)
+				return nullptr;
+
+			indexed.params.resize(read_number - indexed.first_number + 1);
+			indexed.filled.resize(indexed.params.size(), false);
+		}
+
+		return &indexed;
+	}
+
+	void ReadMapParamsParser::ParamsIndex::add(const std::string &read_name, const ReadParametersEfficient &params)
+	{
+		boost::string_ref prefix;
+		size_t read_number;
+		if (ParamsIndex::split_read_name(read_name, prefix, read_number))
+		{
+			this->add(prefix, read_number, params);
+			return;
+		}
+
+		this->add_named(read_name, params);
+	}
+
+	void ReadMapParamsParser::ParamsIndex::add(const boost::string_ref &prefix, size_t read_number,
+	                                           const ReadParametersEfficient &params)
+	{
+		auto indexed = (read_number != 0) ? this->indexed_slot(prefix, read_number) : nullptr;
+		if (indexed == nullptr)
+		{
+			this->add_named(prefix.to_string() + std::to_string(read_number), params);
+			return;
+		}
+
+		size_t slot_ind = read_number - indexed->first_number;
+		if (indexed->filled[slot_ind])
+		{
+			this->report_duplicate(prefix.to_string() + std::to_string(read_number), indexed->params[slot_ind]);
+			return;
+		}
+
+		// The read could be put to the map before the slot was allocated
+		if (!this->_read_params.empty())
+		{
+			auto named_it = this->_read_params.find(prefix.to_string() + std::to_string(read_number));
+			if (named_it != this->_read_params.end())
+			{
+				this->report_duplicate(named_it->first, named_it->second.params);
+				return;
 			}
 		}
 
-		L_TRACE << "All read parameters were loaded";
+		indexed->params[slot_ind] = params;
+		indexed->filled[slot_ind] = true;
+	}
+
+	void ReadMapParamsParser::ParamsIndex::add_named(const std::string &read_name, const ReadParametersEfficient &params)
+	{
+		auto ins_iter = this->_read_params.emplace(read_name, params);
+		if (!ins_iter.second)
+		{
+			this->report_duplicate(read_name, ins_iter.first->second.params);
+		}
+	}
+
+	void ReadMapParamsParser::ParamsIndex::merge(ParamsIndex &&other)
+	{
+		if (this->_indexed_params.empty() && this->_read_params.empty())
+		{
+			*this = std::move(other);
+			return;
+		}
+
+		std::vector<uint32_t> barcode_ids, umi_ids, umi_quality_ids;
+		for (auto const &value : other.barcode_indexer.values())
+		{
+			barcode_ids.push_back(uint32_t(this->barcode_indexer.add(value)));
+		}
+
+		for (auto const &value : other.umi_indexer.values())
+		{
+			umi_ids.push_back(uint32_t(this->umi_indexer.add(value)));
+		}
+
+		for (auto const &value : other.umi_quality_indexer.values())
+		{
+			umi_quality_ids.push_back(uint32_t(this->umi_quality_indexer.add(value)));
+		}
+
+		for (auto const &indexed : other._indexed_params)
+		{
+			for (size_t i = 0; i < indexed.params.size(); ++i)
+			{
+				if (!indexed.filled[i])
+					continue;
+
+				this->add(indexed.prefix, indexed.first_number + i,
+				          indexed.params[i].remapped(barcode_ids, umi_ids, umi_quality_ids));
+			}
+		}
+
+		for (auto const &named : other._read_params)
+		{
+			this->add(named.first, named.second.params.remapped(barcode_ids, umi_ids, umi_quality_ids));
+		}
+
+		other = ParamsIndex();
+	}
+
+	void ReadMapParamsParser::ParamsIndex::finalize()
+	{
+		for (auto &indexed_params : this->_indexed_params)
+		{
+			auto front_size = size_t(std::find(indexed_params.filled.begin(), indexed_params.filled.end(), true) -
+			                         indexed_params.filled.begin());
+			indexed_params.first_number += front_size;
+			indexed_params.params.erase(indexed_params.params.begin(), indexed_params.params.begin() + front_size);
+			indexed_params.filled.erase(indexed_params.filled.begin(), indexed_params.filled.begin() + front_size);
+			indexed_params.params.shrink_to_fit();
+			indexed_params.filled.shrink_to_fit();
+			indexed_params.consumed.reset(new std::atomic<bool>[indexed_params.params.size()]());
+		}
+	}
+
+	const ReadParametersEfficient* ReadMapParamsParser::ParamsIndex::take(const std::string &read_name)
+	{
+		// Entries aren't erased, as lookups run concurrently, so taken reads are marked instead
+		boost::string_ref prefix;
+		size_t read_number;
+		if (ParamsIndex::split_read_name(read_name, prefix, read_number))
+		{
+			auto indexed = this->find_indexed(prefix);
+			if (indexed != nullptr && read_number >= indexed->first_number &&
+				read_number - indexed->first_number < indexed->params.size())
+			{
+				size_t slot_ind = read_number - indexed->first_number;
+				if (indexed->filled[slot_ind])
+					return indexed->consumed[slot_ind].exchange(true) ? nullptr : &indexed->params[slot_ind];
+			}
+		}
+
+		auto iter = this->_read_params.find(read_name);
+		if (iter == this->_read_params.end() || iter->second.consumed.exchange(true))
+			return nullptr;
+
+		return &iter->second.params;
+	}
+
+	void ReadMapParamsParser::ParamsIndex::report_duplicate(const std::string &read_name,
+	                                                        const ReadParametersEfficient &old_params)
+	{
+		L_ERR << "Read name is already in map: " << read_name << ", old value: '"
+		      << (old_params.is_empty() ? "" : old_params.parameters(this->barcode_indexer, this->umi_indexer,
+		                                                             this->umi_quality_indexer).to_string("").substr(1));
 	}
 }
 }
-
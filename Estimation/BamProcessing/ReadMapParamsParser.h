@@ -6,28 +6,108 @@
 #include <Tools/ReadParameters.h>
 #include <api/BamAlignment.h>
 
+#include <boost/utility/string_ref.hpp>
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+namespace TestEstimator
+{
+	struct testReadParamsIndexNames;
+	struct testReadParamsIndexGaps;
+	struct testReadParamsEmpty;
+}
+
 namespace Estimation
 {
 	namespace BamProcessing
 	{
 		class ReadMapParamsParser : public ReadParamsParser
 		{
+			friend struct TestEstimator::testReadParamsIndexNames;
+			friend struct TestEstimator::testReadParamsIndexGaps;
+			friend struct TestEstimator::testReadParamsEmpty;
+
 		private:
-			int _min_quality;
-			ReadParametersEfficient::reads_params_map_t _read_params;
+			// Parameters of reads with own string indexes. Each file is loaded into a separate index,
+			// so files are parsed concurrently and merged in the order of the files.
+			class ParamsIndex
+			{
+				friend struct TestEstimator::testReadParamsIndexNames;
+				friend struct TestEstimator::testReadParamsIndexGaps;
+				friend struct TestEstimator::testReadParamsEmpty;
+
+			private:
+				// Parameters of reads, which are named '<prefix><number>', as droptag does ('<uid><read number>').
+				// They're stored by number in a vector, which takes a few bytes per read.
+				struct IndexedParams
+				{
+					std::string prefix;
+					size_t first_number;
+					std::vector<ReadParametersEfficient> params;
+					std::vector<bool> filled; // Slots with a read, as parameters of a read can be empty
+					std::unique_ptr<std::atomic<bool>[]> consumed; // Allocated by finalize()
+				};
+
+				struct NamedParams
+				{
+					ReadParametersEfficient params;
+					std::atomic<bool> consumed;
+
+					NamedParams(const ReadParametersEfficient &params)
+						: params(params)
+						, consumed(false)
+					{}
+				};
 
-			StringIndexer _barcode_indexer;
-			StringIndexer _umi_indexer;
-			StringIndexer _umi_quality_indexer;
+				static const size_t max_indexed_prefixes = 64;
+				static const size_t max_index_gap = 1 << 20;
+
+				std::vector<IndexedParams> _indexed_params;
+				std::unordered_map<std::string, NamedParams> _read_params; // Reads with other names
+
+			public:
+				StringIndexer barcode_indexer;
+				StringIndexer umi_indexer;
+				StringIndexer umi_quality_indexer;
+
+			private:
+				IndexedParams* find_indexed(const boost::string_ref &prefix);
+				// Returns the index, which has a slot for the read number, or nullptr if the read must be kept in the map
+				IndexedParams* indexed_slot(const boost::string_ref &prefix, size_t read_number);
+				void add_named(const std::string &read_name, const ReadParametersEfficient &params);
+				void report_duplicate(const std::string &read_name, const ReadParametersEfficient &old_params);
+
+				static bool split_read_name(const std::string &read_name, boost::string_ref &prefix, size_t &read_number);
+
+			public:
+				void add(const std::string &read_name, const ReadParametersEfficient &params);
+				void add(const boost::string_ref &prefix, size_t read_number, const ReadParametersEfficient &params);
+				void merge(ParamsIndex &&other);
+				void finalize();
+
+				// Each read is returned only once, so supplementary alignments and reads, which are present in
+				// several BAM files, are counted once. Thread-safe after finalize().
+				const ReadParametersEfficient* take(const std::string &read_name);
+			};
+
+			int _min_quality;
+			ParamsIndex _params_index;
+			std::atomic<size_t> _loaded_reads_num;
 
 		private:
-			void init(const std::string &read_param_filenames);
+			void init(const std::string &read_param_filenames, size_t threads_num);
+			void load_file(const std::string &filename, size_t threads_num, ParamsIndex &index);
+			void load_binary(const std::string &filename, size_t threads_num, ParamsIndex &index);
+			void count_loaded_read();
 
 		public:
 			ReadMapParamsParser(const std::string &gtf_path, const std::string &read_param_filenames,
-			                    const BamTags &tags, bool gene_in_chromosome_name, int min_quality);
+			                    const BamTags &tags, bool gene_in_chromosome_name, int min_quality,
+			                    size_t threads_num = 1);
 
 			bool get_read_params(const BamTools::BamAlignment &alignment, Tools::ReadParameters &read_params) override;
 		};
 	}
-}
\ No newline at end of file
+}
@@ -2,6 +2,9 @@
 #include <Tools/ReadParameters.h>
 #include <Tools/GeneAnnotation/RefGenesContainer.h>
 #include "ReadParamsParser.h"
+#include "ParallelBamReader.h"
+
+#include <cstring>
 
 namespace Estimation
 {
@@ -33,7 +36,23 @@ namespace BamProcessing
 		return true;
 	}
 
-	UMI::Mark ReadParamsParser::get_gene(const std::string &chr_name, BamTools::BamAlignment alignment,
+	int ReadParamsParser::used_fields() const
+	{
+		return ParallelBamReader::NAME | this->gene_fields();
+	}
+
+	int ReadParamsParser::gene_fields() const
+	{
+		if (this->_gene_in_chromosome_name)
+			return 0;
+
+		if (!this->_genes_container.is_empty())
+			return ParallelBamReader::CIGAR; // For the end position
+
+		return ParallelBamReader::TAGS;
+	}
+
+	UMI::Mark ReadParamsParser::get_gene(const std::string &chr_name, const BamTools::BamAlignment &alignment,
 	                                     std::string &gene) const
 	{
 		UMI::Mark mark;
@@ -195,5 +214,80 @@ namespace BamProcessing
 
 		return true;
 	}
+
+	unsigned ReadParamsParser::get_string_tags(const BamTools::BamAlignment &alignment, const std::string *const tags[],
+	                                           std::string values[], size_t tags_num)
+	{
+		const char *data = alignment.TagData.data();
+		const char *data_end = data + alignment.TagData.size();
+		const unsigned all_found = (1u << tags_num) - 1;
+		unsigned found = 0;
+
+		while (data + 3 <= data_end && found != all_found)
+		{
+			const char *tag = data;
+			char type = data[2];
+			data += 3;
+
+			size_t value_size;
+			switch (type)
+			{
+				case 'A':
+				case 'c':
+				case 'C':
+					value_size = 1;
+					break;
+				case 's':
+				case 'S':
+					value_size = 2;
+					break;
+				case 'i':
+				case 'I':
+				case 'f':
+					value_size = 4;
+					break;
+				case 'Z':
+				case 'H':
+				{
+					auto value_end = static_cast<const char*>(std::memchr(data, '\0', data_end - data));
+					if (value_end == nullptr)
+						return found;
+
+					for (size_t i = 0; i < tags_num; ++i)
+					{
+						if ((found & (1u << i)) || tags[i]->size() != 2 || tags[i]->compare(0, 2, tag, 2) != 0)
+							continue;
+
+						values[i].assign(data, value_end);
+						found |= 1u << i;
+						break;
+					}
+
+					value_size = value_end - data + 1;
+					break;
+				}
+				case 'B':
+				{
+					if (data + 5 > data_end)
+						return found;
+
+					int32_t elements_num;
+					std::memcpy(&elements_num, data + 1, sizeof(elements_num));
+					size_t element_size = (data[0] == 'c' || data[0] == 'C') ? 1 : (data[0] == 's' || data[0] == 'S') ? 2 : 4;
+					value_size = 5 + element_size * size_t(std::max(elements_num, 0));
+					break;
+				}
+				default:
+					return found; // Malformed tag data
+			}
+
+			if (value_size > size_t(data_end - data))
+				return found;
+
+			data += value_size;
+		}
+
+		return found;
+	}
 }
 }
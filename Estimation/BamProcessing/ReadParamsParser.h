@@ -27,6 +27,14 @@ namespace Estimation
 		protected:
 			const BamTags tags;
 
+		protected:
+			int gene_fields() const;
+
+			// Finds values of several string tags ('Z' or 'H') with a single pass over the tag data.
+			// Returns the mask of the found tags: bit i is set if tags[i] is present.
+			static unsigned get_string_tags(const BamTools::BamAlignment &alignment, const std::string *const tags[],
+			                                std::string values[], size_t tags_num);
+
 		private:
 			static bool get_bam_tag(const BamTools::BamAlignment &alignment, const std::string &tag, std::string &value);
 
@@ -41,8 +49,11 @@ namespace Estimation
 			ReadParamsParser(const std::string &genes_filename, const BamTags &tags, bool gene_in_chromosome_name);
 
 			virtual bool get_read_params(const BamTools::BamAlignment &alignment, Tools::ReadParameters &read_params);
-			UMI::Mark get_gene(const std::string &chr_name, BamTools::BamAlignment alignment,
-			                                  std::string &gene) const;
+			UMI::Mark get_gene(const std::string &chr_name, const BamTools::BamAlignment &alignment,
+			                   std::string &gene) const;
+
+			// Mask of ParallelBamReader::Field, which are used by get_read_params() and get_gene()
+			virtual int used_fields() const;
 
 			bool has_introns() const;
 		};
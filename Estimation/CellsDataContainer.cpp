@@ -35,6 +35,19 @@ namespace Estimation
 		L_TRACE << this->_merge_strategy->merge_type() << " merge selected.";
 	}
 
+	CellsDataContainer::CellsDataContainer(const CellsDataContainer *prototype)
+		: _merge_strategy(prototype->_merge_strategy)
+		, _umi_merge_strategy(prototype->_umi_merge_strategy)
+		, _save_umi_merge_targets(prototype->_save_umi_merge_targets)
+		, _max_cells_num(prototype->_max_cells_num)
+		, _is_initialized(false)
+		, _query_marks(prototype->_query_marks)
+		, _has_exon_reads(0)
+		, _has_intron_reads(0)
+		, _has_not_annotated_reads(0)
+		, _number_of_real_cells(0)
+	{}
+
 	void CellsDataContainer::merge_and_filter()
 	{
 		if (!this->_is_initialized)
@@ -85,6 +98,56 @@ namespace Estimation
 		this->update_cell_stats(cell_id, read_info.umi_mark, read_info.chromosome_name);
 	}
 
+	std::unique_ptr<CellsDataContainer> CellsDataContainer::create_partial() const
+	{
+		return std::unique_ptr<CellsDataContainer>(new CellsDataContainer(this));
+	}
+
+	void CellsDataContainer::add_records(const CellsDataContainer &partial)
+	{
+		if (this->_is_initialized || partial._is_initialized)
+			throw runtime_error("Container is already initialized");
+
+		// Indexes are assigned in the order of the first occurrence, so genes and UMIs get the same ids as in sequential filling
+		std::vector<StringIndexer::index_t> gene_ids, umi_ids;
+		for (auto const &gene : partial._gene_indexer.values())
+		{
+			gene_ids.push_back(this->_gene_indexer.add(gene));
+		}
+
+		for (auto const &umi : partial._umi_indexer.values())
+		{
+			umi_ids.push_back(this->_umi_indexer.add(umi));
+		}
+
+		for (auto const &source_cell : partial._cells)
+		{
+			auto res = this->_cell_ids_by_cb.emplace(source_cell.barcode_c(), this->_cell_ids_by_cb.size());
+			if (res.second)
+			{
+				this->_cells.emplace_back(source_cell.barcode(), this->_merge_strategy->min_genes_before_merge(),
+				                          &this->_gene_indexer, &this->_umi_indexer);
+			}
+
+			auto &target_cell = this->_cells[res.first->second];
+			target_cell.stats().merge(source_cell.stats());
+
+			for (auto const &gene : source_cell.genes())
+			{
+				auto gene_it = target_cell.genes().emplace(gene_ids[gene.first], Gene(&this->_umi_indexer, this->_save_umi_merge_targets));
+				size_t new_umis_num = gene_it.first->second.add_reads(gene.second, umi_ids);
+				for (size_t i = new_umis_num; i < gene.second.size(); ++i)
+				{
+					target_cell.stats().dec(Stats::TOTAL_UMIS_PER_CB); // The UMI is already counted in the target cell
+				}
+			}
+		}
+
+		this->_has_exon_reads += partial._has_exon_reads;
+		this->_has_intron_reads += partial._has_intron_reads;
+		this->_has_not_annotated_reads += partial._has_not_annotated_reads;
+	}
+
 	void CellsDataContainer::merge_cells(size_t source_cell_ind, size_t target_cell_ind)
 	{
 		auto &source_cell = this->_cells.at(source_cell_ind);
@@ -9,6 +9,7 @@
 #include <string>
 
 #include <map>
+#include <memory>
 #include <vector>
 #include <unordered_map>
 #include <fstream>
@@ -77,6 +78,8 @@ namespace Estimation
 
 		size_t update_filtered_gene_counts(size_t requested_genes_threshold, int cell_threshold);
 
+		explicit CellsDataContainer(const CellsDataContainer *prototype);
+
 	public:
 		CellsDataContainer(const std::shared_ptr<Merge::MergeStrategyAbstract> &merge_strategy,
 		                   const std::shared_ptr<Merge::UMIs::MergeUMIsStrategyAbstract> &umi_merge_strategy,
@@ -84,6 +87,11 @@ namespace Estimation
 		                   int max_cells_num = -1);
 
 		void add_record(const ReadInfo &read_info);
+
+		// Partial containers are filled independently (e.g. one per BAM file). Adding them with add_records() in the
+		// order of the files gives the same result as adding all records to this container in the same order.
+		std::unique_ptr<CellsDataContainer> create_partial() const;
+		void add_records(const CellsDataContainer &partial);
 		void exclude_cell(size_t index);
 
 		void add_umi_to_cell(size_t cell_id, const ReadInfo &read_info);
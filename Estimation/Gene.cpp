@@ -23,6 +23,24 @@ namespace Estimation
 		return insert_it.second;
 	}
 
+	size_t Gene::add_reads(const Gene &source, const std::vector<StringIndexer::index_t> &umi_ids)
+	{
+		size_t new_umis_num = 0;
+		for (auto const &source_umi : source._umis)
+		{
+			auto insert_it = this->_umis.emplace(umi_ids.at(source_umi.first), source_umi.second);
+			if (insert_it.second)
+			{
+				new_umis_num++;
+				continue;
+			}
+
+			insert_it.first->second.add_reads(source_umi.second);
+		}
+
+		return new_umis_num;
+	}
+
 	void Gene::merge(const Gene &source)
 	{
 		for (auto const &merged_umi: source._umis)
@@ -3,6 +3,7 @@
 #include <map>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "UMI.h"
 #include "StringIndexer.h"
@@ -40,6 +41,7 @@ namespace Estimation
 		s_ul_hash_t requested_reads_per_umi(const UMI::Mark::query_t &query) const;
 
 		bool add_umi(const ReadInfo &read_info);
+		size_t add_reads(const Gene &source, const std::vector<StringIndexer::index_t> &umi_ids);
 		void merge(const Gene& source);
 		void merge(const std::string& source_umi, const std::string& target_umi);
 	};
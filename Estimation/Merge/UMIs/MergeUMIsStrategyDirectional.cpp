@@ -1,6 +1,7 @@
 #include "MergeUMIsStrategyDirectional.h"
 
 #include <Tools/Logs.h>
+#include <Tools/SequenceKernels.h>
 #include <Tools/UtilFunctions.h>
 
 namespace Estimation
@@ -85,7 +86,7 @@ namespace UMIs
 	std::string MergeUMIsStrategyDirectional::find_target(size_t src_id, MergeUMIsStrategyDirectional::umi_vec_t &umis) const
 	{
 		auto const &src_umi = umis[src_id];
-		const bool has_ns = (src_umi.sequence.find('N') != std::string::npos);
+		const bool has_ns = Tools::Kernels::contains_n(src_umi.sequence.data(), src_umi.sequence.length());
 
 		std::string target;
 		unsigned min_ed = std::numeric_limits<unsigned>::max();
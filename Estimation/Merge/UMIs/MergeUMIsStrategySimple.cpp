@@ -1,6 +1,7 @@
 #include "MergeUMIsStrategySimple.h"
 
 #include <Tools/Logs.h>
+#include <Tools/SequenceKernels.h>
 #include <Tools/UtilFunctions.h>
 
 #include <limits>
@@ -60,7 +61,7 @@ void MergeUMIsStrategySimple::merge(CellsDataContainer &container) const
 
 bool MergeUMIsStrategySimple::is_umi_real(const std::string &umi) const
 {
-	return umi.find('N') == std::string::npos;
+	return !Tools::Kernels::contains_n(umi.data(), umi.length());
 }
 
 CellsDataContainer::s_s_hash_t MergeUMIsStrategySimple::find_targets(const StringIndexer &umi_indexer,
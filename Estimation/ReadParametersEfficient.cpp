@@ -2,14 +2,22 @@
 
 namespace Estimation
 {
+	ReadParametersEfficient::ReadParametersEfficient()
+		: _cell_barcode_id(0)
+		, _umi_id(0)
+		, _umi_quality_id(0)
+		, _pass_quality_threshold(false)
+		, _is_empty(true)
+	{}
+
 	ReadParametersEfficient::ReadParametersEfficient(const Tools::ReadParameters &parameters,
 	                                                 StringIndexer &barcode_indexer, StringIndexer &umi_indexer,
 	                                                 StringIndexer &umi_quality_indexer)
-		: _is_empty(parameters.is_empty())
-		, _cell_barcode_id(barcode_indexer.add(parameters.cell_barcode()))
-		, _umi_id(umi_indexer.add(parameters.umi()))
-		, _umi_quality_id(umi_quality_indexer.add(parameters.umi_quality()))
+		: _cell_barcode_id(uint32_t(barcode_indexer.add(parameters.cell_barcode())))
+		, _umi_id(uint32_t(umi_indexer.add(parameters.umi())))
+		, _umi_quality_id(uint32_t(umi_quality_indexer.add(parameters.umi_quality())))
 		, _pass_quality_threshold(parameters.pass_quality_threshold())
+		, _is_empty(parameters.is_empty())
 	{}
 
 	Tools::ReadParameters ReadParametersEfficient::parameters(StringIndexer &barcode_indexer, StringIndexer &umi_indexer,
@@ -20,4 +28,20 @@ namespace Estimation
 		                             umi_quality_indexer.get_value(this->_umi_quality_id),
 		                             this->_pass_quality_threshold);
 	}
+
+	bool ReadParametersEfficient::is_empty() const
+	{
+		return this->_is_empty;
+	}
+
+	ReadParametersEfficient ReadParametersEfficient::remapped(const std::vector<uint32_t> &barcode_ids,
+	                                                          const std::vector<uint32_t> &umi_ids,
+	                                                          const std::vector<uint32_t> &umi_quality_ids) const
+	{
+		ReadParametersEfficient res(*this);
+		res._cell_barcode_id = barcode_ids.at(this->_cell_barcode_id);
+		res._umi_id = umi_ids.at(this->_umi_id);
+		res._umi_quality_id = umi_quality_ids.at(this->_umi_quality_id);
+		return res;
+	}
 }
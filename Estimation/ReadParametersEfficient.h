@@ -1,8 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <map>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <Tools/ReadParameters.h>
 #include "StringIndexer.h"
 
@@ -14,18 +16,24 @@ namespace Estimation
 		using reads_params_map_t = std::unordered_map<std::string, ReadParametersEfficient>;
 
 	private:
-		size_t _cell_barcode_id;
-		size_t _umi_id;
-		size_t _umi_quality_id;
+		uint32_t _cell_barcode_id;
+		uint32_t _umi_id;
+		uint32_t _umi_quality_id;
 		bool _pass_quality_threshold;
 
 		bool _is_empty;
 
 	public:
+		ReadParametersEfficient();
 		explicit ReadParametersEfficient(const Tools::ReadParameters &parameters, StringIndexer &barcode_indexer,
 		                                 StringIndexer &umi_indexer, StringIndexer &umi_quality_indexer);
 
 		Tools::ReadParameters parameters(StringIndexer &barcode_indexer, StringIndexer &umi_indexer,
 		                                 StringIndexer &umi_quality_indexer) const;
+		bool is_empty() const;
+
+		// Copy with ids of other indexers, where the ids vectors map the current ids to the new ones
+		ReadParametersEfficient remapped(const std::vector<uint32_t> &barcode_ids, const std::vector<uint32_t> &umi_ids,
+		                                 const std::vector<uint32_t> &umi_quality_ids) const;
 	};
 }
@@ -5,6 +5,7 @@ namespace Estimation
 	Stats::id_set_t Stats::_presented_chromosomes[Stats::CHROMOSOME_STAT_SIZE];
 	Stats::str_map_t Stats::_chromosome_inds;
 	Stats::names_t Stats::_chromosome_names;
+	std::mutex Stats::_chromosomes_mutex;
 
 	Stats::Stats()
 	{
@@ -21,8 +22,13 @@ namespace Estimation
 
 	void Stats::inc(CellChrStatType stat, const std::string &subtype)
 	{
-		size_t id = Stats::get_index(Stats::_chromosome_inds, Stats::_chromosome_names, subtype);
-		Stats::_presented_chromosomes[stat].insert(id);
+		size_t id;
+		{
+			std::lock_guard<std::mutex> lock(Stats::_chromosomes_mutex);
+			id = Stats::get_index(Stats::_chromosome_inds, Stats::_chromosome_names, subtype);
+			Stats::_presented_chromosomes[stat].insert(id);
+		}
+
 		this->_chromosome_stat_data[stat][id]++;
 	}
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -42,6 +43,7 @@ namespace Estimation
 		static id_set_t _presented_chromosomes[CHROMOSOME_STAT_SIZE];
 		static str_map_t _chromosome_inds;
 		static names_t _chromosome_names;
+		static std::mutex _chromosomes_mutex; // Cells of different containers can be filled concurrently
 
 	public:
 		Stats();
@@ -33,6 +33,21 @@ namespace Estimation
 		}
 	}
 
+	void UMI::add_reads(const UMI &source)
+	{
+		this->_read_count += source._read_count;
+		this->_mark.add(source._mark);
+
+		if (source._sum_quality.size() != this->_sum_quality.size())
+			throw std::runtime_error("Wrong quality length: " + std::to_string(source._sum_quality.size()) +
+			                         ", expected: " + std::to_string(this->_sum_quality.size()));
+
+		for (size_t i = 0; i < this->_sum_quality.size(); ++i)
+		{
+			this->_sum_quality[i] += source._sum_quality[i];
+		}
+	}
+
 	size_t UMI::read_count() const
 	{
 		return this->_read_count;
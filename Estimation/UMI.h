@@ -59,5 +59,6 @@ namespace Estimation
 
 		void merge(const UMI& umi);
 		void add_read(const ReadInfo &read_info);
+		void add_reads(const UMI &source);
 	};
 }
@@ -0,0 +1,227 @@
+#include "CellBarcodesCorrector.h"
+
+#include <Tools/Logs.h>
+#include <Tools/UtilFunctions.h>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace TagsSearch
+{
+	const size_t CellBarcodesCorrector::max_part_length;
+
+	CellBarcodesCorrector::CellBarcodesCorrector(const std::string &barcodes_filename, const std::string &barcodes_type,
+	                                             unsigned max_distance)
+		: _max_distance(max_distance)
+		, _variable_first_part(barcodes_type == "indrop")
+	{
+		if (barcodes_type != "indrop" && barcodes_type != "const")
+			throw std::runtime_error("Unexpected barcodes type: " + barcodes_type);
+
+		this->read_barcodes(barcodes_filename);
+
+		this->_neighbours.resize(this->_barcodes.size());
+		for (size_t part_ind = 0; part_ind < this->_barcodes.size(); ++part_ind)
+		{
+			auto const &part_barcodes = this->_barcodes[part_ind];
+			for (uint32_t barcode_ind = 0; barcode_ind < part_barcodes.size(); ++barcode_ind)
+			{
+				std::string barcode = part_barcodes[barcode_ind];
+				this->add_neighbours(this->_neighbours[part_ind], barcode_ind, barcode, 0, 0);
+			}
+		}
+
+		size_t neighbours_num = 0;
+		for (auto const &neighbours : this->_neighbours)
+		{
+			neighbours_num += neighbours.size();
+		}
+
+		L_TRACE << "Cell barcodes correction: " << this->_barcodes.size() << " barcode parts, " << neighbours_num
+		        << " neighbour barcodes";
+	}
+
+	void CellBarcodesCorrector::read_barcodes(const std::string &barcodes_filename)
+	{
+		std::ifstream barcodes_file(barcodes_filename);
+		if (barcodes_file.fail())
+			throw std::runtime_error("Can't open file with barcodes: '" + barcodes_filename + "'");
+
+		Tools::ReverseComplement rc;
+		std::string line;
+		while (std::getline(barcodes_file, line))
+		{
+			if (this->_variable_first_part && this->_barcodes.size() == 2)
+				break;
+
+			std::vector<std::string> part_barcodes;
+			std::istringstream line_in(line);
+			std::string barcode;
+			while (line_in >> barcode)
+			{
+				if (barcode.length() > CellBarcodesCorrector::max_part_length)
+					throw std::runtime_error("Barcode '" + barcode + "' is too long for correction (max length: " +
+					                         std::to_string(CellBarcodesCorrector::max_part_length) + ")");
+
+				if (!this->_variable_first_part && !part_barcodes.empty() && part_barcodes[0].length() != barcode.length())
+					throw std::runtime_error("All barcodes in one line must have the same length");
+
+				part_barcodes.push_back(rc.rc(barcode));
+			}
+
+			if (part_barcodes.empty())
+				throw std::runtime_error("File with barcodes (" + barcodes_filename + ") has wrong format");
+
+			this->_barcodes.push_back(part_barcodes);
+		}
+
+		if (this->_barcodes.empty() || (this->_variable_first_part && this->_barcodes.size() != 2))
+			throw std::runtime_error("File with barcodes (" + barcodes_filename + ") has wrong format");
+	}
+
+	int CellBarcodesCorrector::base_code(char base)
+	{
+		switch (base)
+		{
+			case 'A': return 0;
+			case 'C': return 1;
+			case 'G': return 2;
+			case 'T': return 3;
+			case 'N': return 4;
+			default: return -1;
+		}
+	}
+
+	bool CellBarcodesCorrector::get_key(const char *sequence, size_t length, uint64_t &key)
+	{
+		if (length > CellBarcodesCorrector::max_part_length)
+			return false;
+
+		key = length;
+		for (size_t i = 0; i < length; ++i)
+		{
+			int code = CellBarcodesCorrector::base_code(sequence[i]);
+			if (code < 0)
+				return false;
+
+			key = (key << 3) | uint64_t(code);
+		}
+
+		return true;
+	}
+
+	void CellBarcodesCorrector::add_neighbours(neighbours_map_t &neighbours, uint32_t barcode_ind, std::string &barcode,
+	                                           size_t start_pos, unsigned distance)
+	{
+		uint64_t key;
+		if (!CellBarcodesCorrector::get_key(barcode.data(), barcode.length(), key))
+			throw std::runtime_error("Barcode '" + barcode + "' contains unexpected symbols");
+
+		auto res = neighbours.emplace(key, Neighbour{barcode_ind, uint8_t(distance), false});
+		if (!res.second)
+		{
+			auto &neighbour = res.first->second;
+			if (neighbour.distance > distance)
+			{
+				neighbour = Neighbour{barcode_ind, uint8_t(distance), false};
+			}
+			else if (neighbour.distance == distance && neighbour.barcode_ind != barcode_ind)
+			{
+				neighbour.ambiguous = true;
+			}
+		}
+
+		if (distance == this->_max_distance)
+			return;
+
+		static const char bases[] = "ACGTN";
+		for (size_t pos = start_pos; pos < barcode.length(); ++pos)
+		{
+			char original = barcode[pos];
+			for (size_t base_ind = 0; base_ind < 5; ++base_ind)
+			{
+				if (bases[base_ind] == original)
+					continue;
+
+				barcode[pos] = bases[base_ind];
+				this->add_neighbours(neighbours, barcode_ind, barcode, pos + 1, distance + 1);
+			}
+			barcode[pos] = original;
+		}
+	}
+
+	const CellBarcodesCorrector::Neighbour* CellBarcodesCorrector::find_part(size_t part_ind, const char *sequence,
+	                                                                         size_t length) const
+	{
+		uint64_t key;
+		if (!CellBarcodesCorrector::get_key(sequence, length, key))
+			return nullptr;
+
+		auto const &neighbours = this->_neighbours[part_ind];
+		auto neighbour_it = neighbours.find(key);
+		if (neighbour_it == neighbours.end())
+			return nullptr;
+
+		return &neighbour_it->second;
+	}
+
+	CellBarcodesCorrector::Result CellBarcodesCorrector::correct(const Tools::PackedTag &cell_barcode,
+	                                                             std::string &corrected) const
+	{
+		char sequence[256];
+		const Neighbour* parts[16];
+		const size_t length = cell_barcode.length();
+		if (length > sizeof(sequence) || this->_barcodes.size() > sizeof(parts) / sizeof(parts[0]))
+			return NO_MATCH;
+
+		for (size_t i = 0; i < length; ++i)
+		{
+			sequence[i] = cell_barcode.base(i);
+		}
+
+		unsigned distance = 0;
+		bool ambiguous = false;
+		size_t start_pos = 0;
+		for (size_t part_ind = 0; part_ind < this->_barcodes.size(); ++part_ind)
+		{
+			size_t part_length = this->_barcodes[part_ind][0].length();
+			if (this->_variable_first_part && part_ind == 0)
+			{
+				size_t last_length = this->_barcodes.back()[0].length();
+				if (length <= last_length)
+					return NO_MATCH;
+
+				part_length = length - last_length;
+			}
+
+			if (start_pos + part_length > length)
+				return NO_MATCH;
+
+			parts[part_ind] = this->find_part(part_ind, sequence + start_pos, part_length);
+			if (parts[part_ind] == nullptr)
+				return NO_MATCH;
+
+			distance += parts[part_ind]->distance;
+			ambiguous = ambiguous || parts[part_ind]->ambiguous;
+			start_pos += part_length;
+		}
+
+		if (start_pos != length || distance > this->_max_distance)
+			return NO_MATCH;
+
+		if (ambiguous)
+			return AMBIGUOUS;
+
+		if (distance == 0)
+			return EXACT;
+
+		corrected.clear();
+		for (size_t part_ind = 0; part_ind < this->_barcodes.size(); ++part_ind)
+		{
+			corrected += this->_barcodes[part_ind][parts[part_ind]->barcode_ind];
+		}
+
+		return CORRECTED;
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Tools/PackedReadParameters.h>
+
+namespace TagsSearch
+{
+	// Corrects cell barcodes to the list of real barcodes. The file has the same format as for dropest merge
+	// (Estimation/Merge/barcodes_file): each line contains reverse complemented barcodes for one part of the cell barcode.
+	// For 'indrop' type the file has two lines and the first part has variable length. For 'const' type all parts
+	// have constant length. Each part is corrected by Hamming distance with precomputed neighbourhoods of the real
+	// barcodes, so memory grows as (number of barcodes) * (4 * part length) ^ max_distance.
+	class CellBarcodesCorrector
+	{
+	public:
+		enum Result
+		{
+			EXACT,
+			CORRECTED,
+			NO_MATCH,
+			AMBIGUOUS
+		};
+
+	private:
+		struct Neighbour
+		{
+			uint32_t barcode_ind;
+			uint8_t distance;
+			bool ambiguous;
+		};
+
+		using neighbours_map_t = std::unordered_map<uint64_t, Neighbour>;
+
+		static const size_t max_part_length = 19; // Key stores 3 bits per base and the length
+
+	private:
+		const unsigned _max_distance;
+		const bool _variable_first_part;
+		std::vector<std::vector<std::string>> _barcodes;
+		std::vector<neighbours_map_t> _neighbours;
+
+	private:
+		static int base_code(char base);
+		static bool get_key(const char *sequence, size_t length, uint64_t &key);
+
+		void read_barcodes(const std::string &barcodes_filename);
+		void add_neighbours(neighbours_map_t &neighbours, uint32_t barcode_ind, std::string &barcode, size_t start_pos,
+		                    unsigned distance);
+		const Neighbour* find_part(size_t part_ind, const char *sequence, size_t length) const;
+
+	public:
+		CellBarcodesCorrector(const std::string &barcodes_filename, const std::string &barcodes_type, unsigned max_distance);
+
+		Result correct(const Tools::PackedTag &cell_barcode, std::string &corrected) const;
+	};
+}
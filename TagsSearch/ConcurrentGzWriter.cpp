@@ -1,27 +1,74 @@
 #include "ConcurrentGzWriter.h"
 
-#include <boost/iostreams/filtering_stream.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
+#include <algorithm>
 
 namespace TagsSearch
 {
-	const size_t ConcurrentGzWriter::max_cache_size = 50000;
-
 	ConcurrentGzWriter::ConcurrentGzWriter(const std::string &out_file_name, const std::string &file_extension,
-	                                       size_t max_file_size)
+	                                       size_t max_file_size, int compression_level, bool bgzf,
+	                                       const std::string &header, const std::string &stream_path)
 		: _out_file_name(out_file_name)
 		, _out_file_extension(file_extension)
-		, _max_file_size(max_file_size)
+		, _max_file_size(stream_path.empty() ? max_file_size : 0)
 		, _limited_file_size(_max_file_size != 0)
-		, _write_in_progress(false)
-		, _lines(ConcurrentGzWriter::max_cache_size)
-		, _gzipped(ConcurrentGzWriter::max_cache_size)
+		, _compression_level(compression_level)
+		, _bgzf(bgzf)
+		, _stream_path(stream_path)
+		, _compress(stream_path.empty() || bgzf)
+		, _next_chunk_id(0)
+		, _compression_finished(false)
+		, _stopped(false)
 		, _current_file_reads_written(0)
 		, _out_file_index(0)
+		, _bytes_in(nullptr)
+		, _bytes_out(nullptr)
+		, _enqueue_wait_time(nullptr)
+		, _compression_time(nullptr)
+		, _compression_idle_time(nullptr)
+		, _writing_time(nullptr)
+		, _writing_idle_time(nullptr)
 	{
+		if (compression_level < Z_DEFAULT_COMPRESSION || compression_level > Z_BEST_COMPRESSION)
+			throw std::runtime_error("Compression level must be between 0 and 9: " + std::to_string(compression_level));
+
+		if (!header.empty())
+		{
+			if (this->_compress)
+			{
+				Tools::GzCompressor(compression_level, bgzf).compress(header, this->_file_header);
+			}
+			else
+			{
+				this->_file_header = header;
+			}
+		}
+
 		this->increase_out_file();
 	}
 
+	ConcurrentGzWriter::~ConcurrentGzWriter()
+	{
+		if (this->_lines)
+		{
+			this->stop();
+		}
+
+		for (auto &thread : this->_compression_threads)
+		{
+			if (thread.joinable())
+			{
+				thread.join();
+			}
+		}
+
+		if (this->_writing_thread.joinable())
+		{
+			this->_writing_thread.join();
+		}
+
+		this->close_out_file();
+	}
+
 	bool ConcurrentGzWriter::write(const LinesInfo &text)
 	{
 		bool result = false;
@@ -43,6 +90,9 @@ namespace TagsSearch
 
 	std::string ConcurrentGzWriter::get_out_filename() const
 	{
+		if (!this->_stream_path.empty())
+			return this->_stream_path;
+
 		std::string name = this->_out_file_name;
 
 		if (this->_limited_file_size)
@@ -52,75 +102,227 @@ namespace TagsSearch
 		return name + "." + this->_out_file_extension;
 	}
 
-	std::string ConcurrentGzWriter::gzip(const std::string &text)
+	void ConcurrentGzWriter::close_out_file()
 	{
-		std::string res;
-		boost::iostreams::filtering_ostream ofs;
-		ofs.push(boost::iostreams::gzip_compressor());
-		ofs.push(std::back_inserter(res));
+		if (!this->_out_file.is_open())
+			return;
+
+		if (this->_bgzf)
+		{
+			this->_out_file << Tools::GzCompressor::bgzf_eof;
+		}
 
-		ofs << text << std::flush;
-		return res;
+		this->_out_file.close();
 	}
 
 	void ConcurrentGzWriter::increase_out_file()
 	{
+		this->close_out_file();
+
 		this->_out_file_index++;
 		std::string out_file_name = this->get_out_filename();
 
-		this->_out_file.close();
 		this->_out_file.open(out_file_name.c_str(), std::ios_base::out | std::ios_base::binary);
 		if (!this->_out_file.is_open())
 			throw std::runtime_error("Can't open file: '" + out_file_name + "'");
+
+		if (!(this->_out_file << this->_file_header))
+			throw std::runtime_error("Can't write to file: " + out_file_name);
 	}
 
-	bool ConcurrentGzWriter::full() const
+	void ConcurrentGzWriter::add_metrics(PipelineMetrics &metrics, const std::string &stage)
 	{
-		return this->_lines.full();
+		this->_bytes_in = metrics.counter(stage, "bytes_in");
+		this->_bytes_out = metrics.counter(stage, "bytes_out");
+		this->_enqueue_wait_time = metrics.counter(stage, "enqueue_wait_ns"); // Producers are blocked by the full queue
+		this->_compression_time = metrics.counter(stage, "compression_ns");
+		this->_compression_idle_time = metrics.counter(stage, "compression_idle_ns");
+		this->_writing_time = metrics.counter(stage, "writing_ns");
+		this->_writing_idle_time = metrics.counter(stage, "writing_idle_ns");
+
+		metrics.add_gauge(stage, "queue_bytes", [this]{ return this->_lines ? this->_lines->size() : 0; });
+		metrics.add_gauge(stage, "reorder_chunks", [this]{
+			std::lock_guard<std::mutex> lock(this->_reorder_mutex);
+			return this->_compressed_chunks.size();
+		});
 	}
 
-	bool ConcurrentGzWriter::empty() const
+	void ConcurrentGzWriter::start(size_t compression_threads_num, size_t max_memory)
 	{
-		return this->_lines.empty() && this->_gzipped.empty();
+		this->_lines = std::unique_ptr<Tools::BlockingConcurrentQueue<LinesInfo>>(
+				new Tools::BlockingConcurrentQueue<LinesInfo>(max_memory));
+
+		for (size_t thread_ind = 0; thread_ind < std::max(compression_threads_num, size_t(1)); ++thread_ind)
+		{
+			this->_compression_threads.emplace_back([this]{ this->run_compression(); });
+		}
+
+		this->_writing_thread = std::thread([this]{ this->run_writing(); });
 	}
 
-	void ConcurrentGzWriter::flush_gzip(bool unlimited_size)
+	void ConcurrentGzWriter::finish()
 	{
-		while (unlimited_size || !this->_gzipped.full())
+		this->_lines->close();
+		for (auto &thread : this->_compression_threads)
 		{
-			LinesInfo info;
-			if (!this->_lines.pop(info))
-				break;
+			thread.join();
+		}
 
-			this->_gzipped.push(LinesInfo(ConcurrentGzWriter::gzip(info.text), info.lines_num));
+		{
+			std::lock_guard<std::mutex> lock(this->_reorder_mutex);
+			this->_compression_finished = true;
 		}
+		this->_chunk_compressed.notify_all();
+		this->_writing_thread.join();
+
+		this->rethrow_error();
 	}
 
-	void ConcurrentGzWriter::flush_write()
+	void ConcurrentGzWriter::stop()
 	{
-		if (this->_write_in_progress.exchange(true))
-			return;
+		{
+			std::lock_guard<std::mutex> lock(this->_reorder_mutex);
+			this->_stopped = true;
+		}
+
+		this->_lines->close();
+		this->_chunk_compressed.notify_all();
+		this->_chunk_written.notify_all();
+	}
 
-		while (true)
+	void ConcurrentGzWriter::set_error(const std::exception_ptr &error)
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->_reorder_mutex);
+			if (!this->_error)
+			{
+				this->_error = error;
+			}
+		}
+
+		this->stop();
+	}
+
+	void ConcurrentGzWriter::rethrow_error()
+	{
+		std::lock_guard<std::mutex> lock(this->_reorder_mutex);
+		if (this->_error)
+			std::rethrow_exception(this->_error);
+	}
+
+	void ConcurrentGzWriter::run_compression()
+	{
+		try
+		{
+			Tools::GzCompressor compressor(this->_compression_level, this->_bgzf);
+			LinesInfo info;
+			while (true)
+			{
+				{
+					PipelineMetrics::ScopedTimer idle_timer(this->_compression_idle_time);
+					if (!this->_lines->pop_wait(info))
+						break;
+				}
+
+				size_t text_size = info.text.size();
+				LinesInfo gzipped("", info.lines_num, info.chunk_id);
+				if (!this->_compress)
+				{
+					gzipped.text = std::move(info.text);
+				}
+				else if (!info.text.empty())
+				{
+					PipelineMetrics::ScopedTimer timer(this->_compression_time);
+					compressor.compress(info.text, gzipped.text);
+				}
+
+				if (this->_bytes_in != nullptr)
+				{
+					*this->_bytes_in += text_size;
+					*this->_bytes_out += gzipped.text.size();
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(this->_reorder_mutex);
+					this->_compressed_chunks.emplace(info.chunk_id, std::move(gzipped));
+				}
+				this->_chunk_compressed.notify_all();
+			}
+		}
+		catch (...)
+		{
+			this->set_error(std::current_exception());
+		}
+	}
+
+	void ConcurrentGzWriter::run_writing()
+	{
+		try
 		{
-			LinesInfo to_write, cur_text;
-			while (to_write.text.length() < ConcurrentGzWriter::max_cache_size && this->_gzipped.pop(cur_text))
+			while (true)
 			{
-				to_write.text += cur_text.text;
-				to_write.lines_num += cur_text.lines_num;
+				LinesInfo info;
+				{
+					PipelineMetrics::ScopedTimer idle_timer(this->_writing_idle_time);
+					std::unique_lock<std::mutex> lock(this->_reorder_mutex);
+					this->_chunk_compressed.wait(lock, [this]{
+						return this->_stopped || this->_compression_finished ||
+								this->_compressed_chunks.count(this->_next_chunk_id) != 0;
+					});
+
+					auto chunk_it = this->_compressed_chunks.find(this->_next_chunk_id);
+					if (this->_stopped || chunk_it == this->_compressed_chunks.end())
+						break;
+
+					info = std::move(chunk_it->second);
+					this->_compressed_chunks.erase(chunk_it);
+				}
+
+				if (!info.text.empty())
+				{
+					PipelineMetrics::ScopedTimer timer(this->_writing_time);
+					this->write(info);
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(this->_reorder_mutex);
+					this->_next_chunk_id++;
+				}
+				this->_chunk_written.notify_all();
 			}
-			if (to_write.text.empty())
-				break;
+		}
+		catch (...)
+		{
+			this->set_error(std::current_exception());
+		}
+	}
 
-			this->write(to_write);
+	void ConcurrentGzWriter::enqueue_lines(std::string &&lines, unsigned lines_num, size_t chunk_id)
+	{
+		size_t size = lines.size();
+		bool pushed;
+		{
+			PipelineMetrics::ScopedTimer timer(this->_enqueue_wait_time);
+			pushed = this->_lines->push_wait(LinesInfo(std::move(lines), lines_num, chunk_id), size);
 		}
 
-		this->_write_in_progress = false;
+		if (pushed)
+			return;
+
+		this->rethrow_error();
+		throw std::runtime_error("Can't write to the closed file: " + this->get_out_filename());
 	}
 
-	void ConcurrentGzWriter::enqueue_lines(const std::string &line, unsigned lines_num)
+	void ConcurrentGzWriter::wait_written(size_t chunks_num)
 	{
-		this->_lines.push(LinesInfo(line, lines_num));
+		{
+			std::unique_lock<std::mutex> lock(this->_reorder_mutex);
+			this->_chunk_written.wait(lock, [this, chunks_num]{
+				return this->_stopped || this->_next_chunk_id >= chunks_num;
+			});
+		}
+
+		this->rethrow_error();
 	}
 
 	const std::string &ConcurrentGzWriter::base_filename() const
@@ -128,8 +330,19 @@ namespace TagsSearch
 		return this->_out_file_name;
 	}
 
-	ConcurrentGzWriter::LinesInfo::LinesInfo(const std::string &text, unsigned int lines_num)
-		: text(text)
+	int ConcurrentGzWriter::compression_level() const
+	{
+		return this->_compression_level;
+	}
+
+	bool ConcurrentGzWriter::bgzf() const
+	{
+		return this->_bgzf;
+	}
+
+	ConcurrentGzWriter::LinesInfo::LinesInfo(std::string text, unsigned int lines_num, size_t chunk_id)
+		: text(std::move(text))
 		, lines_num(lines_num)
+		, chunk_id(chunk_id)
 	{}
 }
\ No newline at end of file
@@ -1,13 +1,30 @@
 #pragma once
 
-#include <atomic>
+#include <condition_variable>
+#include <exception>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <Tools/BlockingConcurrentQueue.h>
+#include <Tools/GzCompressor.h>
+
+#include "PipelineMetrics.h"
 
 namespace TagsSearch
 {
+	// Lines are compressed by a pool of threads and written to disk by a separate thread.
+	// Chunks are written in the order of their ids, so the output doesn't depend on the number of threads. Each id
+	// from 0 must be enqueued exactly once (possibly, with empty text). The queue of lines is bounded by the
+	// total size of the text, so enqueue_lines() blocks while compression is behind. Size of the reorder buffer
+	// is bounded by the producer, which must call wait_written() before enqueueing chunks far ahead.
+	// Header (e.g. for BAM) is written at the beginning of each output file.
+	// If stream_path is set, all output goes there (e.g. /dev/stdout or a named pipe) without splitting into files.
+	// Such output isn't compressed, unless it's BGZF.
 	class ConcurrentGzWriter
 	{
 	private:
@@ -15,44 +32,77 @@ namespace TagsSearch
 		{
 			std::string text;
 			unsigned lines_num;
+			size_t chunk_id;
 
-			explicit LinesInfo(const std::string &text = "", unsigned int lines_num = 0);
+			explicit LinesInfo(std::string text = "", unsigned int lines_num = 0, size_t chunk_id = 0);
 		};
 
 	private:
-		static const size_t max_cache_size;
-
 		const std::string _out_file_name;
 		const std::string _out_file_extension;
 		const size_t _max_file_size;
 		const bool _limited_file_size;
+		const int _compression_level;
+		const bool _bgzf;
+		const std::string _stream_path;
+		const bool _compress;
+		std::string _file_header;
 
-		std::atomic<bool> _write_in_progress;
+		std::unique_ptr<Tools::BlockingConcurrentQueue<LinesInfo>> _lines;
 
-		Tools::BlockingConcurrentQueue<LinesInfo> _lines;
-		Tools::BlockingConcurrentQueue<LinesInfo> _gzipped;
+		std::mutex _reorder_mutex;
+		std::condition_variable _chunk_compressed;
+		std::condition_variable _chunk_written;
+		std::map<size_t, LinesInfo> _compressed_chunks;
+		size_t _next_chunk_id;
+		bool _compression_finished;
+		bool _stopped;
+		std::exception_ptr _error;
+
+		std::vector<std::thread> _compression_threads;
+		std::thread _writing_thread;
 
 		std::ofstream _out_file;
 
 		size_t _current_file_reads_written;
 		size_t _out_file_index;
 
+		PipelineMetrics::counter_t *_bytes_in;
+		PipelineMetrics::counter_t *_bytes_out;
+		PipelineMetrics::counter_t *_enqueue_wait_time;
+		PipelineMetrics::counter_t *_compression_time;
+		PipelineMetrics::counter_t *_compression_idle_time;
+		PipelineMetrics::counter_t *_writing_time;
+		PipelineMetrics::counter_t *_writing_idle_time;
+
 	private:
 		std::string get_out_filename() const;
+		void close_out_file();
 		void increase_out_file();
 		bool write(const LinesInfo &text);
 
-		static std::string gzip(const std::string &text);
+		void run_compression();
+		void run_writing();
+		void set_error(const std::exception_ptr &error);
+		void rethrow_error();
 
 	public:
-		ConcurrentGzWriter(const std::string &out_file_name, const std::string &file_extension, size_t max_file_size);
-		bool full() const;
-		bool empty() const;
+		ConcurrentGzWriter(const std::string &out_file_name, const std::string &file_extension, size_t max_file_size,
+		                   int compression_level = Z_DEFAULT_COMPRESSION, bool bgzf = false, const std::string &header = "",
+		                   const std::string &stream_path = "");
+		~ConcurrentGzWriter();
+
 		const std::string &base_filename() const;
+		int compression_level() const;
+		bool bgzf() const;
+
+		// Must be called before start()
+		void add_metrics(PipelineMetrics &metrics, const std::string &stage);
 
-		void enqueue_lines(const std::string &line, unsigned lines_num);
-		void flush_gzip(bool unlimited_size);
-		void flush_write();
+		void start(size_t compression_threads_num, size_t max_memory);
+		void enqueue_lines(std::string &&lines, unsigned lines_num, size_t chunk_id);
+		void wait_written(size_t chunks_num);
+		void finish();
+		void stop(); // Aborts writing. Chunks, which aren't written yet, are dropped
 	};
 }
-
@@ -0,0 +1,65 @@
+#include "CorrectionsCounter.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace TagsSearch
+{
+	void CorrectionsCounter::inc(StatType type)
+	{
+		++this->stats[type];
+	}
+
+	void CorrectionsCounter::merge(const CorrectionsCounter &other)
+	{
+		for (int i = 0; i < STAT_SIZE; ++i)
+		{
+			this->stats[i] += other.stats[i];
+		}
+	}
+
+	int CorrectionsCounter::get(StatType type) const
+	{
+		return this->stats[type];
+	}
+
+	CorrectionsCounter::CorrectionsCounter()
+	{
+		for (int i = 0; i < STAT_SIZE; ++i)
+		{
+			this->stats[i] = 0;
+		}
+
+		this->names[EXACT] = "Exact";
+		this->names[CORRECTED] = "Corrected";
+		this->names[NO_MATCH] = "No match";
+		this->names[AMBIGUOUS] = "Ambiguous";
+	}
+
+	std::string CorrectionsCounter::print(double normalizer) const
+	{
+		std::ostringstream out_stream;
+		out_stream << "Cell barcodes correction:\n[";
+		for (int i = 0; i < STAT_SIZE; i++)
+		{
+			out_stream << " (" << this->names[i] << ") ";
+		}
+		out_stream << "]" << std::endl;
+
+		out_stream << "[";
+		for (int i = 0; i < STAT_SIZE; i++)
+		{
+			out_stream << this->stats[i] << " ";
+		}
+		out_stream << "]" << std::endl;
+
+		out_stream << "[" << std::setprecision(3);
+		for (int i = 0; i < STAT_SIZE; i++)
+		{
+			out_stream << 100.0 * this->stats[i] / normalizer << " ";
+		}
+		out_stream << "] %" << std::endl;
+
+		return out_stream.str();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+namespace TagsSearch
+{
+	class CorrectionsCounter
+	{
+	public:
+		enum StatType
+		{
+			EXACT = 0,
+			CORRECTED,
+			NO_MATCH,
+			AMBIGUOUS,
+			STAT_SIZE
+		};
+
+	private:
+		int stats[STAT_SIZE];
+		std::string names[STAT_SIZE];
+
+	public:
+		CorrectionsCounter();
+
+		void inc(StatType type);
+		void merge(const CorrectionsCounter &other);
+		int get(StatType type) const;
+
+		std::string print(double normalizer) const;
+	};
+}
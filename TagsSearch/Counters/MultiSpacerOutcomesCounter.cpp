@@ -2,6 +2,7 @@
 
 #include <iomanip>
 #include <sstream>
+#include <stdexcept>
 
 namespace TagsSearch
 {
@@ -73,4 +74,20 @@ namespace TagsSearch
 	{
 		this->no_spacer.at(spacer_ind)++;
 	}
+
+	void MultiSpacerOutcomesCounter::merge(const MultiSpacerOutcomesCounter &other)
+	{
+		if (other.no_spacer.size() != this->no_spacer.size())
+			throw std::runtime_error("Can't merge outcome counters with different number of spacers");
+
+		for (int i = 0; i < STAT_SIZE; ++i)
+		{
+			this->stats[i] += other.stats[i];
+		}
+
+		for (size_t i = 0; i < this->no_spacer.size(); ++i)
+		{
+			this->no_spacer[i] += other.no_spacer[i];
+		}
+	}
 }
\ No newline at end of file
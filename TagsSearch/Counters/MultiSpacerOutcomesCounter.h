@@ -25,6 +25,7 @@ namespace TagsSearch
 
 		void inc(StatType type);
 		void inc_no_spacer(size_t spacer_ind);
+		void merge(const MultiSpacerOutcomesCounter &other);
 
 		std::string print(double normalizer)  const;
 	};
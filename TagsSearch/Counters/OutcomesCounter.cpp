@@ -10,6 +10,14 @@ namespace TagsSearch
 		++this->stats[type];
 	}
 
+	void OutcomesCounter::merge(const OutcomesCounter &other)
+	{
+		for (int i = 0; i < STAT_SIZE; ++i)
+		{
+			this->stats[i] += other.stats[i];
+		}
+	}
+
 	int OutcomesCounter::get(StatType type) const
 	{
 		return this->stats[type];
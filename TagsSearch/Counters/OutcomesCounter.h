@@ -24,6 +24,7 @@ namespace TagsSearch
 		OutcomesCounter();
 
 		void inc(StatType type);
+		void merge(const OutcomesCounter &other);
 		int get(StatType type) const;
 
 		std::string print(double normalizer)  const;
@@ -0,0 +1,110 @@
+#include "ReadsPerCbCounter.h"
+
+namespace TagsSearch
+{
+	const size_t ReadsPerCbCounter::initial_size;
+
+	ReadsPerCbCounter::ReadsPerCbCounter()
+		: _entries(ReadsPerCbCounter::initial_size)
+		, _filled_entries(0)
+	{}
+
+	size_t ReadsPerCbCounter::hash(const Tools::PackedTag::Key &key)
+	{
+		uint64_t res = key.length;
+		for (uint64_t value : key.bases)
+		{
+			res = (res ^ value) * 0x9E3779B97F4A7C15ULL;
+		}
+		res = (res ^ key.n_mask) * 0x9E3779B97F4A7C15ULL;
+
+		return size_t(res ^ (res >> 32));
+	}
+
+	ReadsPerCbCounter::Entry& ReadsPerCbCounter::find_entry(const Tools::PackedTag::Key &key)
+	{
+		const size_t mask = this->_entries.size() - 1;
+		for (size_t ind = ReadsPerCbCounter::hash(key) & mask; ; ind = (ind + 1) & mask)
+		{
+			auto &entry = this->_entries[ind];
+			if (entry.count == 0 || entry.key == key)
+				return entry;
+		}
+	}
+
+	void ReadsPerCbCounter::add(const Tools::PackedTag::Key &key, int count)
+	{
+		auto &entry = this->find_entry(key);
+		if (entry.count != 0)
+		{
+			entry.count += count;
+			return;
+		}
+
+		entry.key = key;
+		entry.count = count;
+		this->_filled_entries++;
+
+		if (2 * this->_filled_entries > this->_entries.size())
+		{
+			this->grow();
+		}
+	}
+
+	void ReadsPerCbCounter::grow()
+	{
+		std::vector<Entry> old_entries;
+		old_entries.swap(this->_entries);
+		this->_entries.resize(2 * old_entries.size());
+		for (auto const &entry : old_entries)
+		{
+			if (entry.count != 0)
+			{
+				this->find_entry(entry.key) = entry;
+			}
+		}
+	}
+
+	void ReadsPerCbCounter::inc(const Tools::PackedTag &cell_barcode)
+	{
+		if (!cell_barcode.packed())
+		{
+			this->_text_counts[cell_barcode.sequence()]++;
+			return;
+		}
+
+		this->add(cell_barcode.key(), 1);
+	}
+
+	void ReadsPerCbCounter::merge(const ReadsPerCbCounter &other)
+	{
+		for (auto const &entry : other._entries)
+		{
+			if (entry.count != 0)
+			{
+				this->add(entry.key, entry.count);
+			}
+		}
+
+		for (auto const &cb_count : other._text_counts)
+		{
+			this->_text_counts[cb_count.first] += cb_count.second;
+		}
+	}
+
+	void ReadsPerCbCounter::add_to(s_counter_t &counts) const
+	{
+		for (auto const &entry : this->_entries)
+		{
+			if (entry.count != 0)
+			{
+				counts[entry.key.sequence()] += entry.count;
+			}
+		}
+
+		for (auto const &cb_count : this->_text_counts)
+		{
+			counts[cb_count.first] += cb_count.second;
+		}
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Tools/PackedReadParameters.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace TagsSearch
+{
+	// Number of reads per cell barcode. Packed barcodes are counted in an open-addressing table without allocations
+	// per read. Other barcodes go to a usual hash map.
+	class ReadsPerCbCounter
+	{
+	public:
+		using s_counter_t = std::unordered_map<std::string, int>;
+
+	private:
+		struct Entry
+		{
+			Tools::PackedTag::Key key;
+			int count; // 0 marks an empty entry
+		};
+
+		static const size_t initial_size = 1024;
+
+	private:
+		std::vector<Entry> _entries; // Size is a power of 2
+		size_t _filled_entries;
+		s_counter_t _text_counts;
+
+	private:
+		static size_t hash(const Tools::PackedTag::Key &key);
+
+		Entry& find_entry(const Tools::PackedTag::Key &key);
+		void add(const Tools::PackedTag::Key &key, int count);
+		void grow();
+
+	public:
+		ReadsPerCbCounter();
+
+		void inc(const Tools::PackedTag &cell_barcode);
+		void merge(const ReadsPerCbCounter &other);
+		void add_to(s_counter_t &counts) const;
+	};
+}
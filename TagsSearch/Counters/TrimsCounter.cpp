@@ -10,6 +10,14 @@ namespace TagsSearch
 		++this->stats[type];
 	}
 
+	void TrimsCounter::merge(const TrimsCounter &other)
+	{
+		for (int i = 0; i < STAT_SIZE; ++i)
+		{
+			this->stats[i] += other.stats[i];
+		}
+	}
+
 	int TrimsCounter::get(StatType type) const
 	{
 		return this->stats[type];
@@ -24,6 +24,7 @@ namespace TagsSearch
 		TrimsCounter();
 
 		void inc(StatType type);
+		void merge(const TrimsCounter &other);
 		int get(StatType type) const;
 
 		std::string print()  const;
@@ -10,6 +10,14 @@ namespace TagsSearch
 		++this->stats[type];
 	}
 
+	void TwoBarcodesCounter::merge(const TwoBarcodesCounter &other)
+	{
+		for (int i = 0; i < STAT_SIZE; ++i)
+		{
+			this->stats[i] += other.stats[i];
+		}
+	}
+
 	int TwoBarcodesCounter::get(StatType type) const
 	{
 		return this->stats[type];
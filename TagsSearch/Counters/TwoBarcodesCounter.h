@@ -23,6 +23,7 @@ namespace TagsSearch
 		TwoBarcodesCounter();
 
 		void inc(StatType type);
+		void merge(const TwoBarcodesCounter &other);
 		int get(StatType type) const;
 
 		std::string print(double normalizer) const;
@@ -1,108 +1,173 @@
 #include "FastQReader.h"
 
-#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <stdexcept>
 
 #include <Tools/Logs.h>
 
 namespace TagsSearch
 {
-	FastQReader::FastQReader(const std::string &filename)
+	const size_t FastQReader::read_block_size = 1 << 20;
+	const size_t FastQReader::max_free_batches = 16;
+
+	FastQReader::FastQReader(const std::string &filename, size_t decompression_threads, size_t batch_size)
 		: _filename(filename)
+		, _batch_size(batch_size)
 		, _file_ended(false)
-		, _records(10000)
+		, _stream_ended(false)
+		, _free_batches(FastQReader::max_free_batches)
+		, _records_read(nullptr)
+		, _bytes_read(nullptr)
+		, _read_time(nullptr)
 	{
 		if (filename.empty())
 			return;
 
-		this->_in_file.open(filename, std::ios_base::in | std::ios_base::binary);
-		if (!this->_in_file)
-			throw std::runtime_error("Can't open fastq file '" + filename + "'");
+		this->_in_reader = std::unique_ptr<Tools::ParallelGzReader>(
+				new Tools::ParallelGzReader(filename, decompression_threads));
+	}
 
-		if (boost::ends_with(filename, ".gz") || boost::ends_with(filename, ".gzip"))
-		{
-			this->_in_fstream.push(boost::iostreams::gzip_decompressor());
-		}
-		this->_in_fstream.push(this->_in_file);
+	const std::string &FastQReader::filename() const
+	{
+		return this->_filename;
 	}
 
-//	void FastQReader::write_read_params(const std::string &id_prefix, const Tools::ReadParameters &read_params)
-//	{
-//		this->out_reads_zip << read_params.encoded_params(id_prefix) << "\n";
-//	}
+	void FastQReader::add_metrics(PipelineMetrics &metrics, const std::string &stage)
+	{
+		this->_records_read = metrics.counter(stage, "records");
+		this->_bytes_read = metrics.counter(stage, "bytes_out"); // Decompressed
+		this->_read_time = metrics.counter(stage, "read_ns"); // Includes waiting for decompression
 
-	bool FastQReader::get_next_record_unsafe(FastQRecord &record)
+		auto in_reader = this->_in_reader.get();
+		metrics.add_gauge(stage, "bytes_in", [in_reader]{ return (in_reader != nullptr) ? in_reader->input_bytes() : 0; });
+	}
+
+	bool FastQReader::read_block(std::vector<char> &data)
 	{
-		if (!this->get_next_line_unsafe(record.id))
+		if (!this->_in_reader)
 			return false;
 
-		if (record.id.at(0) != '@')
-			throw std::runtime_error("File '" + this->_filename + "', read '" + record.id + "': fastq malformed!");
+		size_t old_size = data.size();
+		data.resize(old_size + FastQReader::read_block_size);
+		data.resize(old_size + this->_in_reader->read(data.data() + old_size, FastQReader::read_block_size));
 
-		if (!this->get_next_line_unsafe(record.sequence))
-			throw std::runtime_error("File '" + this->_filename + "', read '" + record.id + "': fastq ended prematurely!");
+		return data.size() != old_size;
+	}
 
-		if (!this->get_next_line_unsafe(record.description))
-			throw std::runtime_error("File '" + this->_filename + "', read '" + record.id + "': fastq ended prematurely!");
+	bool FastQReader::read_batch(RecordsBatch &batch)
+	{
+		batch.records.clear();
+		batch.data.assign(this->_tail.begin(), this->_tail.end());
+		this->_line_ends.clear();
 
-		if (!this->get_next_line_unsafe(record.quality))
-			throw std::runtime_error("File '" + this->_filename + "', read '" + record.id + "': fastq ended prematurely!");
+		size_t records_num = 0, scan_pos = 0;
+		while (records_num < this->_batch_size)
+		{
+			const void *line_end = std::memchr(batch.data.data() + scan_pos, '\n', batch.data.size() - scan_pos);
+			if (line_end == nullptr)
+			{
+				if (!this->_stream_ended && this->read_block(batch.data))
+					continue;
+
+				this->_stream_ended = true;
+				if (scan_pos == batch.data.size())
+					break;
+
+				batch.data.push_back('\n'); // The last line isn't terminated
+				continue;
+			}
+
+			this->_line_ends.push_back(static_cast<const char*>(line_end) - batch.data.data());
+			scan_pos = this->_line_ends.back() + 1;
+			if (this->_line_ends.size() % 4 == 0)
+			{
+				records_num++;
+			}
+		}
 
-		if (record.sequence.length() != record.quality.length())
-			throw std::runtime_error("File '" + this->_filename + "', read '" + record.id + "': different lengths of the sequence and the quality string!");
+		size_t records_end = (records_num == 0) ? 0 : this->_line_ends[4 * records_num - 1] + 1;
+		this->_tail.assign(batch.data.begin() + records_end, batch.data.end());
+		batch.data.resize(records_end);
 
-		return true;
-	}
+		if (records_num < this->_batch_size) // The stream is over
+		{
+			if (!std::all_of(this->_tail.begin(), this->_tail.end(), [](char c){ return std::isspace(static_cast<unsigned char>(c)); }))
+				throw std::runtime_error("File '" + this->_filename + "': fastq ended prematurely!");
 
-	const std::string &FastQReader::filename() const
-	{
-		return this->_filename;
-	}
+			this->_tail.clear();
+		}
 
-	bool FastQReader::get_next_line_unsafe(std::string &line)
-	{
-		bool success = std::getline(this->_in_fstream, line).good();
-		this->_file_ended = !success;
-		return success;
+		this->fill_records(batch, records_num);
+		return records_num != 0;
 	}
 
-	void FastQReader::try_read_records_to_cash()
+	void FastQReader::fill_records(RecordsBatch &batch, size_t records_num) const
 	{
-		if (this->_file_ended)
-			return;
+		const char *data = batch.data.data();
+		size_t line_start = 0;
+		boost::string_ref lines[4];
 
-		std::unique_lock<mutex_t> lock(this->_read_mutex, std::try_to_lock);
-		if (!lock)
-			return;
-
-		while (!this->_records.full())
+		batch.records.reserve(records_num);
+		for (size_t record_ind = 0; record_ind < records_num; ++record_ind)
 		{
-			FastQRecord record;
-			if (!this->get_next_record_unsafe(record))
-				break;
+			for (size_t line_ind = 0; line_ind < 4; ++line_ind)
+			{
+				size_t line_end = this->_line_ends[4 * record_ind + line_ind];
+				lines[line_ind] = boost::string_ref(data + line_start, line_end - line_start);
+				line_start = line_end + 1;
+			}
+
+			if (lines[0].empty() || lines[0][0] != '@')
+				throw std::runtime_error("File '" + this->_filename + "', read '" + lines[0].to_string() + "': fastq malformed!");
 
-			this->_records.push(record);
+			if (lines[1].length() != lines[3].length())
+				throw std::runtime_error("File '" + this->_filename + "', read '" + lines[0].to_string() + "': different lengths of the sequence and the quality string!");
+
+			batch.records.emplace_back(lines[0], lines[1], lines[2], lines[3]);
 		}
 	}
 
-	bool FastQReader::get_next_record(FastQReader::FastQRecord &record)
+	bool FastQReader::get_next_batch(RecordsBatch &batch)
 	{
-		while (true)
+		if (this->_file_ended)
+			return false;
+
+		this->_free_batches.pop(batch);
+
+		bool batch_read;
 		{
-			if (this->_records.pop(record))
-				break;
+			PipelineMetrics::ScopedTimer timer(this->_read_time);
+			batch_read = this->read_batch(batch);
+		}
 
-			if (this->_file_ended && this->_records.empty())
-				return false;
+		if (batch_read)
+		{
+			if (this->_records_read != nullptr)
+			{
+				*this->_records_read += batch.records.size();
+				*this->_bytes_read += batch.data.size();
+			}
 
-			this->try_read_records_to_cash();
+			return true;
 		}
 
-		return true;
+		this->_file_ended = true;
+		return false;
+	}
+
+	void FastQReader::release_batch(RecordsBatch &&batch)
+	{
+		if (this->_free_batches.full())
+			return;
+
+		batch.records.clear();
+		this->_free_batches.push(std::move(batch));
 	}
 
-	FastQReader::FastQRecord::FastQRecord(const std::string &id, const std::string &sequence,
-	                                      const std::string &description, const std::string &quality)
+	FastQReader::FastQRecord::FastQRecord(const boost::string_ref &id, const boost::string_ref &sequence,
+	                                      const boost::string_ref &description, const boost::string_ref &quality)
 		: id(id)
 		, sequence(sequence)
 		, description(description)
@@ -111,6 +176,17 @@ namespace TagsSearch
 
 	std::string FastQReader::FastQRecord::to_string() const
 	{
-		return this->id + "\n" + this->sequence + "\n" + this->description + "\n" + this->quality + "\n";
+		std::string res;
+		this->append_to(res);
+		return res;
+	}
+
+	void FastQReader::FastQRecord::append_to(std::string &out) const
+	{
+		out.reserve(out.size() + this->id.size() + this->sequence.size() + this->description.size() + this->quality.size() + 4);
+		out.append(this->id.data(), this->id.size()).push_back('\n');
+		out.append(this->sequence.data(), this->sequence.size()).push_back('\n');
+		out.append(this->description.data(), this->description.size()).push_back('\n');
+		out.append(this->quality.data(), this->quality.size()).push_back('\n');
 	}
 }
@@ -1,57 +1,73 @@
 #pragma once
 
-#include <atomic>
-#include <fstream>
-#include <mutex>
+#include <memory>
 #include <vector>
 
-#include <boost/algorithm/string/predicate.hpp>
-#include <boost/iostreams/filtering_stream.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
-#include <Tools/ScSpConcurrentQueue.h>
+#include <boost/utility/string_ref.hpp>
+#include <Tools/BlockingConcurrentQueue.h>
+#include <Tools/ParallelGzReader.h>
 
+#include "PipelineMetrics.h"
 #include "Tools/ReadParameters.h"
 
 namespace TagsSearch
 {
+	// Batches must be read by a single thread, but can be released from any thread
 	class FastQReader
 	{
-	private:
-		using mutex_t = std::mutex;
-
 	public:
+		// All fields are views into the buffer of the RecordsBatch, which holds the record
 		struct FastQRecord
 		{
-			explicit FastQRecord(const std::string &id="", const std::string &sequence="",
-			                     const std::string &description="", const std::string &quality="");
+			explicit FastQRecord(const boost::string_ref &id="", const boost::string_ref &sequence="",
+			                     const boost::string_ref &description="", const boost::string_ref &quality="");
 
-			std::string id;
-			std::string sequence;
-			std::string description;
-			std::string quality;
+			boost::string_ref id;
+			boost::string_ref sequence;
+			boost::string_ref description;
+			boost::string_ref quality;
 
 			std::string to_string() const;
+			void append_to(std::string &out) const;
+		};
+
+		struct RecordsBatch
+		{
+			std::vector<char> data;
+			std::vector<FastQRecord> records;
 		};
 
 	private:
+		static const size_t read_block_size;
+		static const size_t max_free_batches;
+
 		const std::string _filename;
-		std::atomic<bool> _file_ended;
-		Tools::ScSpConcurrentQueue<FastQRecord> _records;
-		mutex_t _read_mutex;
+		const size_t _batch_size;
+		bool _file_ended;
+		bool _stream_ended;
+		Tools::BlockingConcurrentQueue<RecordsBatch> _free_batches;
+
+		std::vector<char> _tail; // Beginning of the next record, which was read together with the previous batch
+		std::vector<size_t> _line_ends;
+
+		std::unique_ptr<Tools::ParallelGzReader> _in_reader;
 
-		std::ifstream _in_file;
-		boost::iostreams::filtering_istream _in_fstream;
+		PipelineMetrics::counter_t *_records_read;
+		PipelineMetrics::counter_t *_bytes_read;
+		PipelineMetrics::counter_t *_read_time;
 
 	private:
-		bool get_next_line_unsafe(std::string &line);
-		bool get_next_record_unsafe(FastQRecord &record);
+		bool read_block(std::vector<char> &data);
+		bool read_batch(RecordsBatch &batch);
+		void fill_records(RecordsBatch &batch, size_t records_num) const;
 
 	public:
-		explicit FastQReader(const std::string &filename);
+		explicit FastQReader(const std::string &filename, size_t decompression_threads = 1, size_t batch_size = 5000);
 
 		const std::string& filename() const;
-		void try_read_records_to_cash();
+		void add_metrics(PipelineMetrics &metrics, const std::string &stage);
 
-		bool get_next_record(FastQRecord &record);
+		bool get_next_batch(RecordsBatch &batch);
+		void release_batch(RecordsBatch &&batch);
 	};
 }
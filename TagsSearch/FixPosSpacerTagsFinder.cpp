@@ -3,6 +3,7 @@
 #include <Tools/UtilFunctions.h>
 
 #include <boost/algorithm/string.hpp>
+#include <cstring>
 #include <numeric>
 
 namespace TagsSearch
@@ -15,10 +16,11 @@ namespace TagsSearch
 		: TagsFinderBase(fastq_filenames, trimming_config, writer, save_stats, save_read_params)
 		, _mask_parts(FixPosSpacerTagsFinder::parse_mask(barcodes_config.get<std::string>("barcode_mask", ""),
 														 barcodes_config.get<std::string>("spacer_edit_dists", "")))
+		, _plan(FixPosSpacerTagsFinder::compile_plan(this->_mask_parts))
 		, _trim_tail_length(std::min(barcodes_config.get<size_t>("r1_rc_length"),
 									 std::accumulate(this->_mask_parts.begin(), this->_mask_parts.end(), (size_t)0,
 													 [](size_t sum, const MaskPart & m) { return sum + m.length;})))
-		, _outcomes(std::count_if(this->_mask_parts.begin(), this->_mask_parts.end(), [](const MaskPart & m){ return (m.type == MaskPart::SPACER);}))
+		, _outcomes(1, MultiSpacerOutcomesCounter(this->spacers_num()))
 	{}
 
 	FixPosSpacerTagsFinder::MaskPart::MaskPart(const std::string &spacer, size_t length, Type type, size_t min_edit_distance)
@@ -73,6 +75,88 @@ namespace TagsSearch
 		return mask_parts;
 	}
 
+	std::vector<FixPosSpacerTagsFinder::PlanStep> FixPosSpacerTagsFinder::compile_plan(const std::vector<MaskPart> &mask_parts)
+	{
+		std::vector<PlanStep> plan;
+		size_t offset = 0, spacer_ind = 0;
+		for (auto const &mask_part : mask_parts)
+		{
+			if (mask_part.type != MaskPart::CB && mask_part.type != MaskPart::UMI && mask_part.type != MaskPart::SPACER)
+				throw std::runtime_error("Unexpected MaskPart type: " + std::to_string(mask_part.type));
+
+			if (mask_part.type != MaskPart::SPACER && !plan.empty() && plan.back().type == mask_part.type)
+			{
+				plan.back().length += mask_part.length;
+				offset += mask_part.length;
+				continue;
+			}
+
+			PlanStep step;
+			step.offset = offset;
+			step.length = mask_part.length;
+			step.type = mask_part.type;
+			step.spacer_ind = 0;
+			step.max_ed = 0;
+			if (mask_part.type == MaskPart::SPACER)
+			{
+				step.spacer_ind = spacer_ind++;
+				step.max_ed = unsigned(mask_part.min_edit_distance);
+				step.spacer = mask_part.spacer;
+				if (step.length <= 64)
+				{
+					SpacerFinder::fill_peq(step.spacer, step.spacer_peq);
+				}
+			}
+
+			plan.push_back(std::move(step));
+			offset += mask_part.length;
+		}
+
+		return plan;
+	}
+
+	bool FixPosSpacerTagsFinder::spacer_matches(const PlanStep &step, const char *seq)
+	{
+		if (std::memcmp(seq, step.spacer.data(), step.length) == 0)
+			return true;
+
+		if (step.length > 64)
+			return Tools::edit_distance(step.spacer.data(), step.length, seq, step.length, true, step.max_ed) <= step.max_ed;
+
+		// Global alignment of the spacer against the read part of the same length (Myers' bit-vector algorithm)
+		const uint64_t last_bit = uint64_t(1) << (step.length - 1);
+		uint64_t pv = ~uint64_t(0), mv = 0;
+		unsigned score = unsigned(step.length);
+		for (size_t pos = 0; pos < step.length; ++pos)
+		{
+			uint64_t eq = step.spacer_peq[(unsigned char)seq[pos]];
+			uint64_t xv = eq | mv;
+			uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+			uint64_t ph = mv | ~(xh | pv);
+			uint64_t mh = pv & xh;
+
+			if (ph & last_bit)
+			{
+				score++;
+			}
+			else if (mh & last_bit)
+			{
+				score--;
+			}
+
+			ph = (ph << 1) | 1;
+			mh <<= 1;
+			pv = mh | ~(xv | ph);
+			mv = ph & xv;
+
+			// Each of the remaining symbols can decrease the distance at most by one
+			if (score > step.max_ed + (step.length - pos - 1))
+				return false;
+		}
+
+		return score <= step.max_ed;
+	}
+
 	size_t FixPosSpacerTagsFinder::parse_barcode_mask(const std::string &mask, size_t cur_pos, MaskPart &mask_part)
 	{
 		FixPosSpacerTagsFinder::MaskPart::Type part_type;
@@ -98,75 +182,79 @@ namespace TagsSearch
 		return next_pos;
 	}
 
-	bool FixPosSpacerTagsFinder::parse_fastq_record(FastQReader::FastQRecord &gene_record, Tools::ReadParameters &read_params)
+	void FixPosSpacerTagsFinder::parse_fastq_record(records_t &records, FastQReader::FastQRecord &gene_record,
+	                                                Tools::PackedReadParameters &read_params, size_t thread_ind)
 	{
-		FastQReader::FastQRecord barcodes_record;
-		if (!this->fastq_reader(0).get_next_record(barcodes_record))
-			return false;
-
-		if (!this->fastq_reader(1).get_next_record(gene_record))
-			throw std::runtime_error("File '" + this->fastq_reader(1).filename() + "', read '" + barcodes_record.id + "': fastq ended prematurely!");
+		const FastQReader::FastQRecord &barcodes_record = records[0];
+		gene_record = std::move(records[1]);
 
-		size_t seq_end = this->parse(barcodes_record.sequence, barcodes_record.quality, read_params);
+		size_t seq_end = this->parse(barcodes_record.sequence, barcodes_record.quality, read_params, thread_ind);
 		if (seq_end == std::string::npos)
 		{
-			read_params = Tools::ReadParameters();
-			return true;
+			read_params.clear();
+			return;
 		}
 
 		if (this->_trim_tail_length != 0)
 		{
 			auto tail = barcodes_record.sequence.substr(seq_end - this->_trim_tail_length, this->_trim_tail_length);
-			this->trim(tail, gene_record.sequence, gene_record.quality);
+			this->trim(tail, gene_record.sequence, gene_record.quality, thread_ind);
 		}
+	}
 
-		return true;
+	void FixPosSpacerTagsFinder::init_counters(size_t threads_num)
+	{
+		TagsFinderBase::init_counters(threads_num);
+		this->_outcomes.assign(threads_num, MultiSpacerOutcomesCounter(this->spacers_num()));
 	}
 
-	size_t FixPosSpacerTagsFinder::parse(const std::string &r1_seq, const std::string &r1_quality, Tools::ReadParameters &read_params)
+	size_t FixPosSpacerTagsFinder::spacers_num() const
 	{
-		size_t cur_pos = 0, spacer_ind = 0;
-		std::string cb, umi, cb_quality, umi_quality;
-		for (auto const &mask_part : this->_mask_parts)
+		return size_t(std::count_if(this->_mask_parts.begin(), this->_mask_parts.end(),
+		                            [](const MaskPart & m){ return (m.type == MaskPart::SPACER);}));
+	}
+
+	size_t FixPosSpacerTagsFinder::parse(const boost::string_ref &r1_seq, const boost::string_ref &r1_quality,
+	                                     Tools::PackedReadParameters &read_params, size_t thread_ind)
+	{
+		auto &outcomes = this->_outcomes.at(thread_ind);
+		for (auto const &step : this->_plan)
 		{
-			if (cur_pos + mask_part.length > r1_seq.length())
+			if (step.offset + step.length > r1_seq.length())
 			{
-				this->_outcomes.inc(MultiSpacerOutcomesCounter::SHORT_SEQ);
+				outcomes.inc(MultiSpacerOutcomesCounter::SHORT_SEQ);
 				return std::string::npos;
 			}
 
-			switch (mask_part.type)
+			switch (step.type)
 			{
 				case MaskPart::CB:
-					cb += r1_seq.substr(cur_pos, mask_part.length);
-					cb_quality += r1_quality.substr(cur_pos, mask_part.length);
+					read_params.cell_barcode().append(r1_seq.substr(step.offset, step.length),
+					                                  r1_quality.substr(step.offset, step.length));
 					break;
 				case MaskPart::SPACER:
-					if (Tools::edit_distance(mask_part.spacer.c_str(), r1_seq.substr(cur_pos, mask_part.length).c_str(),
-					                         mask_part.min_edit_distance) > mask_part.min_edit_distance)
+					if (!FixPosSpacerTagsFinder::spacer_matches(step, r1_seq.data() + step.offset))
 					{
-						this->_outcomes.inc_no_spacer(spacer_ind);
+						outcomes.inc_no_spacer(step.spacer_ind);
 						return std::string::npos;
 					}
-					++spacer_ind;
 					break;
 				case MaskPart::UMI:
-					umi += r1_seq.substr(cur_pos, mask_part.length);
-					umi_quality += r1_quality.substr(cur_pos, mask_part.length);
+					read_params.umi().append(r1_seq.substr(step.offset, step.length),
+					                         r1_quality.substr(step.offset, step.length));
 					break;
 				default:
-					throw std::runtime_error("Unexpected MaskPart type: " + std::to_string(mask_part.type));
+					break;
 			}
-			cur_pos += mask_part.length;
 		}
 
-		this->_outcomes.inc(MultiSpacerOutcomesCounter::OK);
-		read_params = Tools::ReadParameters(cb, umi, cb_quality, umi_quality, this->_quality_threshold);
-		return cur_pos;
+		outcomes.inc(MultiSpacerOutcomesCounter::OK);
+		read_params.complete(this->_quality_threshold);
+		return this->_plan.empty() ? 0 : this->_plan.back().offset + this->_plan.back().length;
 	}
 
 	std::string FixPosSpacerTagsFinder::get_additional_stat(long total_reads_read) const
 	{
-		return this->_outcomes.print(total_reads_read);
+		return TagsFinderBase::merge_counters(this->_outcomes).print(total_reads_read);
 	}
 }
@@ -35,20 +35,39 @@ namespace TagsSearch
 			explicit MaskPart(const std::string &spacer="", size_t length=0, Type type=Type::NONE, size_t min_edit_distance=0);
 		};
 
+		// Mask part with the fixed position in the barcodes read. Adjacent parts of the same type are merged.
+		struct PlanStep
+		{
+			size_t offset;
+			size_t length;
+			MaskPart::Type type;
+			size_t spacer_ind;
+			unsigned max_ed;
+			std::string spacer;
+			std::array<uint64_t, 256> spacer_peq; // Myers' masks of the spacer. Used for spacers up to 64bp
+		};
+
 	private:
 		const std::vector<MaskPart> _mask_parts;
+		const std::vector<PlanStep> _plan;
 		const size_t _trim_tail_length;
 
-		MultiSpacerOutcomesCounter _outcomes;
+		std::vector<MultiSpacerOutcomesCounter> _outcomes;
 
 	private:
-		size_t parse(const std::string &r1_seq, const std::string &r1_quality, Tools::ReadParameters &read_params);
+		size_t parse(const boost::string_ref &r1_seq, const boost::string_ref &r1_quality, Tools::PackedReadParameters &read_params,
+		             size_t thread_ind = 0);
+		size_t spacers_num() const;
 
 		static std::vector<MaskPart> parse_mask(const std::string& barcode_mask, const std::string& edit_dist_str);
+		static std::vector<PlanStep> compile_plan(const std::vector<MaskPart> &mask_parts);
+		static bool spacer_matches(const PlanStep &step, const char *seq);
 		static size_t parse_barcode_mask(const std::string &mask, size_t cur_pos, MaskPart &mask_part);
 
 	protected:
-		bool parse_fastq_record(FastQReader::FastQRecord &gene_record, Tools::ReadParameters &read_params) override;
+		void parse_fastq_record(records_t &records, FastQReader::FastQRecord &gene_record,
+		                        Tools::PackedReadParameters &read_params, size_t thread_ind) override;
+		void init_counters(size_t threads_num) override;
 
 		std::string get_additional_stat(long total_reads_read) const override;
 
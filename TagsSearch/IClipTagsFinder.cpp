@@ -2,6 +2,8 @@
 
 #include <Tools/Logs.h>
 
+#include <numeric>
+
 namespace TagsSearch
 {
 	IClipTagsFinder::IClipTagsFinder(const std::vector<std::string> &fastq_filenames,
@@ -12,51 +14,52 @@ namespace TagsSearch
 		: TagsFinderBase(fastq_filenames, config, writer, save_stats, save_read_params)
 		, _barcode_length(barcodes_config.get<size_t>("barcode_length"))
 		, _umi_length(barcodes_config.get<size_t>("umi_length"))
-		, _cant_parse_num(0)
+		, _cant_parse_nums(1, 0)
 	{}
 
-	bool IClipTagsFinder::parse_fastq_record(FastQReader::FastQRecord &gene_record, Tools::ReadParameters &read_params)
+	void IClipTagsFinder::parse_fastq_record(records_t &records, FastQReader::FastQRecord &gene_record,
+	                                         Tools::PackedReadParameters &read_params, size_t thread_ind)
 	{
-		if (!this->fastq_reader(0).get_next_record(gene_record))
-			return false;
+		gene_record = std::move(records[0]);
 
 		if (gene_record.sequence.length() <= this->_umi_length + this->_barcode_length + this->_min_read_len)
 		{
-			this->_cant_parse_num++;
-			read_params = Tools::ReadParameters();
-			return true;
+			this->_cant_parse_nums.at(thread_ind)++;
+			return;
 		}
 
-		std::string barcode = this->parse_cb(gene_record.sequence);
-		std::string barcode_quality = this->parse_cb(gene_record.quality);
-
-		std::string umi = this->parse_umi(gene_record.sequence);
-		std::string umi_quality = this->parse_umi(gene_record.quality);
+		read_params.cell_barcode().append(this->parse_cb(gene_record.sequence), this->parse_cb(gene_record.quality));
+		read_params.umi().append(this->parse_umi(gene_record.sequence), this->parse_umi(gene_record.quality));
 
 		gene_record.sequence = this->trim_barcodes(gene_record.sequence);
 		gene_record.quality = this->trim_barcodes(gene_record.quality);
 
-		read_params = Tools::ReadParameters(barcode, umi, barcode_quality, umi_quality, this->_quality_threshold);
+		read_params.complete(this->_quality_threshold);
+	}
 
-		return true;
+	void IClipTagsFinder::init_counters(size_t threads_num)
+	{
+		TagsFinderBase::init_counters(threads_num);
+		this->_cant_parse_nums.assign(threads_num, 0);
 	}
 
 	std::string IClipTagsFinder::get_additional_stat(long total_reads_read) const
 	{
-		return "Can't parse: " + std::to_string(100 * double(this->_cant_parse_num) / total_reads_read) + "%";
+		size_t cant_parse_num = std::accumulate(this->_cant_parse_nums.begin(), this->_cant_parse_nums.end(), size_t(0));
+		return "Can't parse: " + std::to_string(100 * double(cant_parse_num) / total_reads_read) + "%";
 	}
 
-	std::string IClipTagsFinder::trim_barcodes(const std::string &sequence) const
+	boost::string_ref IClipTagsFinder::trim_barcodes(const boost::string_ref &sequence) const
 	{
 		return sequence.substr(this->_umi_length + this->_barcode_length);
 	}
 
-	std::string IClipTagsFinder::parse_cb(const std::string &sequence) const
+	boost::string_ref IClipTagsFinder::parse_cb(const boost::string_ref &sequence) const
 	{
 		return sequence.substr(this->_umi_length, this->_barcode_length);
 	}
 
-	std::string IClipTagsFinder::parse_umi(const std::string &sequence) const
+	boost::string_ref IClipTagsFinder::parse_umi(const boost::string_ref &sequence) const
 	{
 		return sequence.substr(0, this->_umi_length);
 	}
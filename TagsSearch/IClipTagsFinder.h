@@ -9,16 +9,18 @@ namespace TagsSearch
 	private:
 		const size_t _barcode_length;
 		const size_t _umi_length;
-		size_t _cant_parse_num;
+		std::vector<size_t> _cant_parse_nums;
 
 	protected:
-		bool parse_fastq_record(FastQReader::FastQRecord &gene_record, Tools::ReadParameters &read_params) override;
+		void parse_fastq_record(records_t &records, FastQReader::FastQRecord &gene_record,
+		                        Tools::PackedReadParameters &read_params, size_t thread_ind) override;
+		void init_counters(size_t threads_num) override;
 
 		std::string get_additional_stat(long total_reads_read) const override;
 
-		std::string parse_cb(const std::string &sequence) const;
-		std::string parse_umi(const std::string &sequence) const;
-		std::string trim_barcodes(const std::string &sequence) const;
+		boost::string_ref parse_cb(const boost::string_ref &sequence) const;
+		boost::string_ref parse_umi(const boost::string_ref &sequence) const;
+		boost::string_ref trim_barcodes(const boost::string_ref &sequence) const;
 
 	public:
 		IClipTagsFinder(const std::vector<std::string> &fastq_filenames,
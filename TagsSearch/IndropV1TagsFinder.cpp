@@ -11,42 +11,42 @@ namespace TagsSearch
 	                                       bool save_stats, bool save_read_params)
 		: TagsFinderBase(fastq_filenames, config, writer, save_stats, save_read_params)
 		, _spacer_finder(spacer_config)
+		, _outcomes(1)
 	{}
 
-	Tools::ReadParameters IndropV1TagsFinder::parse(const std::string &r1_seq, const std::string &r1_quality,
-		                                              const SpacerFinder::spacer_pos_t &spacer_pos)
+	void IndropV1TagsFinder::parse(const boost::string_ref &r1_seq, const boost::string_ref &r1_quality,
+	                               const SpacerFinder::spacer_pos_t &spacer_pos, Tools::PackedReadParameters &read_params)
 	{
-		std::string cell_barcode = this->_spacer_finder.parse_cell_barcode(r1_seq, spacer_pos.first, spacer_pos.second);
-		std::string cell_barcode_quality = this->_spacer_finder.parse_cell_barcode(r1_quality, spacer_pos.first, spacer_pos.second);
+		this->_spacer_finder.parse_cell_barcode(r1_seq, r1_quality, spacer_pos.first, spacer_pos.second, read_params.cell_barcode());
+		this->_spacer_finder.parse_umi_barcode(r1_seq, r1_quality, spacer_pos.second, read_params.umi());
 
-		std::string umi_barcode = this->_spacer_finder.parse_umi_barcode(r1_seq, spacer_pos.second);
-		std::string umi_barcode_quality = this->_spacer_finder.parse_umi_barcode(r1_quality, spacer_pos.second);
-
-		return Tools::ReadParameters(cell_barcode, umi_barcode, cell_barcode_quality, umi_barcode_quality, this->_quality_threshold);
+		read_params.complete(this->_quality_threshold);
 	}
 
-	bool IndropV1TagsFinder::parse_fastq_record(FastQReader::FastQRecord &gene_record, Tools::ReadParameters &read_params)
+	void IndropV1TagsFinder::parse_fastq_record(records_t &records, FastQReader::FastQRecord &gene_record,
+	                                            Tools::PackedReadParameters &read_params, size_t thread_ind)
 	{
-		FastQReader::FastQRecord barcodes_record;
-		if (!this->fastq_reader(0).get_next_record(barcodes_record))
-			return false;
-
-		if (!this->fastq_reader(1).get_next_record(gene_record))
-			throw std::runtime_error("File '" + this->fastq_reader(1).filename() + "', read '" + barcodes_record.id + "': fastq ended prematurely!");
+		const FastQReader::FastQRecord &barcodes_record = records[0];
+		gene_record = std::move(records[1]);
 
-		auto spacer_pos = this->_spacer_finder.find_spacer(barcodes_record.sequence);
+		auto spacer_pos = this->_spacer_finder.find_spacer(barcodes_record.sequence, this->_outcomes.at(thread_ind));
 		if (spacer_pos.first == SpacerFinder::ERR_CODE)
-			return true;
+			return;
 
-		read_params = this->parse(barcodes_record.sequence, barcodes_record.quality, spacer_pos);
+		this->parse(barcodes_record.sequence, barcodes_record.quality, spacer_pos, read_params);
 
 		std::string barcodes_tail = this->_spacer_finder.parse_r1_rc(barcodes_record.sequence, spacer_pos.second);
-		this->trim(barcodes_tail, gene_record.sequence, gene_record.quality);
-		return true;
+		this->trim(barcodes_tail, gene_record.sequence, gene_record.quality, thread_ind);
+	}
+
+	void IndropV1TagsFinder::init_counters(size_t threads_num)
+	{
+		TagsFinderBase::init_counters(threads_num);
+		this->_outcomes.assign(threads_num, OutcomesCounter());
 	}
 
 	std::string IndropV1TagsFinder::get_additional_stat(long total_reads_read) const
 	{
-		return this->_spacer_finder.get_outcomes_counter().print(total_reads_read);
+		return TagsFinderBase::merge_counters(this->_outcomes).print(total_reads_read);
 	}
 }
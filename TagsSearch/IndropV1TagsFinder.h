@@ -19,12 +19,15 @@ namespace TagsSearch
 		friend struct TestTagsSearch::test3;
 	private:
 		SpacerFinder _spacer_finder;
+		std::vector<OutcomesCounter> _outcomes;
 
 	protected:
-		virtual Tools::ReadParameters parse(const std::string &r1_seq, const std::string &r1_quality,
-		                                    const SpacerFinder::spacer_pos_t &spacer_pos);
+		virtual void parse(const boost::string_ref &r1_seq, const boost::string_ref &r1_quality,
+		                   const SpacerFinder::spacer_pos_t &spacer_pos, Tools::PackedReadParameters &read_params);
 
-		bool parse_fastq_record(FastQReader::FastQRecord &gene_record, Tools::ReadParameters &read_params) override;
+		void parse_fastq_record(records_t &records, FastQReader::FastQRecord &gene_record,
+		                        Tools::PackedReadParameters &read_params, size_t thread_ind) override;
+		void init_counters(size_t threads_num) override;
 		std::string get_additional_stat(long total_reads_read) const override;
 
 	public:
@@ -1,36 +1,92 @@
 #include <Tools/UtilFunctions.h>
 #include "IndropV3LibsTagsFinder.h"
 
+#include <numeric>
+
 namespace TagsSearch
 {
 
 	IndropV3LibsTagsFinder::IndropV3LibsTagsFinder(const std::vector<std::string> &fastq_filenames,
-	                                               const std::string &library_tag,
+	                                               const std::vector<std::string> &library_tags,
 		                                           const boost::property_tree::ptree &barcodes_config,
 		                                           const boost::property_tree::ptree &config,
-		                                           const std::shared_ptr<ConcurrentGzWriter> &writer,
+		                                           const std::vector<std::shared_ptr<ConcurrentGzWriter>> &writers,
+		                                           const std::shared_ptr<ConcurrentGzWriter> &unassigned_writer,
 		                                           bool save_stats, bool save_read_params)
-		: IndropV3TagsFinder(fastq_filenames, barcodes_config, config, writer, save_stats, save_read_params)
-		, library_tag(library_tag)
+		: IndropV3TagsFinder(fastq_filenames, barcodes_config, config, writers.at(0), save_stats, save_read_params)
+		, library_tags(library_tags)
 		, max_lib_tag_ed(barcodes_config.get<unsigned>("max_libtag_ed", 2))
-	{}
-
-	bool IndropV3LibsTagsFinder::parse_fastq_record(FastQReader::FastQRecord &record, Tools::ReadParameters &read_params)
+		, _unassigned_output(SKIP_READ)
+		, _no_tag_nums(1, 0)
+		, _ambiguous_tag_nums(1, 0)
 	{
-		FastQReader::FastQRecord lib_record;
-		if (!this->fastq_reader(3).get_next_record(lib_record))
-			return false;
+		if (library_tags.size() != writers.size())
+			throw std::runtime_error("Number of library tags (" + std::to_string(library_tags.size()) +
+			                         ") doesn't match number of writers (" + std::to_string(writers.size()) + ")");
+
+		for (size_t i = 1; i < writers.size(); ++i)
+		{
+			this->add_output(writers[i]);
+		}
+
+		if (unassigned_writer != nullptr)
+		{
+			this->_unassigned_output = this->add_output(unassigned_writer);
+		}
+	}
 
-		if (Tools::edit_distance(lib_record.sequence.c_str(), this->library_tag.c_str(), false) > this->max_lib_tag_ed)
+	size_t IndropV3LibsTagsFinder::select_output(const records_t &records, size_t thread_ind)
+	{
+		// Output indexes of libraries match indexes of their tags
+		const auto &tag_seq = records[3].sequence;
+		size_t best_lib = SKIP_READ;
+		unsigned best_ed = this->max_lib_tag_ed + 1;
+		bool ambiguous = false;
+		for (size_t lib_ind = 0; lib_ind < this->library_tags.size(); ++lib_ind)
 		{
-			for (size_t file_id = 0; file_id < 3; ++file_id)
+			const auto &tag = this->library_tags[lib_ind];
+			unsigned ed = Tools::edit_distance(tag_seq.data(), tag_seq.length(), tag.data(), tag.length(), false,
+			                                   std::min(best_ed, this->max_lib_tag_ed));
+			if (ed < best_ed)
+			{
+				best_ed = ed;
+				best_lib = lib_ind;
+				ambiguous = false;
+			}
+			else if (ed == best_ed)
 			{
-				this->fastq_reader(file_id).get_next_record(lib_record);
+				ambiguous = true;
 			}
-			read_params = Tools::ReadParameters();
-			return true;
 		}
 
-		return IndropV3TagsFinder::parse_fastq_record(record, read_params);
+		if (best_lib == SKIP_READ)
+		{
+			this->_no_tag_nums.at(thread_ind)++;
+			return this->_unassigned_output;
+		}
+
+		if (ambiguous)
+		{
+			this->_ambiguous_tag_nums.at(thread_ind)++;
+			return this->_unassigned_output;
+		}
+
+		return best_lib;
+	}
+
+	void IndropV3LibsTagsFinder::init_counters(size_t threads_num)
+	{
+		IndropV3TagsFinder::init_counters(threads_num);
+		this->_no_tag_nums.assign(threads_num, 0);
+		this->_ambiguous_tag_nums.assign(threads_num, 0);
+	}
+
+	std::string IndropV3LibsTagsFinder::get_additional_stat(long total_reads_read) const
+	{
+		size_t no_tag_num = std::accumulate(this->_no_tag_nums.begin(), this->_no_tag_nums.end(), size_t(0));
+		size_t ambiguous_num = std::accumulate(this->_ambiguous_tag_nums.begin(), this->_ambiguous_tag_nums.end(), size_t(0));
+		return IndropV3TagsFinder::get_additional_stat(total_reads_read) +
+				"No library tag: " + std::to_string(100 * double(no_tag_num) / total_reads_read) + "%\n" +
+				"Ambiguous library tag: " + std::to_string(100 * double(ambiguous_num) / total_reads_read) + "%";
 	}
-}
\ No newline at end of file
+}
@@ -7,16 +7,26 @@ namespace TagsSearch
 	class IndropV3LibsTagsFinder : public IndropV3TagsFinder
 	{
 	private:
-		const std::string library_tag;
+		const std::vector<std::string> library_tags;
 		const unsigned max_lib_tag_ed;
+		size_t _unassigned_output; // SKIP_READ if reads without library aren't written
+
+		std::vector<size_t> _no_tag_nums; // One per parsing thread
+		std::vector<size_t> _ambiguous_tag_nums;
 
 	protected:
-		bool parse_fastq_record(FastQReader::FastQRecord &record, Tools::ReadParameters &read_params) override;
+		size_t select_output(const records_t &records, size_t thread_ind) override;
+		void init_counters(size_t threads_num) override;
+		std::string get_additional_stat(long total_reads_read) const override;
 
 	public:
+		// Reads of the i-th library go to writers[i]. Reads, which can't be assigned to a single library, go to
+		// unassigned_writer, or are skipped if it's null.
 		IndropV3LibsTagsFinder(const std::vector<std::string> &fastq_filenames,
-		                       const std::string &library_tag, const boost::property_tree::ptree &barcodes_config,
-		                       const boost::property_tree::ptree &config, const std::shared_ptr<ConcurrentGzWriter> &writer,
+		                       const std::vector<std::string> &library_tags, const boost::property_tree::ptree &barcodes_config,
+		                       const boost::property_tree::ptree &config,
+		                       const std::vector<std::shared_ptr<ConcurrentGzWriter>> &writers,
+		                       const std::shared_ptr<ConcurrentGzWriter> &unassigned_writer,
 		                       bool save_stats, bool save_read_params);
 	};
 }
@@ -11,64 +11,61 @@ namespace TagsSearch
 		, barcode2_length(barcodes_config.get<size_t>("barcode2_length"))
 		, umi_length(barcodes_config.get<size_t>("umi_length"))
 		, trim_tail_length(std::min(barcodes_config.get<size_t>("r1_rc_length"), barcode2_length + umi_length))
+		, _counters(1)
 	{}
 
-	bool IndropV3TagsFinder::parse_fastq_record(FastQReader::FastQRecord &record, Tools::ReadParameters &read_params)
+	void IndropV3TagsFinder::parse_fastq_record(records_t &records, FastQReader::FastQRecord &record,
+	                                            Tools::PackedReadParameters &read_params, size_t thread_ind)
 	{
-		FastQReader::FastQRecord cb1_rec, cb2_rec;
-		if (!this->fastq_reader(0).get_next_record(cb1_rec))
-			return false;
-
-		if (!this->fastq_reader(1).get_next_record(cb2_rec))
-			throw std::runtime_error("File '" + this->fastq_reader(1).filename() + "', read '" + cb1_rec.id + "': fastq ended prematurely!");
-
-		if (!this->fastq_reader(2).get_next_record(record))
-			throw std::runtime_error("File '" + this->fastq_reader(2).filename() + "', read '" + cb1_rec.id + "': fastq ended prematurely!");
+		auto &counter = this->_counters.at(thread_ind);
+		const FastQReader::FastQRecord &cb1_rec = records[0], &cb2_rec = records[1];
+		record = std::move(records[2]);
 
 		if (cb1_rec.sequence.length() < this->barcode1_length)
 		{
-			this->_counter.inc(TwoBarcodesCounter::SHORT_READ1);
-			read_params = Tools::ReadParameters();
-			return true;
+			counter.inc(TwoBarcodesCounter::SHORT_READ1);
+			return;
 		}
 
 		if (cb2_rec.sequence.length() < this->barcode2_length + this->umi_length)
 		{
-			this->_counter.inc(TwoBarcodesCounter::SHORT_READ2);
-			read_params = Tools::ReadParameters();
-			return true;
+			counter.inc(TwoBarcodesCounter::SHORT_READ2);
+			return;
 		}
 
-		this->_counter.inc(TwoBarcodesCounter::OK);
-		std::string cb = this->parse_cb(cb1_rec.sequence, cb2_rec.sequence);
-		std::string umi = this->parse_umi(cb2_rec.sequence);
-		std::string cb_quality = this->parse_cb(cb1_rec.quality, cb2_rec.quality);
-		std::string umi_quality = this->parse_umi(cb2_rec.quality);
+		counter.inc(TwoBarcodesCounter::OK);
+		this->parse_cb(cb1_rec, cb2_rec, read_params.cell_barcode());
+		read_params.umi().append(this->parse_umi(cb2_rec.sequence), this->parse_umi(cb2_rec.quality));
 
 		if (this->trim_tail_length != 0)
 		{
-			std::string tail = cb2_rec.sequence.substr(this->barcode2_length + this->umi_length - this->trim_tail_length, this->trim_tail_length);
-			this->trim(tail, record.sequence, record.quality);
+			auto tail = cb2_rec.sequence.substr(this->barcode2_length + this->umi_length - this->trim_tail_length, this->trim_tail_length);
+			this->trim(tail, record.sequence, record.quality, thread_ind);
 		}
 
-		read_params = Tools::ReadParameters(cb, umi, cb_quality, umi_quality, this->_quality_threshold);
-		return true;
+		read_params.complete(this->_quality_threshold);
+	}
+
+	void IndropV3TagsFinder::init_counters(size_t threads_num)
+	{
+		TagsFinderBase::init_counters(threads_num);
+		this->_counters.assign(threads_num, TwoBarcodesCounter());
 	}
 
-	std::string IndropV3TagsFinder::parse_umi(const std::string &cb2_seq) const
+	boost::string_ref IndropV3TagsFinder::parse_umi(const boost::string_ref &cb2_seq) const
 	{
 		return cb2_seq.substr(this->barcode2_length, this->umi_length);
 	}
 
-	std::string IndropV3TagsFinder::parse_cb(const std::string &cb1_seq, const std::string &cb2_seq) const
+	void IndropV3TagsFinder::parse_cb(const FastQReader::FastQRecord &cb1_rec, const FastQReader::FastQRecord &cb2_rec,
+	                                  Tools::PackedTag &cb) const
 	{
-		std::string cb1 = cb1_seq.substr(0, this->barcode1_length);
-		std::string cb2 = cb2_seq.substr(0, this->barcode2_length);
-		return cb1 + cb2;
+		cb.append(cb1_rec.sequence.substr(0, this->barcode1_length), cb1_rec.quality.substr(0, this->barcode1_length));
+		cb.append(cb2_rec.sequence.substr(0, this->barcode2_length), cb2_rec.quality.substr(0, this->barcode2_length));
 	}
 
 	std::string IndropV3TagsFinder::get_additional_stat(long total_reads_read) const
 	{
-		return this->_counter.print(total_reads_read);
+		return TagsFinderBase::merge_counters(this->_counters).print(total_reads_read);
 	}
 }
@@ -15,14 +15,16 @@ namespace TagsSearch
 		const len_t umi_length;
 		const len_t trim_tail_length;
 
-		TwoBarcodesCounter _counter;
-
+		std::vector<TwoBarcodesCounter> _counters;
 
 	private:
-		std::string parse_cb(const std::string &cb1_seq, const std::string &cb2_seq) const;
+		void parse_cb(const FastQReader::FastQRecord &cb1_rec, const FastQReader::FastQRecord &cb2_rec,
+		              Tools::PackedTag &cb) const;
 
 	protected:
-		bool parse_fastq_record(FastQReader::FastQRecord &record, Tools::ReadParameters &read_params) override;
+		void parse_fastq_record(records_t &records, FastQReader::FastQRecord &record,
+		                        Tools::PackedReadParameters &read_params, size_t thread_ind) override;
+		void init_counters(size_t threads_num) override;
 
 		std::string get_additional_stat(long total_reads_read) const override;
 
@@ -33,6 +35,6 @@ namespace TagsSearch
 		                   const std::shared_ptr<ConcurrentGzWriter> &writer,
 		                   bool save_stats, bool save_read_params);
 
-		std::string parse_umi(const std::string &cb2_seq) const;
+		boost::string_ref parse_umi(const boost::string_ref &cb2_seq) const;
 	};
 }
\ No newline at end of file
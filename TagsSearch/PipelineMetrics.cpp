@@ -0,0 +1,156 @@
+#include "PipelineMetrics.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace TagsSearch
+{
+	PipelineMetrics::ScopedTimer::ScopedTimer(counter_t *counter)
+		: _counter(counter)
+	{
+		if (counter != nullptr)
+		{
+			this->_start = clock_t::now();
+		}
+	}
+
+	PipelineMetrics::ScopedTimer::~ScopedTimer()
+	{
+		if (this->_counter == nullptr)
+			return;
+
+		*this->_counter += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				clock_t::now() - this->_start).count());
+	}
+
+	PipelineMetrics::PipelineMetrics(const std::string &filename, double interval_sec)
+		: _filename(filename)
+		, _interval(std::max<long>(long(interval_sec * 1000), 1))
+		, _start_time(clock_t::now())
+		, _out(filename)
+		, _finished(false)
+	{
+		if (!this->_out)
+			throw std::runtime_error("Can't open file for metrics: '" + filename + "'");
+	}
+
+	PipelineMetrics::~PipelineMetrics()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->_mutex);
+			this->_finished = true;
+		}
+		this->_finished_cv.notify_all();
+
+		if (this->_writing_thread.joinable())
+		{
+			this->_writing_thread.join();
+		}
+	}
+
+	PipelineMetrics::counter_t* PipelineMetrics::counter(const std::string &stage, const std::string &name)
+	{
+		this->_counters.emplace_back(0);
+		this->_values.push_back(Value{stage, name, &this->_counters.back(), nullptr});
+		return &this->_counters.back();
+	}
+
+	void PipelineMetrics::add_gauge(const std::string &stage, const std::string &name,
+	                                const std::function<uint64_t()> &gauge)
+	{
+		this->_values.push_back(Value{stage, name, nullptr, gauge});
+	}
+
+	void PipelineMetrics::start()
+	{
+		this->_writing_thread = std::thread([this]{ this->run_writing(); });
+	}
+
+	void PipelineMetrics::finish()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->_mutex);
+			if (this->_finished)
+				return;
+
+			this->_finished = true;
+		}
+		this->_finished_cv.notify_all();
+
+		if (this->_writing_thread.joinable())
+		{
+			this->_writing_thread.join();
+		}
+
+		this->write_snapshot(true);
+		if (!this->_out)
+			throw std::runtime_error("Can't write metrics to file: '" + this->_filename + "'");
+	}
+
+	void PipelineMetrics::run_writing()
+	{
+		std::unique_lock<std::mutex> lock(this->_mutex);
+		while (!this->_finished_cv.wait_for(lock, this->_interval, [this]{ return this->_finished; }))
+		{
+			this->write_snapshot(false);
+		}
+	}
+
+	void PipelineMetrics::write_snapshot(bool final)
+	{
+		auto elapsed = std::chrono::duration<double>(clock_t::now() - this->_start_time).count();
+
+		std::vector<std::string> stages;
+		for (auto const &value : this->_values)
+		{
+			if (std::find(stages.begin(), stages.end(), value.stage) == stages.end())
+			{
+				stages.push_back(value.stage);
+			}
+		}
+
+		std::ostringstream line;
+		line << "{\"elapsed_sec\": " << elapsed << ", \"final\": " << (final ? "true" : "false") << ", \"stages\": {";
+		for (size_t stage_ind = 0; stage_ind < stages.size(); ++stage_ind)
+		{
+			line << ((stage_ind == 0) ? "" : ", ") << "\"" << PipelineMetrics::escape(stages[stage_ind]) << "\": {";
+			bool first_value = true;
+			for (auto const &value : this->_values)
+			{
+				if (value.stage != stages[stage_ind])
+					continue;
+
+				line << (first_value ? "" : ", ") << "\"" << PipelineMetrics::escape(value.name) << "\": "
+				     << ((value.counter != nullptr) ? value.counter->load() : value.gauge());
+				first_value = false;
+			}
+			line << "}";
+		}
+		line << "}}\n";
+
+		this->_out << line.str() << std::flush;
+	}
+
+	std::string PipelineMetrics::escape(const std::string &text)
+	{
+		std::string res;
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				res += '\\';
+			}
+
+			if (static_cast<unsigned char>(c) < 0x20)
+			{
+				res += ' ';
+				continue;
+			}
+
+			res += c;
+		}
+
+		return res;
+	}
+}
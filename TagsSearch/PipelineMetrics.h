@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace TagsSearch
+{
+	// Counters of the pipeline stages (reading, parsing, compression and writing), which are updated by the threads
+	// of the stages. A separate thread writes snapshots of all values to a file as JSON lines, one object per line:
+	// {"elapsed_sec": ..., "final": false, "stages": {"<stage>": {"<name>": <value>, ...}, ...}}.
+	// The last line has "final": true and contains totals of the run. Times are in nanoseconds.
+	// Counters and gauges must be added before start().
+	class PipelineMetrics
+	{
+	public:
+		using counter_t = std::atomic<uint64_t>;
+		using clock_t = std::chrono::steady_clock;
+
+		// Adds time of the scope to the counter. Does nothing if the counter is null, i.e. metrics are disabled
+		class ScopedTimer
+		{
+		private:
+			counter_t *_counter;
+			clock_t::time_point _start;
+
+		public:
+			explicit ScopedTimer(counter_t *counter);
+			~ScopedTimer();
+		};
+
+	private:
+		struct Value
+		{
+			std::string stage;
+			std::string name;
+			counter_t *counter;
+			std::function<uint64_t()> gauge;
+		};
+
+		const std::string _filename;
+		const std::chrono::milliseconds _interval;
+		const clock_t::time_point _start_time;
+
+		std::deque<counter_t> _counters;
+		std::vector<Value> _values;
+
+		std::ofstream _out;
+		std::thread _writing_thread;
+		std::mutex _mutex;
+		std::condition_variable _finished_cv;
+		bool _finished;
+
+	private:
+		static std::string escape(const std::string &text);
+
+		void write_snapshot(bool final);
+		void run_writing();
+
+	public:
+		PipelineMetrics(const std::string &filename, double interval_sec);
+		~PipelineMetrics();
+
+		counter_t* counter(const std::string &stage, const std::string &name);
+		void add_gauge(const std::string &stage, const std::string &name, const std::function<uint64_t()> &gauge);
+
+		void start();
+		void finish(); // Writes the final snapshot
+	};
+}
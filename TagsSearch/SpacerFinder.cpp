@@ -2,8 +2,10 @@
 
 #include "Tools/UtilFunctions.h"
 #include "Tools/Logs.h"
+#include "Tools/PackedReadParameters.h"
 
 using std::string;
+using boost::string_ref;
 
 namespace TagsSearch
 {
@@ -39,13 +41,46 @@ namespace TagsSearch
 				this->max_spacer_ed - this->spacer_prefix.length();
 		this->spacer_min_suffix_start = this->spacer_min_pos + this->spacer.length() - this->spacer_prefix.length();
 		this->spacer_min_suffix_start -= std::min(this->spacer_min_suffix_start, this->max_spacer_ed);
+
+		this->use_bit_parallel = (this->spacer.length() <= 64);
+		if (this->use_bit_parallel)
+		{
+			SpacerFinder::fill_peq(this->spacer, this->spacer_peq);
+			SpacerFinder::fill_peq(string(this->spacer.rbegin(), this->spacer.rend()), this->spacer_rev_peq);
+		}
+	}
+
+	void SpacerFinder::fill_peq(const std::string &pattern, std::array<uint64_t, 256> &peq)
+	{
+		peq.fill(0);
+		for (size_t i = 0; i < pattern.length(); ++i)
+		{
+			if (pattern[i] == 'N')
+			{
+				for (auto &mask : peq)
+				{
+					mask |= uint64_t(1) << i;
+				}
+			}
+			else
+			{
+				peq[(unsigned char)pattern[i]] |= uint64_t(1) << i;
+			}
+		}
+
+		peq['N'] = ~uint64_t(0); // N in the read matches anything
 	}
 
-	SpacerFinder::spacer_pos_t SpacerFinder::find_spacer(const string &seq)
+	SpacerFinder::spacer_pos_t SpacerFinder::find_spacer(const string_ref &seq)
+	{
+		return this->find_spacer(seq, this->outcomes);
+	}
+
+	SpacerFinder::spacer_pos_t SpacerFinder::find_spacer(const string_ref &seq, OutcomesCounter &outcomes) const
 	{
 		if (seq.length() < this->min_seq_len)
 		{
-			this->outcomes.inc(OutcomesCounter::SHORT_SEQ);
+			outcomes.inc(OutcomesCounter::SHORT_SEQ);
 			return std::make_pair(SpacerFinder::ERR_CODE, SpacerFinder::ERR_CODE);
 		}
 
@@ -53,61 +88,169 @@ namespace TagsSearch
 		spacer_pos.second = spacer_pos.first + this->spacer.length();
 		if (spacer_pos.first == SpacerFinder::ERR_CODE)
 		{
-			spacer_pos = this->find_spacer_partial(seq);
+			spacer_pos = this->use_bit_parallel ? this->find_spacer_bit_parallel(seq, outcomes)
+			                                    : this->find_spacer_partial(seq, outcomes);
 		}
 
 		if (spacer_pos.first == SpacerFinder::ERR_CODE)
 		{
-			this->outcomes.inc(OutcomesCounter::NO_SPACER);
+			outcomes.inc(OutcomesCounter::NO_SPACER);
 			return std::make_pair(SpacerFinder::ERR_CODE, SpacerFinder::ERR_CODE);
 		}
 
 		if (seq.length() < spacer_pos.second + this->barcode_length + this->umi_length)
 		{
-			this->outcomes.inc(OutcomesCounter::SHORT_SEQ);
+			outcomes.inc(OutcomesCounter::SHORT_SEQ);
 			return std::make_pair(SpacerFinder::ERR_CODE, SpacerFinder::ERR_CODE);
 		}
 
-		this->outcomes.inc(OutcomesCounter::OK);
+		outcomes.inc(OutcomesCounter::OK);
 		return spacer_pos;
 	}
 
-	SpacerFinder::spacer_pos_t SpacerFinder::find_spacer_partial(const string &seq)
+	SpacerFinder::spacer_pos_t SpacerFinder::find_spacer_partial(const string_ref &seq, OutcomesCounter &outcomes) const
 	{
-		len_t suffix_pos = seq.rfind(this->spacer_suffix, this->spacer_max_suffix_start);
+		len_t suffix_pos = seq.substr(0, this->spacer_max_suffix_start + this->spacer_suffix.length()).rfind(this->spacer_suffix);
 		len_t spacer_pos = suffix_pos - this->spacer.length() + this->spacer_suffix.length();
 
 		if (suffix_pos == string::npos || suffix_pos < this->spacer_min_suffix_start)
 		{
-			spacer_pos = seq.find(this->spacer_prefix, this->spacer_min_pos);
-			if (spacer_pos == string::npos || spacer_pos > this->spacer_max_pos)
+			spacer_pos = seq.substr(this->spacer_min_pos).find(this->spacer_prefix);
+			if (spacer_pos == string::npos || spacer_pos + this->spacer_min_pos > this->spacer_max_pos)
 				return std::make_pair(SpacerFinder::ERR_CODE, SpacerFinder::ERR_CODE);
+
+			spacer_pos += this->spacer_min_pos;
 		}
 
-		int ed = Tools::edit_distance(this->spacer.c_str(), seq.substr(spacer_pos, this->spacer.length()).c_str(), true,
-		                              this->max_spacer_ed);
+		auto spacer_seq = seq.substr(spacer_pos, this->spacer.length());
+		int ed = Tools::edit_distance(this->spacer.data(), this->spacer.length(), spacer_seq.data(), spacer_seq.length(),
+		                              true, this->max_spacer_ed);
 
 		if (ed > this->max_spacer_ed)
 			return std::make_pair(SpacerFinder::ERR_CODE, SpacerFinder::ERR_CODE);
 
-		this->outcomes.inc(OutcomesCounter::SPACER_MODIFIED);
+		outcomes.inc(OutcomesCounter::SPACER_MODIFIED);
 		return std::make_pair(spacer_pos, spacer_pos + this->spacer.length());
 	}
 
-	string SpacerFinder::parse_cell_barcode(const string &seq, len_t spacer_start, len_t spacer_end) const
+	SpacerFinder::spacer_pos_t SpacerFinder::find_spacer_bit_parallel(const string_ref &seq, OutcomesCounter &outcomes) const
 	{
-		string barcode = seq.substr(spacer_end, this->barcode_length);
+		// Approximate search of the spacer, which starts inside [spacer_min_pos, spacer_max_pos]. For each end position
+		// in the window, score is the minimal edit distance between the spacer and a substring, ending there.
+		const len_t spacer_len = this->spacer.length();
+		const uint64_t last_bit = uint64_t(1) << (spacer_len - 1);
+		const len_t search_end = std::min(seq.length(), this->spacer_max_pos + spacer_len + this->max_spacer_ed);
+
+		uint64_t pv = ~uint64_t(0), mv = 0;
+		unsigned score = unsigned(spacer_len);
+
+		unsigned best_score = unsigned(this->max_spacer_ed) + 1;
+		len_t best_start = SpacerFinder::ERR_CODE, best_end = SpacerFinder::ERR_CODE;
+		for (len_t pos = this->spacer_min_pos; pos < search_end; ++pos)
+		{
+			uint64_t eq = this->spacer_peq[(unsigned char)seq[pos]];
+			uint64_t xv = eq | mv;
+			uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+			uint64_t ph = mv | ~(xh | pv);
+			uint64_t mh = pv & xh;
+
+			if (ph & last_bit)
+			{
+				score++;
+			}
+			else if (mh & last_bit)
+			{
+				score--;
+			}
+
+			ph <<= 1;
+			mh <<= 1;
+			pv = mh | ~(xv | ph);
+			mv = ph & xv;
+
+			if (score > this->max_spacer_ed || score > best_score)
+				continue;
+
+			// Among the best matches, the one with the least difference in length from the spacer is taken
+			len_t start = this->find_spacer_start(seq, this->spacer_min_pos, pos + 1, score);
+			if (start > this->spacer_max_pos)
+				continue;
+
+			if (score < best_score || SpacerFinder::length_diff(pos + 1 - start, spacer_len) <
+					SpacerFinder::length_diff(best_end - best_start, spacer_len))
+			{
+				best_score = score;
+				best_start = start;
+				best_end = pos + 1;
+			}
+		}
+
+		if (best_start == SpacerFinder::ERR_CODE)
+			return std::make_pair(SpacerFinder::ERR_CODE, SpacerFinder::ERR_CODE);
+
+		outcomes.inc(OutcomesCounter::SPACER_MODIFIED);
+		return std::make_pair(best_start, best_end);
+	}
+
+	SpacerFinder::len_t SpacerFinder::find_spacer_start(const string_ref &seq, len_t search_start, len_t spacer_end,
+	                                                    unsigned ed) const
+	{
+		// Global alignment of the reversed spacer against the read, which is read backwards from spacer_end
+		const len_t spacer_len = this->spacer.length();
+		const uint64_t last_bit = uint64_t(1) << (spacer_len - 1);
+		const len_t min_start = std::max(search_start, spacer_end - std::min(spacer_end, spacer_len + ed));
+
+		uint64_t pv = ~uint64_t(0), mv = 0;
+		unsigned score = unsigned(spacer_len);
+
+		len_t best_start = SpacerFinder::ERR_CODE;
+		for (len_t pos = spacer_end; pos > min_start; --pos)
+		{
+			uint64_t eq = this->spacer_rev_peq[(unsigned char)seq[pos - 1]];
+			uint64_t xv = eq | mv;
+			uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+			uint64_t ph = mv | ~(xh | pv);
+			uint64_t mh = pv & xh;
+
+			if (ph & last_bit)
+			{
+				score++;
+			}
+			else if (mh & last_bit)
+			{
+				score--;
+			}
+
+			ph = (ph << 1) | 1;
+			mh <<= 1;
+			pv = mh | ~(xv | ph);
+			mv = ph & xv;
+
+			if (score == ed && (best_start == SpacerFinder::ERR_CODE ||
+					SpacerFinder::length_diff(spacer_end - (pos - 1), spacer_len) <
+					SpacerFinder::length_diff(spacer_end - best_start, spacer_len)))
+			{
+				best_start = pos - 1;
+			}
+		}
+
+		return best_start;
+	}
+
+	string SpacerFinder::parse_cell_barcode(const string_ref &seq, len_t spacer_start, len_t spacer_end) const
+	{
+		string_ref barcode = seq.substr(spacer_end, this->barcode_length);
 		if (barcode.length() != this->barcode_length)
 		{
 			L_ERR << "Barcode is too short (required length: " << this->barcode_length << "): '" << barcode << "'";
 		}
 
-		return seq.substr(0, spacer_start) + barcode;
+		return seq.substr(0, spacer_start).to_string() + barcode.to_string();
 	}
 
-	string SpacerFinder::parse_umi_barcode(const string &seq, len_t spacer_end) const
+	string SpacerFinder::parse_umi_barcode(const string_ref &seq, len_t spacer_end) const
 	{
-		string res = seq.substr(spacer_end + this->barcode_length, this->umi_length);
+		string res = seq.substr(spacer_end + this->barcode_length, this->umi_length).to_string();
 		if (res.length() != this->umi_length)
 		{
 			L_ERR << "UMI is too short (required length: " << this->umi_length << "): '" << res << "'";
@@ -116,9 +259,34 @@ namespace TagsSearch
 		return res;
 	}
 
-	string SpacerFinder::parse_r1_rc(const string &seq, len_t spacer_end) const
+	void SpacerFinder::parse_cell_barcode(const string_ref &seq, const string_ref &quality, len_t spacer_start,
+	                                      len_t spacer_end, Tools::PackedTag &cell_barcode) const
+	{
+		string_ref barcode = seq.substr(spacer_end, this->barcode_length);
+		if (barcode.length() != this->barcode_length)
+		{
+			L_ERR << "Barcode is too short (required length: " << this->barcode_length << "): '" << barcode << "'";
+		}
+
+		cell_barcode.append(seq.substr(0, spacer_start), quality.substr(0, spacer_start));
+		cell_barcode.append(barcode, quality.substr(spacer_end, this->barcode_length));
+	}
+
+	void SpacerFinder::parse_umi_barcode(const string_ref &seq, const string_ref &quality, len_t spacer_end,
+	                                     Tools::PackedTag &umi) const
+	{
+		string_ref umi_seq = seq.substr(spacer_end + this->barcode_length, this->umi_length);
+		if (umi_seq.length() != this->umi_length)
+		{
+			L_ERR << "UMI is too short (required length: " << this->umi_length << "): '" << umi_seq << "'";
+		}
+
+		umi.append(umi_seq, quality.substr(spacer_end + this->barcode_length, this->umi_length));
+	}
+
+	string SpacerFinder::parse_r1_rc(const string_ref &seq, len_t spacer_end) const
 	{
-		return seq.substr(spacer_end + this->barcode_length + this->umi_length - this->r1_rc_length, this->r1_rc_length);
+		return seq.substr(spacer_end + this->barcode_length + this->umi_length - this->r1_rc_length, this->r1_rc_length).to_string();
 	}
 
 	const OutcomesCounter &SpacerFinder::get_outcomes_counter() const
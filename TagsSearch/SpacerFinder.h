@@ -1,14 +1,17 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string>
 
 #include <boost/property_tree/ptree.hpp>
+#include <boost/utility/string_ref.hpp>
 
 #include "Counters/OutcomesCounter.h"
 
 namespace Tools
 {
-	class ReadParameters;
+	class PackedTag;
 }
 
 namespace TagsSearch
@@ -38,6 +41,11 @@ namespace TagsSearch
 
 		size_t min_seq_len;
 
+		// Bit masks of spacer positions, which match each symbol (Myers' bit-vector algorithm). Used for spacers up to 64bp.
+		std::array<uint64_t, 256> spacer_peq;
+		std::array<uint64_t, 256> spacer_rev_peq;
+		bool use_bit_parallel;
+
 		OutcomesCounter outcomes;
 
 	public:
@@ -45,15 +53,30 @@ namespace TagsSearch
 
 		explicit SpacerFinder(const boost::property_tree::ptree &config, const std::string& reads_params_file = "");
 
-		spacer_pos_t find_spacer(const std::string& seq);
+		spacer_pos_t find_spacer(const boost::string_ref& seq);
+		spacer_pos_t find_spacer(const boost::string_ref& seq, OutcomesCounter &outcomes) const;
 
-		std::string parse_cell_barcode(const std::string& seq, len_t spacer_start, len_t spacer_end) const;
-		std::string parse_umi_barcode(const std::string& seq, len_t spacer_end) const;
-		std::string parse_r1_rc(const std::string &seq, len_t spacer_end) const;
+		std::string parse_cell_barcode(const boost::string_ref& seq, len_t spacer_start, len_t spacer_end) const;
+		std::string parse_umi_barcode(const boost::string_ref& seq, len_t spacer_end) const;
+		void parse_cell_barcode(const boost::string_ref& seq, const boost::string_ref& quality, len_t spacer_start,
+		                        len_t spacer_end, Tools::PackedTag &cell_barcode) const;
+		void parse_umi_barcode(const boost::string_ref& seq, const boost::string_ref& quality, len_t spacer_end,
+		                       Tools::PackedTag &umi) const;
+		std::string parse_r1_rc(const boost::string_ref &seq, len_t spacer_end) const;
 
 		const OutcomesCounter& get_outcomes_counter() const;
 
 	private:
-		spacer_pos_t find_spacer_partial(const std::string& seq);
+		spacer_pos_t find_spacer_partial(const boost::string_ref& seq, OutcomesCounter &outcomes) const;
+		spacer_pos_t find_spacer_bit_parallel(const boost::string_ref& seq, OutcomesCounter &outcomes) const;
+		len_t find_spacer_start(const boost::string_ref& seq, len_t search_start, len_t spacer_end, unsigned ed) const;
+
+		static len_t length_diff(len_t len1, len_t len2)
+		{
+			return (len1 > len2) ? (len1 - len2) : (len2 - len1);
+		}
+
+	public:
+		static void fill_peq(const std::string &pattern, std::array<uint64_t, 256> &peq);
 	};
 }
\ No newline at end of file
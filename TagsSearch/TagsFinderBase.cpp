@@ -1,8 +1,10 @@
 #include "TagsFinderBase.h"
 
 #include "Tools/Logs.h"
-#include "Tools/ReadParameters.h"
+#include "Tools/SequenceKernels.h"
 
+#include <numeric>
+#include <random>
 #include <thread>
 
 namespace TagsSearch
@@ -13,68 +15,136 @@ namespace TagsSearch
 	                               bool save_stats, bool save_read_params)
 		: _save_stats(save_stats)
 		, _save_read_params(save_read_params)
-		, _quality_threshold(processing_config.get<int>("min_barcode_quality", 0))
-		, _file_uid(TagsFinderBase::get_file_uid())
+		, _bam_output(processing_config.get<std::string>("output_format", "fastq") == "bam")
+		, _binary_params(processing_config.get<std::string>("params_format", "text") == "binary")
+		, _file_uid(TagsFinderBase::get_file_uid(processing_config.get<long>("read_uid_seed", -1)))
 		, _total_reads_read(0)
 		, _low_quality_reads(0)
 		, _parsed_reads(0)
-		, _file_ended(false)
-		, _reading_in_progress(false)
+		, _parsing_threads_num(processing_config.get<size_t>("parsing_threads", 0))
+		, _compression_threads_num(processing_config.get<size_t>("compression_threads", 0))
+		, _max_memory(processing_config.get<size_t>("max_memory_mb", 1024) << 20)
+		, _corrections_counters(1)
+		, _poly_a_base(0)
+		, _reading_wait_time(nullptr)
 		, _min_read_len(processing_config.get<unsigned>("min_align_length", 10))
+		, _quality_threshold(processing_config.get<int>("min_barcode_quality", 0))
 		, poly_a(processing_config.get<std::string>("poly_a_tail", "AAAAAAAA"))
-		, _trims_counter()
-		, _fastq_writer(writer)
+		, _trims_counters(1)
 	{
+		if (!this->poly_a.empty() && this->poly_a.find_first_not_of(this->poly_a[0]) == std::string::npos)
+		{
+			this->_poly_a_base = this->poly_a[0];
+		}
+
+		auto decompression_threads = processing_config.get<size_t>("decompression_threads", 2);
 		for (auto &&filename : fastq_filenames)
 		{
-			this->_fastq_readers.emplace_back(std::make_shared<FastQReader>(filename));
+			this->_fastq_readers.emplace_back(std::make_shared<FastQReader>(filename, decompression_threads));
 		}
 
-		if (save_read_params)
+		auto barcodes_filename = processing_config.get<std::string>("barcodes_file", "");
+		if (!barcodes_filename.empty())
 		{
-			this->_params_writer = std::make_shared<ConcurrentGzWriter>(writer->base_filename(), "params.gz", 0);
+			this->_barcodes_corrector = std::make_shared<CellBarcodesCorrector>(barcodes_filename,
+					processing_config.get<std::string>("barcodes_type", "indrop"),
+					processing_config.get<unsigned>("max_cb_correction_distance", 1));
 		}
+
+		this->add_output(writer);
 	}
 
-	bool TagsFinderBase::get_next_record(FastQReader::FastQRecord& record, Tools::ReadParameters &params)
+	size_t TagsFinderBase::add_output(const std::shared_ptr<ConcurrentGzWriter> &writer)
 	{
-		if (this->_file_ended)
-			return false;
-
-		if (!this->parse_fastq_record(record, params))
+		Output output;
+		output.fastq_writer = writer;
+		if (this->_save_read_params && this->_binary_params)
 		{
-			this->_file_ended = true;
-			return false;
+			output.params_writer = std::make_shared<ConcurrentGzWriter>(writer->base_filename(), "params.bin", 0,
+			                                                            writer->compression_level(), true,
+			                                                            Tools::BinaryReadParams::file_header(this->_file_uid));
+		}
+		else if (this->_save_read_params)
+		{
+			output.params_writer = std::make_shared<ConcurrentGzWriter>(writer->base_filename(), "params.gz", 0,
+			                                                            writer->compression_level(), writer->bgzf());
 		}
 
-		if (this->_total_reads_read % 5000000 == 0 && this->_total_reads_read > 0)
+		this->_outputs.push_back(std::move(output));
+		return this->_outputs.size() - 1;
+	}
+
+	size_t TagsFinderBase::select_output(const records_t &, size_t)
+	{
+		return 0;
+	}
+
+	size_t TagsFinderBase::get_next_record(records_t &records, long read_number, FastQReader::FastQRecord &record,
+	                                       std::string &record_id, Tools::PackedReadParameters &params, size_t thread_ind)
+	{
+		size_t output_ind = this->select_output(records, thread_ind);
+		if (output_ind == SKIP_READ)
+			return SKIP_READ;
+
+		params.clear();
 		{
-			L_TRACE << "Total " << this->_total_reads_read << " read (" << this->_parsed_reads << " parsed, "
-			        << (this->_parsed_reads - this->_low_quality_reads) << " passed quality threshold)";
+			PipelineMetrics::ScopedTimer timer(this->_parsing_metrics[thread_ind].parse_time);
+			this->parse_fastq_record(records, record, params, thread_ind);
 		}
-		this->_total_reads_read++;
 
 		if (params.is_empty() || record.sequence.length() < this->_min_read_len)
-			return false;
+			return SKIP_READ;
 
 		++this->_parsed_reads;
 
 		if (!params.pass_quality_threshold())
 		{
 			this->_low_quality_reads++;
-			return false;
+			return SKIP_READ;
 		}
 
-		std::string read_prefix = "@" + this->_file_uid + std::to_string(this->_total_reads_read);
+		if (this->_barcodes_corrector != nullptr)
+		{
+			this->correct_cell_barcode(params, thread_ind);
+		}
 
-		record.id = this->_save_read_params ? read_prefix : params.encoded_id(read_prefix);
+		record_id = "@" + this->_file_uid;
+		record_id += std::to_string(read_number);
+		if (!this->_save_read_params && !this->_bam_output)
+		{
+			params.append_encoded_id(record_id);
+		}
+		record.id = record_id;
 
 		if (this->_save_stats)
 		{
-			this->_num_reads_per_cb[params.cell_barcode()]++;
+			this->_outputs[output_ind].num_reads_per_cb_by_thread[thread_ind].inc(params.cell_barcode());
 		}
 
-		return true;
+		return output_ind;
+	}
+
+	void TagsFinderBase::correct_cell_barcode(Tools::PackedReadParameters &params, size_t thread_ind)
+	{
+		std::string corrected;
+		auto res = this->_barcodes_corrector->correct(params.cell_barcode(), corrected);
+		auto &counter = this->_corrections_counters.at(thread_ind);
+		switch (res)
+		{
+			case CellBarcodesCorrector::EXACT:
+				counter.inc(CorrectionsCounter::EXACT);
+				break;
+			case CellBarcodesCorrector::CORRECTED:
+				counter.inc(CorrectionsCounter::CORRECTED);
+				params.correct_cell_barcode(corrected);
+				break;
+			case CellBarcodesCorrector::NO_MATCH:
+				counter.inc(CorrectionsCounter::NO_MATCH);
+				break;
+			case CellBarcodesCorrector::AMBIGUOUS:
+				counter.inc(CorrectionsCounter::AMBIGUOUS);
+				break;
+		}
 	}
 
 	std::string TagsFinderBase::results_to_string() const
@@ -82,51 +152,78 @@ namespace TagsSearch
 		std::stringstream ss;
 		ss << " (" << this->_total_reads_read << " reads)\n"
 		   << this->get_additional_stat(this->_total_reads_read) << "\n"
-		   << this->_trims_counter.print();
+		   << TagsFinderBase::merge_counters(this->_trims_counters).print();
+
+		if (this->_barcodes_corrector != nullptr)
+		{
+			ss << TagsFinderBase::merge_counters(this->_corrections_counters)
+					.print(this->_parsed_reads - this->_low_quality_reads);
+		}
+
+		if (this->_outputs.size() > 1)
+		{
+			ss << "Reads written per output:\n";
+			for (auto const &output : this->_outputs)
+			{
+				long written_reads = std::accumulate(output.written_reads_by_thread.begin(),
+				                                     output.written_reads_by_thread.end(), 0l);
+				ss << "\t" << output.fastq_writer->base_filename() << ": " << written_reads << "\n";
+			}
+		}
 
 		return ss.str();
 	}
 
-	void TagsFinderBase::trim(const std::string &barcodes_tail, std::string &sequence, std::string &quality)
+	void TagsFinderBase::trim(const std::string &barcodes_tail, std::string &sequence, std::string &quality,
+	                          size_t thread_ind)
+	{
+		boost::string_ref sequence_ref(sequence), quality_ref(quality);
+		this->trim(barcodes_tail, sequence_ref, quality_ref, thread_ind);
+
+		sequence.resize(sequence_ref.length());
+		quality.resize(quality_ref.length());
+	}
+
+	void TagsFinderBase::trim(const boost::string_ref &barcodes_tail, boost::string_ref &sequence,
+	                          boost::string_ref &quality, size_t thread_ind)
 	{
+		auto &trims_counter = this->_trims_counters.at(thread_ind);
+
 		if (sequence.length() != quality.length())
 			throw std::runtime_error("Read has different lengths of sequence and quality string: '" +
-											 sequence + "', '" + quality + "'");
+											 sequence.to_string() + "', '" + quality.to_string() + "'");
 
 		len_t trim_pos = sequence.length();
 		// attempt 1: check for reverse complement of the UMI+second barcode, remove trailing As
 		// RC of UMI+second barcode (up to a length r1_rc_length - spacer_finder parameter)
-		std::string rcb = this->rc.rc(barcodes_tail);
+		std::string rcb(barcodes_tail.data(), barcodes_tail.length());
+		Tools::Kernels::reverse_complement(&rcb[0], rcb.length());
 
 		len_t rc_pos = sequence.find(rcb);
 		if (rc_pos != std::string::npos)
 		{
 			trim_pos = rc_pos;
-			this->_trims_counter.inc(TrimsCounter::RC);
+			trims_counter.inc(TrimsCounter::RC);
 		}
 		else
 		{
 			// attempt 2: find polyA block
-			rc_pos = sequence.find(this->poly_a);
+			rc_pos = (this->_poly_a_base != 0)
+					? Tools::Kernels::find_run(sequence.data(), sequence.length(), this->_poly_a_base, this->poly_a.length())
+					: sequence.find(this->poly_a);
 			if (rc_pos != std::string::npos)
 			{
 				trim_pos = rc_pos;
-				this->_trims_counter.inc(TrimsCounter::POLY_A);
+				trims_counter.inc(TrimsCounter::POLY_A);
 			}
 		}
 
 		// attempt 3: trim trailing As
-		bool a_trim = false;
-		len_t skip_count = 0;
-		while (trim_pos > 0 && (sequence.at(trim_pos - 1) == 'A' || sequence.at(trim_pos - 1) == 'N'))
+		len_t skip_count = Tools::Kernels::trailing_run_length(sequence.data(), trim_pos, 'A', 'N');
+		if (skip_count > 0)
 		{
-			trim_pos--;
-			skip_count++;
-			a_trim = true;
-		}
-		if (a_trim)
-		{
-			this->_trims_counter.inc(TrimsCounter::A_TRIM);
+			trim_pos -= skip_count;
+			trims_counter.inc(TrimsCounter::A_TRIM);
 		}
 
 		//attempt 4: apply
@@ -137,20 +234,31 @@ namespace TagsSearch
 		}
 		else
 		{
-			this->_trims_counter.inc(TrimsCounter::NO_TRIM);
+			trims_counter.inc(TrimsCounter::NO_TRIM);
 		}
 	}
 
-	const TagsFinderBase::s_counter_t& TagsFinderBase::num_reads_per_cb() const
+	size_t TagsFinderBase::outputs_num() const
+	{
+		return this->_outputs.size();
+	}
+
+	const std::string& TagsFinderBase::output_name(size_t output_ind) const
 	{
-		return this->_num_reads_per_cb;
+		return this->_outputs.at(output_ind).fastq_writer->base_filename();
+	}
+
+	const TagsFinderBase::s_counter_t& TagsFinderBase::num_reads_per_cb(size_t output_ind) const
+	{
+		return this->_outputs.at(output_ind).num_reads_per_cb;
 	}
 
 	std::string TagsFinderBase::get_file_uid(long random_seed)
 	{
 		if (random_seed < 0)
 		{
-			random_seed = time(nullptr);
+			// Runs, which are started at the same time (e.g. for several lanes), must get different uids
+			random_seed = long(std::random_device()() & 0x7fffffff);
 		}
 
 		srand(unsigned(random_seed));
@@ -164,110 +272,302 @@ namespace TagsSearch
 		return res;
 	}
 
-	void TagsFinderBase::read_bunch(size_t number_of_iterations, size_t records_bunch_size)
+	void TagsFinderBase::init_counters(size_t threads_num)
 	{
-		for (size_t i = 0; i < number_of_iterations; ++i)
+		this->_trims_counters.assign(threads_num, TrimsCounter());
+		this->_parsing_metrics.assign(threads_num, ParsingMetrics());
+		this->_corrections_counters.assign(threads_num, CorrectionsCounter());
+		for (auto &output : this->_outputs)
 		{
-			if (this->_file_ended)
-				break;
+			output.num_reads_per_cb_by_thread.assign(threads_num, ReadsPerCbCounter());
+			output.written_reads_by_thread.assign(threads_num, 0);
+		}
+	}
 
-			std::string records_bunch, params_bunch;
-			unsigned record_id;
-			for (record_id = 0; record_id < records_bunch_size; ++record_id)
+	bool TagsFinderBase::read_bunch(batches_t &batches, long &first_read_number)
+	{
+		batches.resize(this->_fastq_readers.size());
+		if (!this->_fastq_readers[0]->get_next_batch(batches[0]))
+			return false;
+
+		size_t records_num = batches[0].records.size();
+		for (size_t file_id = 1; file_id < this->_fastq_readers.size(); ++file_id)
+		{
+			if (!this->_fastq_readers[file_id]->get_next_batch(batches[file_id]) || batches[file_id].records.size() < records_num)
+				throw std::runtime_error("File '" + this->_fastq_readers[file_id]->filename() + "', read '" +
+				                         batches[0].records.back().id.to_string() + "': fastq ended prematurely!");
+		}
+
+		first_read_number = this->_total_reads_read;
+		this->_total_reads_read += records_num;
+
+		if (first_read_number / 5000000 != this->_total_reads_read / 5000000)
+		{
+			L_TRACE << "Total " << this->_total_reads_read << " read (" << this->_parsed_reads << " parsed, "
+			        << (this->_parsed_reads - this->_low_quality_reads) << " passed quality threshold)";
+		}
+
+		return true;
+	}
+
+	void TagsFinderBase::parse_bunch(batches_t &batches, long first_read_number, size_t bunch_id, size_t thread_ind)
+	{
+		PipelineMetrics::ScopedTimer timer(this->_parsing_metrics[thread_ind].busy_time);
+		if (this->_parsing_metrics[thread_ind].records != nullptr)
+		{
+			*this->_parsing_metrics[thread_ind].records += batches[0].records.size();
+		}
+
+		const size_t outputs_num = this->_outputs.size();
+		std::vector<std::string> records_bunches(outputs_num), params_bunches(outputs_num);
+		std::vector<Tools::BinaryReadParams::BlockBuilder> params_blocks(this->_binary_params ? outputs_num : 0);
+		std::vector<unsigned> records_nums(outputs_num, 0);
+		std::string record_id;
+		records_t records(batches.size());
+		Tools::PackedReadParameters params; // Views into the batches, so it's used only before they are released
+		for (size_t i = 0; i < batches[0].records.size(); ++i)
+		{
+			for (size_t file_id = 0; file_id < batches.size(); ++file_id)
 			{
-				if (this->_file_ended)
-					break;
+				records[file_id] = batches[file_id].records[i];
+			}
 
-				FastQReader::FastQRecord record;
-				Tools::ReadParameters params;
-				if (!this->get_next_record(record, params))
-				{
-					record_id--;
-					continue;
-				}
+			FastQReader::FastQRecord record;
+			size_t output_ind = this->get_next_record(records, first_read_number + i + 1, record, record_id, params, thread_ind);
+			if (output_ind == SKIP_READ)
+				continue;
 
-				records_bunch += record.to_string();
-				params_bunch += params.to_string(record.id) + "\n";
+			if (this->_bam_output)
+			{
+				UnalignedBamEncoder::append_record(record, params, records_bunches[output_ind]);
+			}
+			else
+			{
+				record.append_to(records_bunches[output_ind]);
 			}
 
-			if (!records_bunch.empty())
+			if (this->_save_read_params && this->_binary_params)
+			{
+				params_blocks[output_ind].add(first_read_number + i + 1, params);
+			}
+			else if (this->_save_read_params)
 			{
-				this->_fastq_writer->enqueue_lines(records_bunch, record_id);
+				params.append_to(params_bunches[output_ind], record_id);
+				params_bunches[output_ind] += '\n';
+			}
+			++records_nums[output_ind];
+		}
 
-				if (this->_save_read_params)
+		for (size_t file_id = 0; file_id < batches.size(); ++file_id)
+		{
+			this->_fastq_readers[file_id]->release_batch(std::move(batches[file_id]));
+		}
+
+		// Empty bunches are enqueued too, as writers expect all ids
+		for (size_t output_ind = 0; output_ind < outputs_num; ++output_ind)
+		{
+			auto &output = this->_outputs[output_ind];
+			output.written_reads_by_thread[thread_ind] += records_nums[output_ind];
+			output.fastq_writer->enqueue_lines(std::move(records_bunches[output_ind]), records_nums[output_ind], bunch_id);
+
+			if (this->_save_read_params)
+			{
+				if (this->_binary_params)
 				{
-					this->_params_writer->enqueue_lines(params_bunch, record_id);
+					params_blocks[output_ind].append_to(params_bunches[output_ind]);
 				}
+				output.params_writer->enqueue_lines(std::move(params_bunches[output_ind]), records_nums[output_ind], bunch_id);
 			}
 		}
 	}
 
-	void TagsFinderBase::run_thread()
+	void TagsFinderBase::set_error(const std::exception_ptr &error, bunches_queue_t &bunches)
 	{
-		while (true)
 		{
-			if (this->_file_ended && this->_fastq_writer->empty())
-				break;
+			std::lock_guard<std::mutex> lock(this->_error_mutex);
+			if (!this->_error)
+			{
+				this->_error = error;
+			}
+		}
 
-			// Part 0. Multithreaded.
-			for (auto &reader : this->_fastq_readers)
+		bunches.close();
+		for (auto &output : this->_outputs)
+		{
+			output.fastq_writer->stop();
+			if (this->_save_read_params)
 			{
-				reader->try_read_records_to_cash();
+				output.params_writer->stop();
 			}
+		}
+	}
 
-			// Part 1. Single thread.
-			if (!this->_file_ended)
+	void TagsFinderBase::run_reading(bunches_queue_t &bunches, size_t max_bunches_in_progress)
+	{
+		try
+		{
+			for (size_t bunch_id = 0; ; ++bunch_id)
 			{
-				if (!this->_reading_in_progress.exchange(true))
+				// Limits the number of bunches, which wait in reorder buffers of the writers
+				if (bunch_id >= max_bunches_in_progress)
 				{
-					this->read_bunch();
-					if (this->_file_ended)
+					PipelineMetrics::ScopedTimer timer(this->_reading_wait_time);
+					for (auto &output : this->_outputs)
 					{
-						L_TRACE << this->results_to_string();
-						Tools::trace_time("Reading completed");
-						L_TRACE << "Writing the rest lines";
+						output.fastq_writer->wait_written(bunch_id - max_bunches_in_progress);
+						if (this->_save_read_params)
+						{
+							output.params_writer->wait_written(bunch_id - max_bunches_in_progress);
+						}
 					}
-
-					this->_reading_in_progress = false;
 				}
+
+				RecordsBunch bunch;
+				bunch.id = bunch_id;
+				if (!this->read_bunch(bunch.batches, bunch.first_read_number))
+					break;
+
+				PipelineMetrics::ScopedTimer timer(this->_reading_wait_time);
+				if (!bunches.push_wait(std::move(bunch)))
+					break;
 			}
+		}
+		catch (...)
+		{
+			this->set_error(std::current_exception(), bunches);
+		}
 
-			// Part 2.1. Multithreaded.
-			this->_fastq_writer->flush_gzip(this->_file_ended);
+		bunches.close();
+	}
 
-			// Part 2.2. Multithreaded.
-			if (this->_save_read_params)
+	void TagsFinderBase::run_parsing(bunches_queue_t &bunches, size_t thread_ind)
+	{
+		try
+		{
+			RecordsBunch bunch;
+			while (true)
 			{
-				this->_params_writer->flush_gzip(_file_ended);
+				{
+					PipelineMetrics::ScopedTimer timer(this->_parsing_metrics[thread_ind].idle_time);
+					if (!bunches.pop_wait(bunch))
+						break;
+				}
+
+				this->parse_bunch(bunch.batches, bunch.first_read_number, bunch.id, thread_ind);
 			}
+		}
+		catch (...)
+		{
+			this->set_error(std::current_exception(), bunches);
+		}
+	}
 
-			// Part 3.1. Single thread.
-			this->_fastq_writer->flush_write();
+	void TagsFinderBase::set_metrics(const std::shared_ptr<PipelineMetrics> &metrics)
+	{
+		this->_metrics = metrics;
+	}
 
-			// Part 3.2. Single thread.
+	void TagsFinderBase::add_metrics(bunches_queue_t &bunches, size_t parsing_threads_num)
+	{
+		auto &metrics = *this->_metrics;
+		for (auto &reader : this->_fastq_readers)
+		{
+			reader->add_metrics(metrics, "read:" + reader->filename());
+		}
+
+		this->_reading_wait_time = metrics.counter("read", "wait_ns"); // Waiting for parsing or writing
+		metrics.add_gauge("read", "bunches_queue", [&bunches]{ return bunches.size(); });
+
+		for (size_t thread_ind = 0; thread_ind < parsing_threads_num; ++thread_ind)
+		{
+			const std::string stage = "parse:" + std::to_string(thread_ind);
+			auto &thread_metrics = this->_parsing_metrics.at(thread_ind);
+			thread_metrics.records = metrics.counter(stage, "records");
+			thread_metrics.parse_time = metrics.counter(stage, "parse_ns");
+			thread_metrics.busy_time = metrics.counter(stage, "busy_ns");
+			thread_metrics.idle_time = metrics.counter(stage, "idle_ns");
+		}
+
+		for (auto &output : this->_outputs)
+		{
+			output.fastq_writer->add_metrics(metrics, "write:" + output.fastq_writer->base_filename());
 			if (this->_save_read_params)
 			{
-				this->_params_writer->flush_write();
+				output.params_writer->add_metrics(metrics, "write:" + output.fastq_writer->base_filename() + ".params");
 			}
 		}
 	}
 
 	void TagsFinderBase::run(int number_of_threads)
 	{
-		std::vector<std::thread> tasks;
-		for (int thread_num = 0; thread_num < number_of_threads; ++thread_num)
+		size_t threads_num = size_t(std::max(number_of_threads, 1));
+		size_t parsing_threads_num = (this->_parsing_threads_num != 0) ? this->_parsing_threads_num : threads_num;
+		size_t compression_threads_num = (this->_compression_threads_num != 0) ? this->_compression_threads_num : threads_num;
+
+		this->init_counters(parsing_threads_num);
+
+		bunches_queue_t bunches(2 * parsing_threads_num);
+		if (this->_metrics != nullptr)
 		{
-			tasks.emplace_back([this]{this->run_thread();});
+			this->add_metrics(bunches, parsing_threads_num);
 		}
 
-		for (auto &task : tasks)
+		// read -> parse -> compress -> write
+		size_t writers_num = this->_outputs.size() * (this->_save_read_params ? 2 : 1);
+		for (auto &output : this->_outputs)
 		{
-			task.join();
+			output.fastq_writer->start(compression_threads_num, this->_max_memory / writers_num);
+			if (this->_save_read_params)
+			{
+				output.params_writer->start(compression_threads_num, this->_max_memory / writers_num);
+			}
 		}
-	}
 
-	FastQReader &TagsFinderBase::fastq_reader(size_t index)
-	{
-		return *this->_fastq_readers.at(index);
+		if (this->_metrics != nullptr)
+		{
+			this->_metrics->start();
+		}
+
+		std::thread reading_thread([this, &bunches, parsing_threads_num]{ this->run_reading(bunches, 4 * parsing_threads_num); });
+
+		std::vector<std::thread> parsing_threads;
+		for (size_t thread_ind = 0; thread_ind < parsing_threads_num; ++thread_ind)
+		{
+			parsing_threads.emplace_back([this, &bunches, thread_ind]{ this->run_parsing(bunches, thread_ind); });
+		}
+
+		reading_thread.join();
+		for (auto &thread : parsing_threads)
+		{
+			thread.join();
+		}
+
+		for (auto &output : this->_outputs)
+		{
+			output.fastq_writer->finish();
+			if (this->_save_read_params)
+			{
+				output.params_writer->finish();
+			}
+		}
+
+		if (this->_metrics != nullptr)
+		{
+			this->_metrics->finish();
+		}
+
+		if (this->_error)
+			std::rethrow_exception(this->_error);
+
+		if (this->_save_stats)
+		{
+			for (auto &output : this->_outputs)
+			{
+				TagsFinderBase::merge_counters(output.num_reads_per_cb_by_thread).add_to(output.num_reads_per_cb);
+			}
+		}
+
+		L_TRACE << this->results_to_string();
+		Tools::trace_time("Reading completed");
 	}
 }
@@ -1,13 +1,21 @@
 #pragma once
 
+#include "CellBarcodesCorrector.h"
+#include "Counters/CorrectionsCounter.h"
+#include "Counters/ReadsPerCbCounter.h"
 #include "Counters/TrimsCounter.h"
 #include "FastQReader.h"
+#include "PipelineMetrics.h"
 #include "SpacerFinder.h"
+#include "UnalignedBamEncoder.h"
+#include "Tools/BinaryReadParams.h"
+#include "Tools/PackedReadParameters.h"
 #include "Tools/UtilFunctions.h"
-#include <Tools/ScSpConcurrentQueue.h>
 #include <Tools/BlockingConcurrentQueue.h>
 #include "ConcurrentGzWriter.h"
 
+#include <exception>
+#include <mutex>
 #include <string>
 
 #include <boost/property_tree/ptree.hpp>
@@ -18,11 +26,6 @@ namespace TestTagsSearch
 	struct test1;
 }
 
-namespace Tools
-{
-	class ReadParameters;
-}
-
 namespace TagsSearch
 {
 	class TagsFinderBase
@@ -30,57 +33,126 @@ namespace TagsSearch
 		friend struct TestTagsSearch::test1;
 
 	public:
-		using s_counter_t = std::unordered_map<std::string, int>;
+		using s_counter_t = ReadsPerCbCounter::s_counter_t;
 
 	protected:
 		using len_t = std::string::size_type;
+		using records_t = std::vector<FastQReader::FastQRecord>; // Aligned records, one per input file
+		using batches_t = std::vector<FastQReader::RecordsBatch>; // Aligned batches, one per input file
+
+		static const size_t SKIP_READ = size_t(-1);
+
+	private:
+		struct RecordsBunch
+		{
+			batches_t batches;
+			long first_read_number;
+			size_t id;
+		};
+
+		using bunches_queue_t = Tools::BlockingConcurrentQueue<RecordsBunch>;
+
+		struct Output
+		{
+			std::shared_ptr<ConcurrentGzWriter> fastq_writer;
+			std::shared_ptr<ConcurrentGzWriter> params_writer;
+			std::vector<ReadsPerCbCounter> num_reads_per_cb_by_thread;
+			std::vector<long> written_reads_by_thread;
+			s_counter_t num_reads_per_cb;
+		};
+
+		// Null if metrics aren't collected
+		struct ParsingMetrics
+		{
+			PipelineMetrics::counter_t *records = nullptr;
+			PipelineMetrics::counter_t *parse_time = nullptr; // Time of parse_fastq_record
+			PipelineMetrics::counter_t *busy_time = nullptr;
+			PipelineMetrics::counter_t *idle_time = nullptr;
+		};
 
 	private:
 		const bool _save_stats;
 		const bool _save_read_params;
+		const bool _bam_output;
+		const bool _binary_params;
 		const std::string _file_uid;
 
 		std::atomic<long> _total_reads_read;
 		std::atomic<long> _low_quality_reads;
 		std::atomic<long> _parsed_reads;
-		std::atomic<bool> _file_ended;
 
-		std::atomic<bool> _reading_in_progress;
+		const size_t _parsing_threads_num;
+		const size_t _compression_threads_num;
+		const size_t _max_memory;
+
+		std::mutex _error_mutex;
+		std::exception_ptr _error;
 
-		const std::shared_ptr<ConcurrentGzWriter> _fastq_writer;
-		std::shared_ptr<ConcurrentGzWriter> _params_writer;
+		std::vector<Output> _outputs;
 		std::vector<std::shared_ptr<FastQReader>> _fastq_readers;
-		s_counter_t _num_reads_per_cb;
+		std::shared_ptr<CellBarcodesCorrector> _barcodes_corrector;
+		std::vector<CorrectionsCounter> _corrections_counters; // One counter per parsing thread
+		char _poly_a_base; // Set if poly_a is a homopolymer, which allows vectorized search. Otherwise, 0
+
+		std::shared_ptr<PipelineMetrics> _metrics;
+		std::vector<ParsingMetrics> _parsing_metrics; // One per parsing thread
+		PipelineMetrics::counter_t *_reading_wait_time;
 
 	protected:
 		const unsigned _min_read_len;
 		const int _quality_threshold;
 		const std::string poly_a;
-		const Tools::ReverseComplement rc;
-
-		TrimsCounter _trims_counter;
 
+		std::vector<TrimsCounter> _trims_counters; // One counter per parsing thread
 	private:
 		static std::string get_file_uid(long random_seed = -1);
 
-		bool get_next_record(FastQReader::FastQRecord& record, Tools::ReadParameters &params);
+		bool read_bunch(batches_t &batches, long &first_read_number);
+		void parse_bunch(batches_t &batches, long first_read_number, size_t bunch_id, size_t thread_ind);
+		void correct_cell_barcode(Tools::PackedReadParameters &params, size_t thread_ind);
+		size_t get_next_record(records_t &records, long read_number, FastQReader::FastQRecord &record,
+		                       std::string &record_id, Tools::PackedReadParameters &params, size_t thread_ind);
 
-		void read_bunch(size_t number_of_iterations = 10000, size_t records_bunch_size = 5000);
-		void run_thread();
+		void run_reading(bunches_queue_t &bunches, size_t max_bunches_in_progress);
+		void run_parsing(bunches_queue_t &bunches, size_t thread_ind);
+		void set_error(const std::exception_ptr &error, bunches_queue_t &bunches);
+		void add_metrics(bunches_queue_t &bunches, size_t parsing_threads_num);
 
 	protected:
-		virtual bool parse_fastq_record(FastQReader::FastQRecord &record, Tools::ReadParameters &read_params) = 0;
-		void trim(const std::string &barcodes_tail, std::string &sequence, std::string &quality);
+		virtual void parse_fastq_record(records_t &records, FastQReader::FastQRecord &gene_record,
+		                                Tools::PackedReadParameters &read_params, size_t thread_ind) = 0;
+		virtual void init_counters(size_t threads_num);
+		virtual size_t select_output(const records_t &records, size_t thread_ind); // Index of the output or SKIP_READ
+
+		size_t add_output(const std::shared_ptr<ConcurrentGzWriter> &writer);
+
+		void trim(const boost::string_ref &barcodes_tail, boost::string_ref &sequence, boost::string_ref &quality,
+		          size_t thread_ind = 0);
+		void trim(const std::string &barcodes_tail, std::string &sequence, std::string &quality, size_t thread_ind = 0);
 		virtual std::string get_additional_stat(long total_reads_read) const = 0;
-		FastQReader& fastq_reader(size_t index);
+
+		template<typename T>
+		static T merge_counters(const std::vector<T> &counters)
+		{
+			T res(counters.at(0));
+			for (size_t i = 1; i < counters.size(); ++i)
+			{
+				res.merge(counters[i]);
+			}
+
+			return res;
+		}
 
 	public:
 		TagsFinderBase(const std::vector<std::string> &fastq_filenames,
 		               const boost::property_tree::ptree &processing_config, const std::shared_ptr<ConcurrentGzWriter> &writer,
 		               bool save_stats, bool save_read_params);
 
+		void set_metrics(const std::shared_ptr<PipelineMetrics> &metrics); // Metrics are collected and written during run()
 		void run(int number_of_threads);
-		const s_counter_t& num_reads_per_cb() const;
+		size_t outputs_num() const;
+		const std::string& output_name(size_t output_ind = 0) const;
+		const s_counter_t& num_reads_per_cb(size_t output_ind = 0) const;
 		std::string results_to_string() const;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "UnalignedBamEncoder.h"
+
+#include <stdexcept>
+
+namespace TagsSearch
+{
+	const uint16_t UnalignedBamEncoder::unmapped_bin;
+	const uint16_t UnalignedBamEncoder::unmapped_flag;
+
+	std::string UnalignedBamEncoder::header()
+	{
+		std::string text = "@HD\tVN:1.6\tSO:unsorted\n@PG\tID:droptag\tPN:droptag\tVN:" + std::string(VERSION) + "\n";
+
+		std::string res = "BAM\1";
+		UnalignedBamEncoder::append_value(int32_t(text.length()), res);
+		res += text;
+		UnalignedBamEncoder::append_value(int32_t(0), res); // No references
+		return res;
+	}
+
+	void UnalignedBamEncoder::append_record(const FastQReader::FastQRecord &record,
+	                                        const Tools::PackedReadParameters &params, std::string &out)
+	{
+		boost::string_ref name = record.id;
+		if (!name.empty() && name[0] == '@')
+		{
+			name.remove_prefix(1);
+		}
+		name = name.substr(0, name.find(' '));
+
+		if (name.length() > 254)
+			throw std::runtime_error("Read name is too long for BAM: '" + name.to_string() + "'");
+
+		if (record.sequence.length() != record.quality.length())
+			throw std::runtime_error("Read has different lengths of sequence and quality string: '" +
+			                         record.sequence.to_string() + "', '" + record.quality.to_string() + "'");
+
+		size_t block_start = out.size();
+		UnalignedBamEncoder::append_value(int32_t(0), out); // Block size, which is filled at the end
+		UnalignedBamEncoder::append_value(int32_t(-1), out); // refID
+		UnalignedBamEncoder::append_value(int32_t(-1), out); // pos
+		UnalignedBamEncoder::append_value(uint8_t(name.length() + 1), out);
+		UnalignedBamEncoder::append_value(uint8_t(0), out); // MAPQ
+		UnalignedBamEncoder::append_value(UnalignedBamEncoder::unmapped_bin, out);
+		UnalignedBamEncoder::append_value(uint16_t(0), out); // n_cigar_op
+		UnalignedBamEncoder::append_value(UnalignedBamEncoder::unmapped_flag, out);
+		UnalignedBamEncoder::append_value(int32_t(record.sequence.length()), out);
+		UnalignedBamEncoder::append_value(int32_t(-1), out); // next_refID
+		UnalignedBamEncoder::append_value(int32_t(-1), out); // next_pos
+		UnalignedBamEncoder::append_value(int32_t(0), out); // tlen
+
+		out.append(name.data(), name.length()).push_back('\0');
+		UnalignedBamEncoder::append_sequence(record.sequence, out);
+		for (char qual : record.quality)
+		{
+			out.push_back(char(qual - Tools::ReadParameters::quality_offset));
+		}
+
+		UnalignedBamEncoder::append_string_tag("CB", params.cell_barcode().sequence(), out);
+		UnalignedBamEncoder::append_string_tag("UB", params.umi().sequence(), out);
+		UnalignedBamEncoder::append_string_tag("CY", params.cell_barcode().quality(), out);
+		UnalignedBamEncoder::append_string_tag("UY", params.umi().quality(), out);
+		if (!params.raw_cell_barcode().empty())
+		{
+			UnalignedBamEncoder::append_string_tag("CR", params.raw_cell_barcode(), out);
+		}
+
+		int32_t block_size = int32_t(out.size() - block_start - sizeof(int32_t));
+		out.replace(block_start, sizeof(block_size), reinterpret_cast<const char*>(&block_size), sizeof(block_size));
+	}
+
+	void UnalignedBamEncoder::append_string_tag(const char *tag, const std::string &value, std::string &out)
+	{
+		out.append(tag, 2);
+		out.push_back('Z');
+		out += value;
+		out.push_back('\0');
+	}
+
+	int UnalignedBamEncoder::base_code(char base)
+	{
+		switch (base)
+		{
+			case 'A': return 1;
+			case 'C': return 2;
+			case 'G': return 4;
+			case 'T': return 8;
+			default: return 15; // N
+		}
+	}
+
+	void UnalignedBamEncoder::append_sequence(const boost::string_ref &sequence, std::string &out)
+	{
+		for (size_t i = 0; i < sequence.length(); i += 2)
+		{
+			int high = UnalignedBamEncoder::base_code(sequence[i]);
+			int low = (i + 1 < sequence.length()) ? UnalignedBamEncoder::base_code(sequence[i + 1]) : 0;
+			out.push_back(char((high << 4) | low));
+		}
+	}
+}
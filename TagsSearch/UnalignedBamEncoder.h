@@ -0,0 +1,35 @@
+#pragma once
+
+#include "FastQReader.h"
+
+#include <Tools/PackedReadParameters.h>
+
+#include <string>
+
+namespace TagsSearch
+{
+	// Encodes reads as unaligned BAM records. Cell barcode and UMI are stored in the standard CB/UB tags,
+	// their qualities in CY/UY. If the cell barcode was corrected, the raw one is stored in CR.
+	class UnalignedBamEncoder
+	{
+	private:
+		static const uint16_t unmapped_bin = 4680; // reg2bin(-1, 0)
+		static const uint16_t unmapped_flag = 4;
+
+	private:
+		template<typename T>
+		static void append_value(T value, std::string &out)
+		{
+			out.append(reinterpret_cast<const char*>(&value), sizeof(value)); // BAM is little-endian, as the supported platforms
+		}
+
+		static int base_code(char base);
+		static void append_string_tag(const char *tag, const std::string &value, std::string &out);
+		static void append_sequence(const boost::string_ref &sequence, std::string &out);
+
+	public:
+		static std::string header(); // Must be written at the beginning of each file
+		static void append_record(const FastQReader::FastQRecord &record, const Tools::PackedReadParameters &params,
+		                          std::string &out);
+	};
+}
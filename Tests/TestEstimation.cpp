@@ -9,6 +9,9 @@
 #include <Estimation/BamProcessing/ReadParamsParser.h>
 #include <Estimation/BamProcessing/BamController.h>
 #include <Estimation/BamProcessing/BamProcessor.h>
+#include <Estimation/BamProcessing/FilledBamParamsParser.h>
+#include <Estimation/BamProcessing/ParallelBamReader.h>
+#include <Estimation/BamProcessing/ReadMapParamsParser.h>
 #include <Estimation/Merge/BarcodesParsing/InDropBarcodesParser.h>
 #include <Estimation/Merge/BarcodesParsing/ConstLengthBarcodesParser.h>
 #include <Estimation/Merge/MergeStrategyFactory.h>
@@ -17,10 +20,25 @@
 #include <Estimation/Merge/UMIs/MergeUMIsStrategySimple.h>
 #include <Estimation/Merge/UMIs/MergeUMIsStrategyDirectional.h>
 
+#include <Tools/BinaryReadParams.h>
+#include <Tools/GzCompressor.h>
 #include <Tools/Logs.h>
 #include <Tools/IndexedValue.h>
 #include <Tools/UtilFunctions.h>
 
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+
+#include <api/BamReader.h>
+#include <api/BamWriter.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <sstream>
+
 using namespace Estimation;
 using Mark = UMI::Mark;
 
@@ -30,6 +48,303 @@ static ReadInfo read_info(const std::string &cell_barcode, const std::string &um
 	return ReadInfo(Tools::ReadParameters(cell_barcode, umi, "", umi, 0), gene, chr_name, mark);
 }
 
+// Writes a params.gz file, as droptag does. Parameters of each read are ('<cb>', '<umi>')
+static void write_read_params(const std::string &filename,
+                              const std::vector<std::pair<std::string, std::pair<std::string, std::string>>> &reads)
+{
+	std::ofstream gz_out(filename, std::ios_base::out | std::ios_base::binary);
+	boost::iostreams::filtering_ostream out;
+	out.push(boost::iostreams::gzip_compressor());
+	out.push(gz_out);
+
+	for (auto const &read : reads)
+	{
+		out << Tools::ReadParameters(read.second.first, read.second.second, std::string(read.second.first.size(), 'I'),
+		                             std::string(read.second.second.size(), 'I'), 0).to_string(read.first) << "\n";
+	}
+}
+
+// Writes a params.bin file of reads '<prefix><number>'
+static void write_binary_read_params(const std::string &filename, const std::string &prefix,
+                                     const std::vector<std::pair<long, std::pair<std::string, std::string>>> &reads)
+{
+	Tools::BinaryReadParams::BlockBuilder block;
+	for (auto const &read : reads)
+	{
+		Tools::PackedReadParameters params;
+		params.cell_barcode().append(read.second.first, std::string(read.second.first.size(), 'I'));
+		params.umi().append(read.second.second, std::string(read.second.second.size(), 'I'));
+		params.complete(0);
+		block.add(read.first, params);
+	}
+
+	std::string content = Tools::BinaryReadParams::file_header(prefix), compressed;
+	block.append_to(content);
+	Tools::GzCompressor(Z_DEFAULT_COMPRESSION, true).compress(content, compressed);
+	compressed += Tools::GzCompressor::bgzf_eof;
+	std::ofstream(filename, std::ios_base::out | std::ios_base::binary) << compressed;
+}
+
+static bool get_read_params(BamProcessing::ReadParamsParser &parser, const std::string &read_name,
+                            Tools::ReadParameters &read_params)
+{
+	BamTools::BamAlignment alignment;
+	alignment.Name = read_name;
+	return parser.get_read_params(alignment, read_params);
+}
+
+// Alignments with pseudo-random fields. Some of them are unmapped, secondary, without sequence or qualities.
+static std::vector<BamTools::BamAlignment> random_alignments(size_t alignments_num, const BamTools::RefVector &references,
+                                                             bool sorted)
+{
+	const std::vector<std::vector<BamTools::CigarOp>> cigars = {
+			{{'M', 40}}, {{'S', 5}, {'M', 30}, {'I', 2}, {'M', 3}}, {{'M', 10}, {'N', 500}, {'M', 25}, {'D', 5}, {'M', 5}},
+			{{'H', 3}, {'M', 20}, {'P', 1}, {'=', 2}, {'X', 3}, {'M', 15}}, {}};
+	const std::string bases = "ACGTN";
+
+	unsigned long state = 42;
+	auto next_rand = [&state]() {
+		state = state * 6364136223846793005ul + 1442695040888963407ul;
+		return size_t(state >> 33);
+	};
+
+	std::vector<BamTools::BamAlignment> alignments;
+	for (size_t i = 0; i < alignments_num; ++i)
+	{
+		BamTools::BamAlignment alignment;
+		alignment.Name = "read" + std::to_string(i);
+		alignment.RefID = (i % 50 == 0) ? -1 : int32_t(next_rand() % references.size());
+		alignment.Position = (alignment.RefID < 0) ? -1 : int32_t(next_rand() % (references[alignment.RefID].RefLength - 1000));
+		alignment.MapQuality = uint16_t(next_rand() % 256);
+		alignment.AlignmentFlag = ((i % 7 == 0 || alignment.RefID < 0) ? 0x4 : 0) | ((i % 11 == 0) ? 0x100 : 0) |
+				((i % 3 == 0) ? 0x10 : 0);
+		alignment.MateRefID = alignment.RefID;
+		alignment.MatePosition = alignment.Position + 100;
+		alignment.InsertSize = int32_t(i % 300) - 150;
+		alignment.CigarData = cigars[i % cigars.size()];
+
+		size_t query_length = 0;
+		for (auto const &op : alignment.CigarData)
+		{
+			if (std::string("MIS=X").find(op.Type) != std::string::npos)
+			{
+				query_length += op.Length;
+			}
+		}
+
+		if (i % 17 == 0) // SEQ and QUAL are '*'
+		{
+			query_length = 0;
+		}
+		else if (query_length == 0)
+		{
+			query_length = 30;
+		}
+
+		for (size_t pos = 0; pos < query_length; ++pos)
+		{
+			alignment.QueryBases += bases[next_rand() % bases.size()];
+			alignment.Qualities += char(33 + next_rand() % 41);
+		}
+
+		if (i % 13 == 0 && query_length > 0) // QUAL is '*'
+		{
+			alignment.Qualities = "*";
+		}
+
+		alignment.Length = int32_t(query_length);
+		if (i % 5 != 0)
+		{
+			alignment.AddTag("CB", "Z", alignment.QueryBases.substr(0, 8));
+			alignment.AddTag("NM", "i", int32_t(i % 5));
+		}
+
+		alignments.push_back(alignment);
+	}
+
+	if (sorted) // Reads without coordinates are in the end
+	{
+		std::stable_sort(alignments.begin(), alignments.end(),
+		                 [](const BamTools::BamAlignment &a1, const BamTools::BamAlignment &a2) {
+			                 return std::make_pair(uint32_t(a1.RefID), a1.Position) <
+			                        std::make_pair(uint32_t(a2.RefID), a2.Position);
+		                 });
+	}
+
+	return alignments;
+}
+
+static void write_bam(const std::string &filename, const BamTools::RefVector &references,
+                      const std::vector<BamTools::BamAlignment> &alignments, bool sorted)
+{
+	std::string header = std::string("@HD\tVN:1.4\tSO:") + (sorted ? "coordinate" : "unsorted") + "\n";
+	for (auto const &reference : references)
+	{
+		header += "@SQ\tSN:" + reference.RefName + "\tLN:" + std::to_string(reference.RefLength) + "\n";
+	}
+
+	BamTools::BamWriter writer;
+	BOOST_REQUIRE(writer.Open(filename, header, references));
+	for (auto const &alignment : alignments)
+	{
+		writer.SaveAlignment(alignment);
+	}
+	writer.Close();
+}
+
+// Fields, which aren't decoded, must be empty
+static void check_alignment_fields(const BamTools::BamAlignment &expected, const BamTools::BamAlignment &actual,
+                                   int fields)
+{
+	using BamProcessing::ParallelBamReader;
+	BOOST_CHECK_EQUAL(actual.RefID, expected.RefID);
+	BOOST_CHECK_EQUAL(actual.Position, expected.Position);
+	BOOST_CHECK_EQUAL(actual.Bin, expected.Bin);
+	BOOST_CHECK_EQUAL(actual.MapQuality, expected.MapQuality);
+	BOOST_CHECK_EQUAL(actual.AlignmentFlag, expected.AlignmentFlag);
+	BOOST_CHECK_EQUAL(actual.Length, expected.Length);
+	BOOST_CHECK_EQUAL(actual.MateRefID, expected.MateRefID);
+	BOOST_CHECK_EQUAL(actual.MatePosition, expected.MatePosition);
+	BOOST_CHECK_EQUAL(actual.InsertSize, expected.InsertSize);
+	BOOST_CHECK_EQUAL(actual.Filename, expected.Filename);
+
+	BOOST_CHECK_EQUAL(actual.Name, (fields & ParallelBamReader::NAME) ? expected.Name : "");
+	BOOST_CHECK_EQUAL(actual.QueryBases, (fields & ParallelBamReader::BASES) ? expected.QueryBases : "");
+	BOOST_CHECK_EQUAL(actual.AlignedBases, (fields & ParallelBamReader::BASES) ? expected.AlignedBases : "");
+	BOOST_CHECK_EQUAL(actual.Qualities, (fields & ParallelBamReader::QUALITIES) ? expected.Qualities : "");
+	BOOST_CHECK_EQUAL(actual.TagData, (fields & ParallelBamReader::TAGS) ? expected.TagData : "");
+
+	if (fields & (ParallelBamReader::CIGAR | ParallelBamReader::BASES))
+	{
+		BOOST_REQUIRE_EQUAL(actual.CigarData.size(), expected.CigarData.size());
+		for (size_t i = 0; i < actual.CigarData.size(); ++i)
+		{
+			BOOST_CHECK_EQUAL(actual.CigarData[i].Type, expected.CigarData[i].Type);
+			BOOST_CHECK_EQUAL(actual.CigarData[i].Length, expected.CigarData[i].Length);
+		}
+	}
+	else
+	{
+		BOOST_CHECK(actual.CigarData.empty());
+	}
+}
+
+// Alignments near the genes of gtf_test.gtf.gz (chrY isn't there). Names are encoded read parameters, and tags have
+// the parameters, genes and read types of a filled BAM file.
+static std::vector<BamTools::BamAlignment> annotated_alignments(size_t alignments_num, const BamTools::RefVector &references)
+{
+	const std::map<std::string, std::vector<int32_t>> gene_bounds = {
+			{"chr1", {11874, 14362, 17615, 24738, 34611, 35277, 69091, 70005}}, {"chr2", {34609, 100000, 110000, 120000}},
+			{"chrX", {34609, 100000, 110000}}, {"chrY", {1000}}};
+	const std::vector<std::vector<BamTools::CigarOp>> cigars = {
+			{{'M', 40}}, {{'M', 10}, {'N', 500}, {'M', 25}}, {{'S', 5}, {'M', 30}, {'D', 300}, {'M', 5}},
+			{{'M', 20}, {'N', 2000}, {'M', 20}}, {}};
+	const std::vector<std::string> read_types = {"EXONIC", "INTRONIC", "INTERGENIC", ""};
+	const std::string bases = "ACGT";
+
+	unsigned long state = 17;
+	auto next_rand = [&state]() {
+		state = state * 6364136223846793005ul + 1442695040888963407ul;
+		return size_t(state >> 33);
+	};
+
+	std::vector<BamTools::BamAlignment> alignments;
+	for (size_t i = 0; i < alignments_num; ++i)
+	{
+		BamTools::BamAlignment alignment;
+		alignment.RefID = (i % 101 == 0) ? -1 : int32_t(next_rand() % references.size());
+		if (alignment.RefID >= 0)
+		{
+			auto const &bounds = gene_bounds.at(references[alignment.RefID].RefName);
+			alignment.Position = std::max(int32_t(bounds[next_rand() % bounds.size()] + next_rand() % 1200) - 600, 0);
+		}
+		else
+		{
+			alignment.Position = -1;
+		}
+
+		alignment.MapQuality = 255;
+		alignment.AlignmentFlag = ((i % 19 == 0 || alignment.RefID < 0) ? 0x4 : 0) | ((i % 23 == 0) ? 0x100 : 0);
+		alignment.MateRefID = -1;
+		alignment.MatePosition = -1;
+		alignment.CigarData = cigars[i % cigars.size()];
+		alignment.QueryBases = std::string(40, bases[i % bases.size()]);
+		alignment.Qualities = std::string(40, 'I');
+		alignment.Length = 40;
+
+		std::string cell_barcode = "AAATTAGGTC", umi;
+		for (int pos = 0; pos < 2; ++pos)
+		{
+			cell_barcode += bases[next_rand() % bases.size()];
+		}
+		for (int pos = 0; pos < 6; ++pos)
+		{
+			umi += bases[next_rand() % bases.size()];
+		}
+
+		alignment.Name = std::to_string(i) + "!" + cell_barcode + "#" + umi;
+		if (i % 31 != 0)
+		{
+			alignment.AddTag("CB", "Z", cell_barcode);
+		}
+		alignment.AddTag("UB", "Z", umi);
+		alignment.AddTag("CQ", "Z", std::string(cell_barcode.size(), (i % 37 == 0) ? '#' : 'I'));
+		alignment.AddTag("UQ", "Z", std::string(umi.size(), 'I'));
+		if (i % 13 != 0)
+		{
+			alignment.AddTag("GX", "Z", "Gene" + std::to_string(next_rand() % 20));
+		}
+		auto const &read_type = read_types[next_rand() % read_types.size()];
+		if (!read_type.empty())
+		{
+			alignment.AddTag("RE", "Z", read_type);
+		}
+
+		alignments.push_back(alignment);
+	}
+
+	return alignments;
+}
+
+// Text dump of the cells, genes and UMIs with their counts, which must be the same for any order of parsing
+static std::string container_summary(const CellsDataContainer &container)
+{
+	std::ostringstream out;
+	out << container.has_exon_reads_num() << " " << container.has_intron_reads_num() << " "
+	    << container.has_not_annotated_reads_num() << "\n";
+	for (size_t cell_id = 0; cell_id < container.total_cells_number(); ++cell_id)
+	{
+		auto const &cell = container.cell(cell_id);
+		out << cell.barcode() << " " << cell.stats().get(Stats::TOTAL_READS_PER_CB) << " "
+		    << cell.stats().get(Stats::TOTAL_UMIS_PER_CB);
+		for (int stat = 0; stat < Stats::CHROMOSOME_STAT_SIZE; ++stat)
+		{
+			Stats::stat_list_t counts;
+			cell.stats().get(Stats::CellChrStatType(stat), counts);
+			for (auto count : counts)
+			{
+				out << " " << count;
+			}
+			out << ";";
+		}
+		out << "\n";
+
+		for (auto const &gene : cell.genes())
+		{
+			out << "\t" << container.gene_indexer().get_value(gene.first);
+			for (auto const &umi : gene.second.umis())
+			{
+				out << " " << container.umi_indexer().get_value(umi.first) << ":" << umi.second.read_count() << ":"
+				    << umi.second.mark().check(Mark::HAS_EXONS) << umi.second.mark().check(Mark::HAS_INTRONS)
+				    << umi.second.mark().check(Mark::HAS_NOT_ANNOTATED);
+			}
+			out << "\n";
+		}
+	}
+
+	return out.str();
+}
+
 struct Fixture
 {
 	Fixture()
@@ -465,6 +780,38 @@ BOOST_AUTO_TEST_SUITE(TestEstimator)
 		BOOST_CHECK_EQUAL(container.cell(0).at("FAM138A").size(), 2);
 	}
 
+	BOOST_FIXTURE_TEST_CASE(testAddPartialRecords, Fixture)
+	{
+		CellsDataContainer container(this->real_cb_strat, this->umi_merge_strat, this->any_mark);
+		auto partial1 = container.create_partial(), partial2 = container.create_partial();
+
+		partial1->add_record(read_info("AAATTAGGTCCA", "AAACCT", "Gene1", "chr1"));
+		partial1->add_record(read_info("AAATTAGGTCCA", "CCCCCT", "Gene2", "chr1"));
+		partial1->add_record(read_info("AAATTAGGTCCC", "CAACCT", "", "chr2"));
+
+		partial2->add_record(read_info("AAATTAGGTCCC", "CAACCT", "Gene3", "chr1"));
+		partial2->add_record(read_info("AAATTAGGTCCA", "AAACCT", "Gene1", "chr2", Mark(Mark::HAS_NOT_ANNOTATED)));
+		partial2->add_record(read_info("AAATTAGGTCCA", "TTTTTT", "Gene1", "chr1"));
+
+		container.add_records(*partial1);
+		container.add_records(*partial2);
+
+		BOOST_REQUIRE_EQUAL(container.total_cells_number(), 2);
+		BOOST_CHECK_EQUAL(container.cell_id_by_cb("AAATTAGGTCCA"), 0);
+		BOOST_CHECK_EQUAL(container.gene_indexer().get_index("Gene3"), 2);
+
+		auto const &cell = container.cell(0);
+		BOOST_CHECK_EQUAL(cell.at("Gene1").size(), 2);
+		BOOST_CHECK_EQUAL(cell.at("Gene1").at("AAACCT").read_count(), 2);
+		BOOST_CHECK(cell.at("Gene1").at("AAACCT").mark().check(Mark::HAS_EXONS));
+		BOOST_CHECK(cell.at("Gene1").at("AAACCT").mark().check(Mark::HAS_NOT_ANNOTATED));
+		BOOST_CHECK_EQUAL(cell.stats().get(Stats::TOTAL_UMIS_PER_CB), 3);
+		BOOST_CHECK_EQUAL(cell.stats().get(Stats::TOTAL_READS_PER_CB), 4);
+		BOOST_CHECK_EQUAL(container.cell(1).stats().get(Stats::TOTAL_READS_PER_CB), 1);
+		BOOST_CHECK_EQUAL(container.has_exon_reads_num(), 4);
+		BOOST_CHECK_EQUAL(container.has_not_annotated_reads_num(), 1);
+	}
+
 	BOOST_FIXTURE_TEST_CASE(testUMIMerge, Fixture)
 	{
 		CellsDataContainer container(this->real_cb_strat, this->umi_merge_strat, this->any_mark);
@@ -606,4 +953,643 @@ BOOST_AUTO_TEST_SUITE(TestEstimator)
 		BOOST_CHECK_EQUAL(targets.at("AAT"), "AGT");
 		BOOST_CHECK_EQUAL(targets.at("CCC"), "TCC");
 	}
+	BOOST_FIXTURE_TEST_CASE(testReadParamsTakenOnce, Fixture)
+	{
+		write_read_params("test_read_params_once.params.gz", {{"uid1", {"AAAA", "CCCC"}}, {"uid2", {"AAAA", "GGGG"}},
+		                                                      {"other_name", {"TTTT", "CCCC"}}});
+		BamProcessing::ReadMapParamsParser parser("", "test_read_params_once.params.gz", BamProcessing::BamTags(),
+		                                          false, 0);
+
+		// Supplementary alignments and reads from several BAM files have the same name, but are counted once
+		for (auto const &read_name : {"uid1", "@uid2", "other_name"})
+		{
+			Tools::ReadParameters read_params;
+			BOOST_CHECK(get_read_params(parser, read_name, read_params));
+			BOOST_CHECK(!read_params.is_empty());
+			BOOST_CHECK(!get_read_params(parser, read_name, read_params));
+		}
+
+		Tools::ReadParameters read_params;
+		BOOST_CHECK(!get_read_params(parser, "uid3", read_params));
+	}
+	BOOST_FIXTURE_TEST_CASE(testReadParamsIndexNames, Fixture)
+	{
+		std::vector<std::pair<std::string, std::pair<std::string, std::string>>> reads;
+		for (size_t i = 1; i <= 20; ++i)
+		{
+			reads.push_back({"abc" + std::to_string(i), {"AAAA", "CCC" + std::string(1, "ACGT"[i % 4])}});
+		}
+
+		reads.push_back({"abc07", {"TTTT", "GGGG"}}); // Leading zeros, differs from 'abc7'
+		reads.push_back({"abc0", {"TTTT", "GGGA"}});
+		reads.push_back({"read_name", {"TTTT", "GGGC"}}); // No number
+		reads.push_back({"abc1234567890123456789", {"TTTT", "GGGT"}}); // More than 18 digits
+		reads.push_back({"q100000000000000000", {"TTTT", "GGAA"}}); // 18 digits
+		reads.push_back({"12345", {"TTTT", "GGAC"}}); // Empty prefix
+
+		write_read_params("test_read_params_names.params.gz", reads);
+		BamProcessing::ReadMapParamsParser parser("", "test_read_params_names.params.gz", BamProcessing::BamTags(),
+		                                          false, 0);
+
+		std::vector<std::string> prefixes;
+		for (auto const &indexed : parser._params_index._indexed_params)
+		{
+			prefixes.push_back(indexed.prefix);
+		}
+		std::sort(prefixes.begin(), prefixes.end());
+		BOOST_CHECK(prefixes == std::vector<std::string>({"", "abc", "q"}));
+
+		auto const &named_params = parser._params_index._read_params;
+		BOOST_CHECK_EQUAL(named_params.size(), 4);
+		for (auto const &read_name : {"abc07", "abc0", "read_name", "abc1234567890123456789"})
+		{
+			BOOST_CHECK_EQUAL(named_params.count(read_name), 1);
+		}
+
+		for (auto const &read : reads)
+		{
+			Tools::ReadParameters read_params;
+			BOOST_REQUIRE(get_read_params(parser, read.first, read_params));
+			BOOST_CHECK_EQUAL(read_params.cell_barcode(), read.second.first);
+			BOOST_CHECK_EQUAL(read_params.umi(), read.second.second);
+		}
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testReadParamsIndexGaps, Fixture)
+	{
+		const size_t max_gap = 1 << 20;
+		std::vector<std::pair<std::string, std::pair<std::string, std::string>>> reads;
+
+		// Numbers beyond the gap are kept in the map, until the index grows up to them
+		const std::string far_name = "g" + std::to_string(max_gap + 13), near_name = "g" + std::to_string(max_gap + 2);
+		reads.push_back({"g1", {"AAAA", "CCCA"}});
+		reads.push_back({"g2", {"AAAA", "CCCG"}});
+		reads.push_back({far_name, {"AAAA", "CCCT"}});
+		reads.push_back({near_name, {"AAAA", "CCAA"}});
+
+		// Out of order numbers are inserted in front, unless they're too far
+		reads.push_back({"f1000", {"AAAA", "CCAC"}});
+		reads.push_back({"f999", {"AAAA", "CCAG"}});
+		reads.push_back({"f10", {"AAAA", "CCAT"}});
+		reads.push_back({"h" + std::to_string(3 * max_gap), {"AAAA", "CCGA"}});
+		reads.push_back({"h1", {"AAAA", "CCGC"}});
+
+		// Reads in the reverse order
+		const size_t reversed_reads_num = 100000;
+		for (size_t i = reversed_reads_num; i > 0; --i)
+		{
+			reads.push_back({"r" + std::to_string(i), {"AAAA", std::string("CCT") + "ACGT"[i % 4]}});
+		}
+
+		for (size_t i = 0; i < 70; ++i) // Too many prefixes
+		{
+			reads.push_back({"p" + std::to_string(i) + "_1", {"AAAA", "CCCC"}});
+		}
+
+		auto all_reads = reads;
+		all_reads.push_back({far_name, {"TTTT", "TTTT"}}); // Duplicate, which isn't in the map anymore
+		all_reads.push_back({"f999", {"TTTT", "TTTT"}});
+		write_read_params("test_read_params_gaps.params.gz", all_reads);
+		BamProcessing::ReadMapParamsParser parser("", "test_read_params_gaps.params.gz", BamProcessing::BamTags(),
+		                                          false, 0);
+
+		auto const &indexed_params = parser._params_index._indexed_params;
+		BOOST_CHECK_EQUAL(indexed_params.size(), 64);
+		for (auto const &indexed : indexed_params)
+		{
+			if (indexed.prefix == "g")
+			{
+				BOOST_CHECK_EQUAL(indexed.first_number, 1);
+				BOOST_CHECK_EQUAL(indexed.params.size(), max_gap + 13); // Grown up to the duplicate
+			}
+			else if (indexed.prefix == "f")
+			{
+				BOOST_CHECK_EQUAL(indexed.first_number, 10);
+				BOOST_CHECK_EQUAL(indexed.params.size(), 991);
+			}
+			else if (indexed.prefix == "h")
+			{
+				BOOST_CHECK_EQUAL(indexed.first_number, 3 * max_gap);
+			}
+			else if (indexed.prefix == "r")
+			{
+				BOOST_CHECK_EQUAL(indexed.first_number, 1);
+				BOOST_CHECK_EQUAL(indexed.params.size(), reversed_reads_num);
+			}
+		}
+
+		auto const &named_params = parser._params_index._read_params;
+		BOOST_CHECK_EQUAL(named_params.size(), 4 + 70 - 64 + 2);
+		BOOST_CHECK_EQUAL(named_params.count(far_name), 1);
+		BOOST_CHECK_EQUAL(named_params.count("h1"), 1);
+
+		for (auto const &read : reads)
+		{
+			Tools::ReadParameters read_params;
+			BOOST_REQUIRE(get_read_params(parser, read.first, read_params));
+			BOOST_CHECK_EQUAL(read_params.umi(), read.second.second);
+		}
+	}
+	BOOST_FIXTURE_TEST_CASE(testReadParamsEmpty, Fixture)
+	{
+		// Reads can have empty parameters. They occupy their slots, so duplicates don't replace them.
+		BamProcessing::ReadMapParamsParser parser("", "", BamProcessing::BamTags(), false, 0);
+		auto &index = parser._params_index;
+		auto params = ReadParametersEfficient(Tools::ReadParameters("AAAA", "CCCC", "IIII", "IIII", 0), index.barcode_indexer,
+		                                      index.umi_indexer, index.umi_quality_indexer);
+
+		index.add("e1", params);
+		index.add("e5", ReadParametersEfficient());
+		index.add("e5", params);
+		index.add("e3", ReadParametersEfficient());
+		index.add("named_read", ReadParametersEfficient());
+		index.add("named_read", params);
+		index.finalize();
+
+		BOOST_REQUIRE_EQUAL(index._indexed_params.size(), 1);
+		auto const &indexed = index._indexed_params.front();
+		BOOST_CHECK_EQUAL(indexed.first_number, 1);
+		BOOST_CHECK(indexed.filled == std::vector<bool>({true, false, true, false, true}));
+
+		Tools::ReadParameters read_params;
+		BOOST_CHECK(get_read_params(parser, "e1", read_params));
+		BOOST_CHECK_EQUAL(read_params.umi(), "CCCC");
+		for (auto const &read_name : {"e5", "e3", "named_read", "e2", "e4"})
+		{
+			BOOST_CHECK(!get_read_params(parser, read_name, read_params));
+			BOOST_CHECK(index.take(read_name) == nullptr);
+		}
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testReadParamsFilesOrder, Fixture)
+	{
+		// Each file has own reads and reads, which are duplicated in other files. Files are loaded concurrently,
+		// but the first file in the list wins, as in sequential loading.
+		const size_t files_num = 6;
+		std::vector<std::string> filenames, umis;
+		for (size_t file_ind = 0; file_ind < files_num; ++file_ind)
+		{
+			umis.push_back(std::string("CC") + "ACGT"[file_ind / 4] + "ACGT"[file_ind % 4]);
+
+			std::vector<std::pair<long, std::pair<std::string, std::string>>> reads;
+			for (long read_ind = 1; read_ind <= 300; ++read_ind)
+			{
+				reads.push_back({long(file_ind) * 1000 + read_ind, {"AAAA", umis.back()}});
+			}
+			reads.push_back({7, {"AAAA", umis.back()}});
+
+			if (file_ind == 2)
+			{
+				filenames.push_back("test_read_params_order" + std::to_string(file_ind) + ".params.bin");
+				write_binary_read_params(filenames.back(), "uid", reads);
+				continue;
+			}
+
+			std::vector<std::pair<std::string, std::pair<std::string, std::string>>> named_reads;
+			for (auto const &read : reads)
+			{
+				named_reads.push_back({"uid" + std::to_string(read.first), read.second});
+			}
+
+			named_reads.push_back({"shared_read", {"AAAA", umis.back()}});
+			if (file_ind == 3 || file_ind == 5)
+			{
+				named_reads.push_back({"shared_tail", {"AAAA", umis.back()}});
+			}
+
+			filenames.push_back("test_read_params_order" + std::to_string(file_ind) + ".params.gz");
+			write_read_params(filenames.back(), named_reads);
+		}
+
+		for (size_t threads_num : {1, 4})
+		{
+			for (bool reversed : {false, true})
+			{
+				std::vector<size_t> order(files_num);
+				std::iota(order.begin(), order.end(), 0);
+				if (reversed)
+				{
+					std::reverse(order.begin(), order.end());
+				}
+
+				std::string filenames_list;
+				for (size_t file_ind : order)
+				{
+					filenames_list += filenames[file_ind] + " ";
+				}
+
+				BamProcessing::ReadMapParamsParser parser("", filenames_list, BamProcessing::BamTags(), false, 0, threads_num);
+				Tools::ReadParameters read_params;
+				for (size_t file_ind = 0; file_ind < files_num; ++file_ind)
+				{
+					for (long read_ind = (file_ind == 0) ? 8 : 1; read_ind <= 300; ++read_ind)
+					{
+						BOOST_REQUIRE(get_read_params(parser, "uid" + std::to_string(file_ind * 1000 + read_ind), read_params));
+						BOOST_CHECK_EQUAL(read_params.umi(), umis[file_ind]);
+					}
+				}
+
+				BOOST_REQUIRE(get_read_params(parser, "uid7", read_params));
+				BOOST_CHECK_EQUAL(read_params.umi(), umis[order.front()]);
+				BOOST_REQUIRE(get_read_params(parser, "shared_read", read_params));
+				BOOST_CHECK_EQUAL(read_params.umi(), umis[reversed ? 5 : 0]); // The binary file has no named reads
+				BOOST_REQUIRE(get_read_params(parser, "shared_tail", read_params));
+				BOOST_CHECK_EQUAL(read_params.umi(), umis[reversed ? 5 : 3]);
+			}
+		}
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testReadParamsFileErrors, Fixture)
+	{
+		write_read_params("test_read_params_errors0.params.gz", {{"uid1", {"AAAA", "CCCC"}}});
+		std::ofstream("test_read_params_errors1.params.gz") << "not a gzip file\n";
+
+		// Rows, which can't be parsed, are skipped
+		{
+			std::ofstream gz_out("test_read_params_errors2.params.gz", std::ios_base::out | std::ios_base::binary);
+			boost::iostreams::filtering_ostream out;
+			out.push(boost::iostreams::gzip_compressor());
+			out.push(gz_out);
+			out << "uid2 AAAA CCCC IIII IIII\nbroken_row\nuid3 AAAA CCCC IIII IIII\n";
+		}
+
+		BamProcessing::ReadMapParamsParser parser("", "test_read_params_errors0.params.gz test_read_params_errors2.params.gz",
+		                                          BamProcessing::BamTags(), false, 0);
+		Tools::ReadParameters read_params;
+		for (auto const &read_name : {"uid1", "uid2", "uid3"})
+		{
+			BOOST_CHECK(get_read_params(parser, read_name, read_params));
+		}
+
+		// An error in any file stops loading of the others
+		for (auto const &bad_file : {"test_read_params_missing.params.gz", "test_read_params_errors1.params.gz"})
+		{
+			for (size_t bad_file_ind = 0; bad_file_ind < 3; ++bad_file_ind)
+			{
+				std::vector<std::string> filenames(3, "test_read_params_errors0.params.gz");
+				filenames[bad_file_ind] = bad_file;
+				BOOST_CHECK_THROW(BamProcessing::ReadMapParamsParser("", filenames[0] + " " + filenames[1] + " " +
+				                                                     filenames[2], BamProcessing::BamTags(), false, 0),
+				                  std::exception);
+			}
+		}
+	}
+	BOOST_FIXTURE_TEST_CASE(testParallelBamReader, Fixture)
+	{
+		using BamProcessing::ParallelBamReader;
+		const BamTools::RefVector references = {BamTools::RefData("chr1", 1000000), BamTools::RefData("chr2", 50000)};
+		auto alignments = random_alignments(20000, references, false);
+
+		// Records span BGZF blocks, which have 64Kb of data. This one is larger than a block.
+		alignments[100].QueryBases = std::string(70000, 'A');
+		alignments[100].Qualities = std::string(70000, 'I');
+		alignments[100].Length = 70000;
+		alignments[100].CigarData = {{'M', 70000}};
+
+		const std::string bam_name = "test_parallel_bam_reader.bam";
+		write_bam(bam_name, references, alignments, false);
+
+		std::vector<BamTools::BamAlignment> expected_alignments;
+		BamTools::BamReader bam_reader;
+		BOOST_REQUIRE(bam_reader.Open(bam_name));
+		BamTools::BamAlignment alignment;
+		while (bam_reader.GetNextAlignment(alignment))
+		{
+			expected_alignments.push_back(alignment);
+		}
+		bam_reader.Close();
+		BOOST_REQUIRE_EQUAL(expected_alignments.size(), alignments.size());
+
+		for (size_t threads_num : {1, 3})
+		{
+			ParallelBamReader reader(bam_name, threads_num);
+			BOOST_REQUIRE_EQUAL(reader.references().size(), references.size());
+			for (size_t i = 0; i < references.size(); ++i)
+			{
+				BOOST_CHECK_EQUAL(reader.references()[i].RefName, references[i].RefName);
+				BOOST_CHECK_EQUAL(reader.references()[i].RefLength, references[i].RefLength);
+			}
+
+			for (auto const &expected : expected_alignments)
+			{
+				BOOST_REQUIRE(reader.get_next_alignment(alignment));
+				check_alignment_fields(expected, alignment, ParallelBamReader::ALL_FIELDS);
+			}
+
+			BOOST_CHECK(!reader.get_next_alignment(alignment));
+		}
+
+		for (int fields : {0, int(ParallelBamReader::NAME), int(ParallelBamReader::CIGAR), int(ParallelBamReader::BASES),
+		                   int(ParallelBamReader::QUALITIES), int(ParallelBamReader::TAGS),
+		                   ParallelBamReader::NAME | ParallelBamReader::QUALITIES | ParallelBamReader::TAGS})
+		{
+			ParallelBamReader reader(bam_name, 2);
+			for (auto const &expected : expected_alignments)
+			{
+				BOOST_REQUIRE(reader.get_next_alignment_core(alignment));
+				reader.decode_fields(alignment, fields);
+				check_alignment_fields(expected, alignment, fields);
+			}
+
+			BOOST_CHECK(!reader.get_next_alignment_core(alignment));
+		}
+
+		// A truncated file must fail instead of losing the rest of the reads
+		std::string content;
+		{
+			std::ifstream bam_in(bam_name, std::ios_base::in | std::ios_base::binary);
+			content.assign(std::istreambuf_iterator<char>(bam_in), std::istreambuf_iterator<char>());
+		}
+
+		// Cut inside of a BGZF block, and between blocks inside of a record
+		size_t blocks_end = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			blocks_end += size_t(uint8_t(content[blocks_end + 16]) | (uint8_t(content[blocks_end + 17]) << 8)) + 1;
+		}
+
+		const std::string truncated_name = "test_parallel_bam_reader_truncated.bam";
+		for (size_t truncated_size : {content.size() / 2, blocks_end})
+		{
+			std::ofstream(truncated_name, std::ios_base::out | std::ios_base::binary) << content.substr(0, truncated_size);
+			BOOST_CHECK_THROW({
+				                  ParallelBamReader truncated_reader(truncated_name, 2);
+				                  while (truncated_reader.get_next_alignment(alignment)) {}
+			                  }, std::runtime_error);
+		}
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testBamRegionsParsing, Fixture)
+	{
+		using namespace BamProcessing;
+		const BamTools::RefVector references = {BamTools::RefData("chr1", 300000), BamTools::RefData("chr2", 200000),
+		                                        BamTools::RefData("chr3", 100000), BamTools::RefData("chr4", 400000)};
+		const std::string bam_name = "test_bam_regions.bam";
+		const BamTags tags((boost::property_tree::ptree()));
+		const size_t threads_num = 3;
+
+		auto create_index = [&bam_name]() {
+			BamTools::BamReader reader;
+			BOOST_REQUIRE(reader.Open(bam_name));
+			BOOST_REQUIRE(reader.CreateIndex());
+		};
+
+		// Bounds of the regions depend only on the reference lengths
+		BamController controller(tags, true, "", "", false, 0, threads_num);
+		std::vector<BamController::AlignmentsRegion> regions;
+		BamTools::RefVector region_references;
+		write_bam(bam_name, references, {}, true);
+		create_index();
+		BOOST_REQUIRE(controller.split_to_regions(bam_name, regions, region_references));
+		BOOST_REQUIRE_GT(regions.size(), 4);
+
+		// chr2 has reads only in the first half and chr3 doesn't have reads, so some regions start after the last read
+		// of their reference. Alignments at the bounds of the regions must be parsed once, with the right region.
+		std::vector<BamTools::BamAlignment> alignments;
+		auto add_alignment = [&alignments](int32_t ref_id, int32_t position) {
+			const size_t i = alignments.size();
+			BamTools::BamAlignment alignment;
+			alignment.Name = "read" + std::to_string(i);
+			alignment.RefID = ref_id;
+			alignment.Position = position;
+			alignment.MapQuality = 255;
+			alignment.AlignmentFlag = ((i % 23 == 0 || ref_id < 0) ? 0x4 : 0) | ((i % 29 == 0) ? 0x100 : 0);
+			alignment.MateRefID = -1;
+			alignment.MatePosition = -1;
+			alignment.CigarData = {{'M', 50}};
+			alignment.QueryBases = std::string(50, "ACGT"[i % 4]);
+			alignment.Qualities = std::string(50, 'I');
+			alignment.Length = 50;
+			if (i % 31 != 0) // Reads without cell barcode can't be parsed
+			{
+				alignment.AddTag("CB", "Z", std::string("AAATTAGGTCC") + "ACGTN"[i % 5]);
+			}
+			alignment.AddTag("UB", "Z", std::string("CCAT") + "ACGT"[(i / 5) % 4] + "ACGT"[(i / 20) % 4]);
+			alignment.AddTag("GX", "Z", "Gene" + std::to_string(i % 11));
+			alignments.push_back(alignment);
+		};
+
+		for (size_t i = 0; i < 40000; ++i)
+		{
+			const int32_t ref_id = std::vector<int32_t>{0, 1, 3}[i % 3];
+			const int32_t max_position = (ref_id == 1) ? references[ref_id].RefLength / 2 : references[ref_id].RefLength;
+			add_alignment(ref_id, int32_t((i * 104729) % size_t(max_position)));
+		}
+
+		size_t bound_alignments_num = 0;
+		for (size_t i = 1; i < regions.size(); ++i)
+		{
+			auto const &start = regions[i].start;
+			if (start.first == 2 || (start.first == 1 && start.second >= references[1].RefLength / 2))
+				continue;
+
+			add_alignment(start.first, start.second);
+			add_alignment(start.first, start.second);
+			if (start.second > 0)
+			{
+				add_alignment(start.first, start.second - 1);
+			}
+			bound_alignments_num++;
+		}
+		BOOST_REQUIRE_GT(bound_alignments_num, 2);
+
+		for (size_t i = 0; i < 300; ++i) // Reads without coordinates are in the end
+		{
+			add_alignment(-1, -1);
+		}
+
+		std::stable_sort(alignments.begin(), alignments.end(),
+		                 [](const BamTools::BamAlignment &a1, const BamTools::BamAlignment &a2) {
+			                 return std::make_pair(uint32_t(a1.RefID), a1.Position) <
+			                        std::make_pair(uint32_t(a2.RefID), a2.Position);
+		                 });
+
+		write_bam(bam_name, references, alignments, true);
+		create_index();
+
+		std::vector<BamController::AlignmentsRegion> indexed_regions;
+		BOOST_REQUIRE(controller.split_to_regions(bam_name, indexed_regions, region_references));
+		BOOST_REQUIRE_EQUAL(indexed_regions.size(), regions.size());
+		BOOST_CHECK_GT(indexed_regions.back().start_offset, 0);
+		for (size_t i = 1; i < indexed_regions.size(); ++i)
+		{
+			BOOST_CHECK(indexed_regions[i].start == regions[i].start);
+			BOOST_CHECK_GE(indexed_regions[i].start_offset, indexed_regions[i - 1].start_offset);
+		}
+
+		auto parse = [&](size_t cur_threads_num, bool split_sorted_bam) {
+			BamController cur_controller(tags, true, "", "", false, 0, cur_threads_num, split_sorted_bam);
+			CellsDataContainer container(this->real_cb_strat, this->umi_merge_strat, this->any_mark);
+			std::shared_ptr<BamProcessorAbstract> processor(new BamProcessor(container, tags, false));
+			cur_controller.process_bam_files({bam_name}, processor);
+
+			return std::to_string(processor->total_reads_num()) + " " + std::to_string(processor->cant_parse_reads_num()) +
+			       " " + std::to_string(processor->low_quality_reads_num()) + "\n" + container_summary(container);
+		};
+
+		const std::string expected = parse(1, true);
+		BOOST_CHECK_EQUAL(parse(threads_num, true), expected);
+		BOOST_CHECK_EQUAL(parse(threads_num, false), expected);
+
+		// samtools can name the index '<name>.bai', and files without an index are parsed sequentially
+		const std::string short_index_name = "test_bam_regions.bai";
+		BOOST_REQUIRE_EQUAL(std::rename((bam_name + ".bai").c_str(), short_index_name.c_str()), 0);
+		BOOST_CHECK(controller.split_to_regions(bam_name, indexed_regions, region_references));
+		BOOST_CHECK_EQUAL(parse(threads_num, true), expected);
+
+		std::remove(short_index_name.c_str());
+		BOOST_CHECK(!controller.split_to_regions(bam_name, indexed_regions, region_references));
+		BOOST_CHECK_EQUAL(parse(threads_num, true), expected);
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testParsersUsedFields, Fixture)
+	{
+		using namespace BamProcessing;
+		const BamTools::RefVector references = {BamTools::RefData("chr1", 80000), BamTools::RefData("chr2", 140000),
+		                                        BamTools::RefData("chrX", 120000), BamTools::RefData("chrY", 50000)};
+		const std::string bam_name = "test_parsers_used_fields.bam", params_name = "test_parsers_used_fields.params.gz";
+		const std::string gtf_name = PROJ_DATA_PATH + std::string("/gtf/gtf_test.gtf.gz");
+		auto alignments = annotated_alignments(3000, references);
+		write_bam(bam_name, references, alignments, false);
+
+		std::vector<std::pair<std::string, std::pair<std::string, std::string>>> read_params;
+		for (auto const &alignment : alignments)
+		{
+			auto params = Tools::ReadParameters::parse_encoded_id(alignment.Name);
+			read_params.emplace_back(alignment.Name, std::make_pair(params.cell_barcode(), params.umi()));
+		}
+		write_read_params(params_name, read_params);
+
+		boost::property_tree::ptree config;
+		config.put("BamTags.Type.tag", "RE");
+		config.put("BamTags.Type.intronic", "INTRONIC");
+		config.put("BamTags.Type.intergenic", "INTERGENIC");
+		config.put("BamTags.Type.exonic", "EXONIC");
+		const BamTags tags(config);
+
+		// Read parameters and genes must be the same with the fields from used_fields() and with all fields. Parsers
+		// are created twice, as ReadMapParamsParser gives parameters of each read only once.
+		struct ParserConfig
+		{
+			std::function<std::shared_ptr<ReadParamsParser>()> create;
+			int expected_fields;
+		};
+
+		const std::vector<ParserConfig> configs = {
+				{[&]{ return std::make_shared<ReadParamsParser>(gtf_name, tags, false); },
+				 ParallelBamReader::NAME | ParallelBamReader::CIGAR},
+				{[&]{ return std::make_shared<ReadParamsParser>("", tags, false); },
+				 ParallelBamReader::NAME | ParallelBamReader::TAGS},
+				{[&]{ return std::make_shared<ReadParamsParser>(gtf_name, tags, true); }, int(ParallelBamReader::NAME)},
+				{[&]{ return std::make_shared<ReadMapParamsParser>(gtf_name, params_name, tags, false, 10); },
+				 ParallelBamReader::NAME | ParallelBamReader::CIGAR},
+				{[&]{ return std::make_shared<FilledBamParamsParser>(gtf_name, tags, false, 10); },
+				 ParallelBamReader::TAGS | ParallelBamReader::CIGAR},
+				{[&]{ return std::make_shared<FilledBamParamsParser>("", tags, false, 10); }, int(ParallelBamReader::TAGS)},
+				{[&]{ return std::make_shared<FilledBamParamsParser>("", tags, true, 10); }, int(ParallelBamReader::TAGS)}};
+
+		// Results of the parser for each alignment, decoded with the fields
+		auto annotate = [&](ReadParamsParser &parser, int fields) {
+			std::vector<std::string> results;
+			ParallelBamReader reader(bam_name, 1);
+			BamTools::BamAlignment alignment;
+			while (reader.get_next_alignment_core(alignment))
+			{
+				reader.decode_fields(alignment, fields);
+				if (alignment.RefID < 0)
+					continue;
+
+				Tools::ReadParameters params;
+				std::string result = parser.get_read_params(alignment, params)
+				                     ? params.cell_barcode() + " " + params.umi() + " " + std::to_string(params.pass_quality_threshold())
+				                     : "no params";
+
+				std::string gene;
+				try
+				{
+					auto mark = parser.get_gene(reader.references()[alignment.RefID].RefName, alignment, gene);
+					result += " " + gene + " " + std::to_string(mark.check(Mark::HAS_EXONS)) +
+					          std::to_string(mark.check(Mark::HAS_INTRONS)) + std::to_string(mark.check(Mark::HAS_NOT_ANNOTATED));
+				}
+				catch (Tools::GeneAnnotation::RefGenesContainer::ChrNotFoundException &ex)
+				{
+					result += " unknown chromosome " + ex.chr_name;
+				}
+
+				results.push_back(result);
+			}
+
+			return results;
+		};
+
+		for (auto const &parser_config : configs)
+		{
+			int fields = parser_config.create()->used_fields();
+			BOOST_CHECK_EQUAL(fields, parser_config.expected_fields);
+
+			auto expected = annotate(*parser_config.create(), ParallelBamReader::ALL_FIELDS);
+			BOOST_REQUIRE_EQUAL(expected.size(), alignments.size() - (alignments.size() + 100) / 101);
+			BOOST_CHECK(annotate(*parser_config.create(), fields) == expected);
+
+			// Each of the fields is needed, so the test alignments depend on all of them
+			for (int field : {ParallelBamReader::NAME, ParallelBamReader::CIGAR, ParallelBamReader::TAGS})
+			{
+				if (fields & field)
+				{
+					BOOST_CHECK(annotate(*parser_config.create(), fields & ~field) != expected);
+				}
+			}
+		}
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testParallelAnnotation, Fixture)
+	{
+		using namespace BamProcessing;
+		const BamTools::RefVector references = {BamTools::RefData("chr1", 80000), BamTools::RefData("chr2", 140000),
+		                                        BamTools::RefData("chrX", 120000), BamTools::RefData("chrY", 50000)};
+		const std::string bam_name = "test_parallel_annotation.bam", params_name = "test_parallel_annotation.params.gz";
+		const std::string gtf_name = PROJ_DATA_PATH + std::string("/gtf/gtf_test.gtf.gz");
+
+		// Several batches of alignments, annotated concurrently
+		auto alignments = annotated_alignments(35000, references);
+		write_bam(bam_name, references, alignments, false);
+
+		std::vector<std::pair<std::string, std::pair<std::string, std::string>>> read_params;
+		for (size_t i = 0; i < alignments.size(); i += (i % 7 == 0) ? 2 : 1) // Some reads don't have parameters
+		{
+			auto params = Tools::ReadParameters::parse_encoded_id(alignments[i].Name);
+			read_params.emplace_back(alignments[i].Name, std::make_pair(params.cell_barcode(), params.umi()));
+		}
+		write_read_params(params_name, read_params);
+
+		const BamTags tags((boost::property_tree::ptree()));
+		auto parse = [&](bool filled_bam, const std::string &read_params_name, const std::string &gtf, size_t threads_num) {
+			BamController controller(tags, filled_bam, read_params_name, gtf, false, 10, threads_num);
+			CellsDataContainer container(this->real_cb_strat, this->umi_merge_strat, this->any_mark);
+			std::shared_ptr<BamProcessorAbstract> processor(new BamProcessor(container, tags, false));
+			controller.process_bam_files({bam_name}, processor);
+
+			return std::to_string(processor->total_reads_num()) + " " + std::to_string(processor->cant_parse_reads_num()) +
+			       " " + std::to_string(processor->low_quality_reads_num()) + "\n" + container_summary(container);
+		};
+
+		for (bool filled_bam : {false, true})
+		{
+			for (auto const &read_params_name : {std::string(), params_name})
+			{
+				if (filled_bam && !read_params_name.empty())
+					continue;
+
+				for (auto const &gtf : {std::string(), gtf_name})
+				{
+					// Stages of the parsing are merged, if there are too few threads
+					auto expected = parse(filled_bam, read_params_name, gtf, 1);
+					for (size_t threads_num : {2, 3, 4, 7})
+					{
+						BOOST_CHECK_EQUAL(parse(filled_bam, read_params_name, gtf, threads_num), expected);
+					}
+				}
+			}
+		}
+	}
 BOOST_AUTO_TEST_SUITE_END()
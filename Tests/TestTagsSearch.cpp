@@ -3,18 +3,80 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include "TagsSearch/CellBarcodesCorrector.h"
+#include "TagsSearch/ConcurrentGzWriter.h"
 #include "TagsSearch/FixPosSpacerTagsFinder.h"
 #include "TagsSearch/SpacerFinder.h"
+#include "TagsSearch/UnalignedBamEncoder.h"
 #include "TagsSearch/IndropV1TagsFinder.h"
+#include "TagsSearch/IndropV3TagsFinder.h"
+#include "TagsSearch/IndropV3LibsTagsFinder.h"
+#include "TagsSearch/PipelineMetrics.h"
 #include "Tools/Logs.h"
-#include "Tools/ReadParameters.h"
+#include "Tools/PackedReadParameters.h"
 
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <sstream>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 
 using namespace TagsSearch;
 
+static std::string read_gz(const std::string &filename)
+{
+	std::ifstream gz_in(filename, std::ios_base::in | std::ios_base::binary);
+	boost::iostreams::filtering_istream in;
+	in.push(boost::iostreams::gzip_decompressor());
+	in.push(gz_in);
+
+	std::stringstream result;
+	boost::iostreams::copy(in, result);
+	return result.str();
+}
+
+// Writes reads of the three indrop v3 files. Sequences are pseudo-random, and some reads are short or have low quality
+static std::vector<std::string> write_indrop_v3_reads(const std::string &base_name, size_t reads_num, size_t gene_reads_num)
+{
+	const std::string bases = "ACGT";
+	std::vector<std::string> read_files;
+	for (size_t file_id = 0; file_id < 3; ++file_id)
+	{
+		read_files.push_back(base_name + "_r" + std::to_string(file_id + 1) + ".fastq.gz");
+		std::ofstream gz_out(read_files.back(), std::ios_base::out | std::ios_base::binary);
+		boost::iostreams::filtering_ostream out;
+		out.push(boost::iostreams::gzip_compressor());
+		out.push(gz_out);
+
+		unsigned long state = 17 + file_id;
+		const size_t file_reads_num = (file_id == 2) ? gene_reads_num : reads_num;
+		for (size_t i = 0; i < file_reads_num; ++i)
+		{
+			size_t length = (file_id == 0) ? 8 : (file_id == 1) ? 14 : (i % 97 == 0) ? 5 : 40;
+			std::string seq;
+			for (size_t pos = 0; pos < length; ++pos)
+			{
+				state = state * 6364136223846793005ul + 1442695040888963407ul;
+				seq += bases[(file_id == 0) ? (state >> 60) % 2 : (state >> 60) % 4]; // Few cell barcodes
+			}
+
+			if (length == 40 && file_id == 2 && i % 5 == 0)
+			{
+				seq.replace(20, 20, std::string(20, 'A'));
+			}
+
+			std::string quality(length, (file_id == 1 && i % 13 == 0) ? '#' : 'I');
+			out << "@read" << i << "\n" << seq << "\n+\n" << quality << "\n";
+		}
+	}
+
+	return read_files;
+}
+
 struct Fixture
 {
 	Fixture()
@@ -86,17 +148,19 @@ BOOST_AUTO_TEST_SUITE(TestTagsSearch)
 	{
 		std::string r1_seq = "TAGTTTCGGAGTGTTTGCTTGTGACGCCTTACCTTGCCCGCGACTTTTTTTTTTT";
 		auto spacer_pos = tags_finder->_spacer_finder.find_spacer(r1_seq);
-		Tools::ReadParameters res = tags_finder->parse(r1_seq, r1_seq, spacer_pos);
+		Tools::PackedReadParameters res;
+		tags_finder->parse(r1_seq, r1_seq, spacer_pos, res);
 		BOOST_CHECK_EQUAL(res.is_empty(), false);
-		BOOST_CHECK_EQUAL(res.cell_barcode(), "TAGTTTCGACCTTGCC");
-		BOOST_CHECK_EQUAL(res.cell_barcode_quality(), "TAGTTTCGACCTTGCC");
+		BOOST_CHECK_EQUAL(res.cell_barcode().sequence(), "TAGTTTCGACCTTGCC");
+		BOOST_CHECK_EQUAL(res.cell_barcode().quality(), "TAGTTTCGACCTTGCC");
 	}
 
 	BOOST_FIXTURE_TEST_CASE(test3, Fixture)
 	{
 		std::string r1_seq = "TGACCATTACTGAGTGATTGCTTGTGACGCCTTAAGCGTACAGATTATTTT";
 		auto spacer_pos = tags_finder->_spacer_finder.find_spacer(r1_seq);
-		Tools::ReadParameters res = tags_finder->parse(r1_seq, r1_seq, spacer_pos);
+		Tools::PackedReadParameters res;
+		tags_finder->parse(r1_seq, r1_seq, spacer_pos, res);
 		BOOST_CHECK_EQUAL(res.is_empty(), false);
 	}
 
@@ -122,12 +186,412 @@ BOOST_AUTO_TEST_SUITE(TestTagsSearch)
 	BOOST_FIXTURE_TEST_CASE(testMaskParse, Fixture)
 	{
 		std::string seq("TCTCACTGCGTCTCACTGCGTGACATTGTCGGCCATTGTCGGCCTCCCGGAGATAGGAGGAGATAGGACAACGAGGTCGGCTAGGCGTAAGGGATTTTTTTTTTTTTTTTT");
-		Tools::ReadParameters params;
+		Tools::PackedReadParameters params;
 		this->mask_tags_finder->parse(seq, seq, params);
-		BOOST_CHECK_EQUAL(params.cell_barcode(), "TCTCACTGCGTCTCACTGCGATTGTCGGCCATTGTCGGCCGGAGATAGGAGGAGATAGGA");
-		BOOST_CHECK_EQUAL(params.cell_barcode_quality(), "TCTCACTGCGTCTCACTGCGATTGTCGGCCATTGTCGGCCGGAGATAGGAGGAGATAGGA");
-		BOOST_CHECK_EQUAL(params.umi(), "TAAGGGAT");
-		BOOST_CHECK_EQUAL(params.umi_quality(), "TAAGGGAT");
+		BOOST_CHECK_EQUAL(params.cell_barcode().sequence(), "TCTCACTGCGTCTCACTGCGATTGTCGGCCATTGTCGGCCGGAGATAGGAGGAGATAGGA");
+		BOOST_CHECK_EQUAL(params.cell_barcode().quality(), "TCTCACTGCGTCTCACTGCGATTGTCGGCCATTGTCGGCCGGAGATAGGAGGAGATAGGA");
+		BOOST_CHECK_EQUAL(params.umi().sequence(), "TAAGGGAT");
+		BOOST_CHECK_EQUAL(params.umi().quality(), "TAAGGGAT");
+
+		// Spacers with errors are checked against the edit distance limits (2, 2, 7)
+		auto const &plan = this->mask_tags_finder->_plan;
+		BOOST_REQUIRE_EQUAL(plan.size(), 7);
+		BOOST_CHECK_EQUAL(plan[5].offset, 68);
+
+		std::vector<std::string> reads = {"TGAC", "TGAA", "TTTC", "AGGG", "TANC", "TGA"};
+		for (auto const &read : reads)
+		{
+			std::string padded = read + std::string(4 - std::min(read.length(), size_t(4)), 'G');
+			bool expected = Tools::edit_distance("TGAC", 4, padded.data(), 4, true, 2) <= 2;
+			BOOST_CHECK_EQUAL(FixPosSpacerTagsFinder::spacer_matches(plan[1], padded.data()), expected);
+		}
+
+		std::string bad_seq = seq;
+		bad_seq.replace(68, 4, "GTTG");
+		params.clear();
+		BOOST_CHECK_EQUAL(this->mask_tags_finder->parse(bad_seq, bad_seq, params), 95);
+
+		bad_seq.replace(68, 12, "TTTTTTTTTTTT");
+		params.clear();
+		BOOST_CHECK_EQUAL(this->mask_tags_finder->parse(bad_seq, bad_seq, params), std::string::npos);
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testWriterOrder, Fixture)
+	{
+		std::string expected;
+		{
+			ConcurrentGzWriter writer("test_writer_order", "txt.gz", 0);
+			writer.start(3, 1000);
+			for (int chunk_id = 9; chunk_id >= 0; --chunk_id) // Chunks are enqueued in the reversed order
+			{
+				std::string text = (chunk_id == 5) ? "" : "chunk " + std::to_string(chunk_id) + "\n";
+				expected = text + expected;
+				writer.enqueue_lines(std::move(text), 1, size_t(chunk_id));
+			}
+			writer.finish();
+		}
+
+		std::ifstream gz_in("test_writer_order.txt.gz", std::ios_base::in | std::ios_base::binary);
+		boost::iostreams::filtering_istream in;
+		in.push(boost::iostreams::gzip_decompressor());
+		in.push(gz_in);
+
+		std::stringstream result;
+		boost::iostreams::copy(in, result);
+		BOOST_CHECK_EQUAL(result.str(), expected);
+		std::remove("test_writer_order.txt.gz");
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testWriterStream, Fixture)
+	{
+		std::string expected;
+		{
+			ConcurrentGzWriter writer("test_writer_stream", "txt.gz", 1, Z_DEFAULT_COMPRESSION, false, "header\n",
+			                          "test_writer_stream.txt");
+			writer.start(2, 1000);
+			for (int chunk_id = 4; chunk_id >= 0; --chunk_id)
+			{
+				std::string text = "chunk " + std::to_string(chunk_id) + "\n";
+				expected = text + expected;
+				writer.enqueue_lines(std::move(text), 1, size_t(chunk_id));
+			}
+			writer.finish();
+		}
+
+		std::ifstream in("test_writer_stream.txt");
+		std::stringstream result;
+		result << in.rdbuf();
+		BOOST_CHECK_EQUAL(result.str(), "header\n" + expected); // Not compressed and not split
+		std::remove("test_writer_stream.txt");
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testWriterMetrics, Fixture)
+	{
+		{
+			PipelineMetrics metrics("test_writer_metrics.jsonl", 3600);
+			ConcurrentGzWriter writer("test_writer_metrics", "txt.gz", 0);
+			writer.add_metrics(metrics, "write");
+			auto records = metrics.counter("read", "records");
+			metrics.add_gauge("read", "queue", []{ return 7; });
+
+			metrics.start();
+			writer.start(2, 1000);
+			for (size_t chunk_id = 0; chunk_id < 3; ++chunk_id)
+			{
+				*records += 10;
+				writer.enqueue_lines("chunk\n", 1, chunk_id);
+			}
+			writer.finish();
+			metrics.finish();
+		}
+
+		std::ifstream in("test_writer_metrics.jsonl");
+		std::string line, last_line;
+		while (std::getline(in, line))
+		{
+			last_line = line;
+		}
+
+		BOOST_CHECK_EQUAL(last_line.find("\"final\": true"), last_line.find("\"final\""));
+		BOOST_CHECK_NE(last_line.find("\"read\": {\"records\": 30, \"queue\": 7}"), std::string::npos);
+		BOOST_CHECK_NE(last_line.find("\"write\": {\"bytes_in\": 18, "), std::string::npos);
+		std::remove("test_writer_metrics.jsonl");
+		std::remove("test_writer_metrics.txt.gz");
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testWriterStreamMetrics, Fixture)
+	{
+		{
+			PipelineMetrics metrics("test_writer_stream_metrics.jsonl", 3600);
+			ConcurrentGzWriter writer("test_writer_stream_metrics", "txt.gz", 0, Z_DEFAULT_COMPRESSION, false, "",
+			                          "test_writer_stream_metrics.txt");
+			writer.add_metrics(metrics, "write");
+
+			metrics.start();
+			writer.start(2, 1000);
+			for (size_t chunk_id = 0; chunk_id < 3; ++chunk_id)
+			{
+				writer.enqueue_lines("chunk\n", 1, chunk_id);
+			}
+			writer.finish();
+			metrics.finish();
+		}
+
+		std::ifstream in("test_writer_stream_metrics.jsonl");
+		std::string line, last_line;
+		while (std::getline(in, line))
+		{
+			last_line = line;
+		}
+
+		// Text isn't compressed in the stream mode, so both sizes are the same
+		BOOST_CHECK_NE(last_line.find("\"write\": {\"bytes_in\": 18, \"bytes_out\": 18, "), std::string::npos);
+		std::remove("test_writer_stream_metrics.jsonl");
+		std::remove("test_writer_stream_metrics.txt");
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testBarcodesCorrection, Fixture)
+	{
+		{
+			std::ofstream barcodes_out("test_barcodes.txt");
+			barcodes_out << "AAAACCCC GGGGTTTTA\n" << "ACGTAC ACGTAA\n";
+		}
+
+		CellBarcodesCorrector corrector("test_barcodes.txt", "indrop", 1);
+		std::remove("test_barcodes.txt");
+
+		auto correct = [&corrector](const std::string &barcode, std::string &corrected)
+		{
+			std::string quality(barcode.length(), 'I');
+			Tools::PackedTag tag;
+			tag.append(barcode, quality);
+			return corrector.correct(tag, corrected);
+		};
+
+		std::string corrected;
+		BOOST_CHECK_EQUAL(correct("GGGGTTTTGTACGT", corrected), CellBarcodesCorrector::EXACT);
+		BOOST_CHECK_EQUAL(correct("TAAAACCCCTTACGT", corrected), CellBarcodesCorrector::EXACT);
+		BOOST_CHECK_EQUAL(correct("GGGATTTTGTACGT", corrected), CellBarcodesCorrector::CORRECTED);
+		BOOST_CHECK_EQUAL(corrected, "GGGGTTTTGTACGT");
+		BOOST_CHECK_EQUAL(correct("TAAAACCCCTTNCGT", corrected), CellBarcodesCorrector::CORRECTED);
+		BOOST_CHECK_EQUAL(corrected, "TAAAACCCCTTACGT");
+		BOOST_CHECK_EQUAL(correct("GGAATTTTGTACGT", corrected), CellBarcodesCorrector::NO_MATCH);
+		BOOST_CHECK_EQUAL(correct("GGGATTTTGTACGA", corrected), CellBarcodesCorrector::NO_MATCH);
+		BOOST_CHECK_EQUAL(correct("GGGGTTTTGTACG", corrected), CellBarcodesCorrector::NO_MATCH);
+		BOOST_CHECK_EQUAL(correct("GGGGTTTTNTACGT", corrected), CellBarcodesCorrector::AMBIGUOUS);
+
+		std::string barcode = "GGGATTTT", umi = "ACGTAC", barcode_quality = "IIIIIIII", umi_quality = "IIIIII";
+		Tools::PackedReadParameters params;
+		params.cell_barcode().append(barcode, barcode_quality);
+		params.umi().append(umi, umi_quality);
+		params.complete(0);
+		params.correct_cell_barcode("GGGGTTTT");
+
+		std::string params_line;
+		params.append_to(params_line, "@read");
+		BOOST_CHECK_EQUAL(params_line, "@read GGGGTTTT ACGTAC IIIIIIII IIIIII GGGATTTT");
+		BOOST_CHECK_EQUAL(Tools::ReadParameters::parse_from_string(params_line).second.cell_barcode(), "GGGGTTTT");
+		BOOST_CHECK_EQUAL(Tools::ReadParameters::parse_from_string(params_line).second.umi_quality(), "IIIIII");
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testUnalignedBam, Fixture)
+	{
+		std::string header = UnalignedBamEncoder::header();
+		BOOST_CHECK_EQUAL(header.substr(0, 4), std::string("BAM\1"));
+
+		std::string barcode = "ACGTACGT", umi = "TTGCA", barcode_quality = "IIIIHHHH", umi_quality = "55555";
+		Tools::PackedReadParameters params;
+		params.cell_barcode().append(barcode, barcode_quality);
+		params.umi().append(umi, umi_quality);
+		params.complete(0);
+
+		FastQReader::FastQRecord record("@READ1", "ACGTN", "+", "#+5?I");
+		std::string bam;
+		UnalignedBamEncoder::append_record(record, params, bam);
+
+		int32_t block_size;
+		std::memcpy(&block_size, bam.data(), sizeof(block_size));
+		BOOST_CHECK_EQUAL(block_size, bam.size() - sizeof(block_size));
+		BOOST_CHECK_EQUAL(bam[12], char(6)); // Name length with '\0'
+		BOOST_CHECK_EQUAL(bam.substr(36, 6), std::string("READ1\0", 6));
+		BOOST_CHECK_EQUAL(bam.substr(42, 3), std::string("\x12\x48\xF0")); // ACGTN
+		BOOST_CHECK_EQUAL(bam.substr(45, 5), std::string("\x02\x0A\x14\x1E\x28"));
+		BOOST_CHECK_EQUAL(bam.substr(50), std::string("CBZACGTACGT\0UBZTTGCA\0CYZIIIIHHHH\0UYZ55555\0", 42));
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testLibrariesDemultiplexing, Fixture)
+	{
+		std::vector<std::string> cb1s = {"ACCCCCCA", "CCCCCCCA", "GCCCCCCA", "TCCCCCCA", "ACCCCCCT"};
+		std::vector<std::string> lib_tags = {"AAAAAAAA", "AAAACCCC", "AAAAAAAT", "AAAAAACC", "GGGGGGGG"};
+		std::vector<std::string> read_files;
+		for (size_t file_id = 0; file_id < 4; ++file_id)
+		{
+			read_files.push_back("test_libs_r" + std::to_string(file_id + 1) + ".fastq.gz");
+			std::ofstream gz_out(read_files.back(), std::ios_base::out | std::ios_base::binary);
+			boost::iostreams::filtering_ostream out;
+			out.push(boost::iostreams::gzip_compressor());
+			out.push(gz_out);
+			for (size_t i = 0; i < cb1s.size(); ++i)
+			{
+				std::string seq = (file_id == 0) ? cb1s[i]
+						: (file_id == 1) ? "GTGTGTGTCATCAT"
+						: (file_id == 2) ? "CTGACTGACTGACTGACTGC"
+						: lib_tags[i];
+				out << "@read" << i << "\n" << seq << "\n+\n" << std::string(seq.length(), 'I') << "\n";
+			}
+		}
+
+		boost::property_tree::ptree barcodes_config, processing_config;
+		barcodes_config.put("barcode1_length", 8);
+		barcodes_config.put("barcode2_length", 8);
+		barcodes_config.put("umi_length", 6);
+		barcodes_config.put("r1_rc_length", 8);
+		barcodes_config.put("max_libtag_ed", 2);
+
+		auto make_writer = [](const std::string &name)
+		{ return std::make_shared<ConcurrentGzWriter>(name, "fastq.gz", 0, Z_DEFAULT_COMPRESSION, false); };
+
+		IndropV3LibsTagsFinder finder(read_files, {"AAAAAAAA", "AAAACCCC"}, barcodes_config, processing_config,
+		                              {make_writer("test_libs.l1"), make_writer("test_libs.l2")},
+		                              make_writer("test_libs.unassigned"), true, false);
+		finder.run(1);
+
+		BOOST_REQUIRE_EQUAL(finder.outputs_num(), 3);
+		BOOST_CHECK_EQUAL(finder.output_name(2), "test_libs.unassigned");
+
+		// The 4-th tag is at distance 2 from both libraries, and the 5-th one is far from both
+		BOOST_CHECK_EQUAL(finder.num_reads_per_cb(0).size(), 2);
+		BOOST_CHECK_EQUAL(finder.num_reads_per_cb(0).count("ACCCCCCAGTGTGTGT"), 1);
+		BOOST_CHECK_EQUAL(finder.num_reads_per_cb(0).count("GCCCCCCAGTGTGTGT"), 1);
+		BOOST_CHECK_EQUAL(finder.num_reads_per_cb(1).size(), 1);
+		BOOST_CHECK_EQUAL(finder.num_reads_per_cb(1).count("CCCCCCCAGTGTGTGT"), 1);
+		BOOST_CHECK_EQUAL(finder.num_reads_per_cb(2).size(), 2);
+		BOOST_CHECK_EQUAL(finder.num_reads_per_cb(2).count("TCCCCCCAGTGTGTGT"), 1);
+
+		for (auto const &file : read_files)
+		{
+			std::remove(file.c_str());
+		}
+
+		for (auto const &name : {"test_libs.l1", "test_libs.l2", "test_libs.unassigned"})
+		{
+			std::remove((std::string(name) + ".fastq.gz").c_str());
+		}
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testPipelineThreads, Fixture)
+	{
+		auto read_files = write_indrop_v3_reads("test_pipeline", 23000, 23000); // Several batches of the readers
+
+		boost::property_tree::ptree barcodes_config, processing_config;
+		barcodes_config.put("barcode1_length", 8);
+		barcodes_config.put("barcode2_length", 8);
+		barcodes_config.put("umi_length", 6);
+		barcodes_config.put("r1_rc_length", 8);
+		processing_config.put("min_barcode_quality", 10);
+		processing_config.put("read_uid_seed", 42);
+		processing_config.put("compression_threads", 2);
+
+		std::vector<std::string> stats;
+		std::vector<IndropV3TagsFinder::s_counter_t> reads_per_cb;
+		for (int threads_num : {1, 4})
+		{
+			auto writer = std::make_shared<ConcurrentGzWriter>("test_pipeline." + std::to_string(threads_num), "fastq.gz",
+			                                                   7000, Z_DEFAULT_COMPRESSION, false);
+			IndropV3TagsFinder finder(read_files, barcodes_config, processing_config, writer, true, true);
+			finder.run(threads_num);
+			stats.push_back(finder.results_to_string());
+			reads_per_cb.push_back(finder.num_reads_per_cb());
+		}
+
+		BOOST_CHECK_EQUAL(stats[0], stats[1]);
+		BOOST_CHECK(reads_per_cb[0] == reads_per_cb[1]);
+		BOOST_CHECK_NE(stats[0].find("(23000 reads)"), std::string::npos);
+
+		// Files are split at the same reads, so their contents are the same
+		size_t file_ind = 1;
+		for (; std::ifstream("test_pipeline.1." + std::to_string(file_ind) + ".fastq.gz"); ++file_ind)
+		{
+			auto name1 = "test_pipeline.1." + std::to_string(file_ind) + ".fastq.gz";
+			auto name4 = "test_pipeline.4." + std::to_string(file_ind) + ".fastq.gz";
+			BOOST_CHECK(read_gz(name1) == read_gz(name4));
+			std::remove(name1.c_str());
+			std::remove(name4.c_str());
+		}
+
+		BOOST_CHECK_GT(file_ind, 2);
+		BOOST_CHECK(!std::ifstream("test_pipeline.4." + std::to_string(file_ind) + ".fastq.gz"));
+
+		std::string params1 = read_gz("test_pipeline.1.params.gz"), params4 = read_gz("test_pipeline.4.params.gz");
+		BOOST_CHECK(params1 == params4);
+		BOOST_CHECK_GT(params1.size(), 0);
+
+		for (auto const &name : {"test_pipeline.1.params.gz", "test_pipeline.4.params.gz"})
+		{
+			std::remove(name);
+		}
+
+		for (auto const &file : read_files)
+		{
+			std::remove(file.c_str());
+		}
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testPipelinePrematureEnd, Fixture)
+	{
+		auto read_files = write_indrop_v3_reads("test_premature_end", 12000, 11000);
+
+		boost::property_tree::ptree barcodes_config, processing_config;
+		barcodes_config.put("barcode1_length", 8);
+		barcodes_config.put("barcode2_length", 8);
+		barcodes_config.put("umi_length", 6);
+		barcodes_config.put("r1_rc_length", 8);
+
+		for (int threads_num : {1, 4})
+		{
+			auto writer = std::make_shared<ConcurrentGzWriter>("test_premature_end", "fastq.gz", 0, Z_DEFAULT_COMPRESSION, false);
+			IndropV3TagsFinder finder(read_files, barcodes_config, processing_config, writer, false, true);
+
+			std::string error;
+			try
+			{
+				finder.run(threads_num);
+			}
+			catch (std::runtime_error &err)
+			{
+				error = err.what();
+			}
+
+			BOOST_CHECK_NE(error.find("fastq ended prematurely"), std::string::npos);
+			BOOST_CHECK_NE(error.find(read_files[2]), std::string::npos);
+		}
+
+		std::remove("test_premature_end.fastq.gz");
+		std::remove("test_premature_end.params.gz");
+		for (auto const &file : read_files)
+		{
+			std::remove(file.c_str());
+		}
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testReadsPerCbCounter, Fixture)
+	{
+		const std::string bases = "ACGT";
+		std::vector<std::string> barcodes;
+		for (int i = 0; i < 3000; ++i) // More than the initial table size
+		{
+			std::string barcode;
+			for (int val = i, pos = 0; pos < 8; ++pos, val /= 4)
+			{
+				barcode += bases[val % 4];
+			}
+			barcodes.push_back(barcode);
+		}
+		barcodes.push_back("ACGTNNAC");
+		barcodes.push_back("ACGT.NAC"); // Isn't packed
+
+		ReadsPerCbCounter counter1, counter2;
+		for (size_t i = 0; i < barcodes.size(); ++i)
+		{
+			Tools::PackedTag tag;
+			tag.append(barcodes[i], "");
+			counter1.inc(tag);
+			if (i % 2 == 0)
+			{
+				counter2.inc(tag);
+				counter2.inc(tag);
+			}
+		}
+
+		counter1.merge(counter2);
+		ReadsPerCbCounter::s_counter_t counts;
+		counter1.add_to(counts);
+
+		BOOST_CHECK_EQUAL(counts.size(), barcodes.size());
+		for (size_t i = 0; i < barcodes.size(); ++i)
+		{
+			BOOST_CHECK_EQUAL(counts[barcodes[i]], (i % 2 == 0) ? 3 : 1);
+		}
 	}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -160,5 +624,34 @@ BOOST_AUTO_TEST_SUITE(TestSpacerFinder)
 		BOOST_CHECK_EQUAL(spacer_pos.second, 30);
 	}
 
+	BOOST_FIXTURE_TEST_CASE(testDeletion, Fixture)
+	{
+		std::string r1_line2 = "AGTTAACGGAGTGTTGCTTGTGACGCCTTGTAGACCGTCTTAGGC";
+		auto spacer_pos = spacer_finder.find_spacer(r1_line2);
+		BOOST_CHECK_EQUAL(spacer_pos.first, 8);
+		BOOST_CHECK_EQUAL(spacer_pos.second, 29);
+		BOOST_CHECK_EQUAL(spacer_finder.parse_cell_barcode(r1_line2, spacer_pos.first, spacer_pos.second), "AGTTAACGGTAGACCG");
+		BOOST_CHECK_EQUAL(spacer_finder.parse_umi_barcode(r1_line2, spacer_pos.second), "TCTTAG");
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testInsertion, Fixture)
+	{
+		std::string r1_line2 = "TAGTCTAGGAGTGATTGCTATGTGACGCCTTTCATCCTTATAATATTTTTTTTTTT";
+		auto spacer_pos = spacer_finder.find_spacer(r1_line2);
+		BOOST_CHECK_EQUAL(spacer_pos.first, 8);
+		BOOST_CHECK_EQUAL(spacer_pos.second, 31);
+		BOOST_CHECK_EQUAL(spacer_finder.parse_cell_barcode(r1_line2, spacer_pos.first, spacer_pos.second), "TAGTCTAGTCATCCTT");
+		BOOST_CHECK_EQUAL(spacer_finder.parse_umi_barcode(r1_line2, spacer_pos.second), "ATAATA");
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testPrefixAndSuffix, Fixture)
+	{
+		std::string r1_line2 = "TAGTCTAGGAGTCATTGCTTGTGACGCGTTTCATCCTTATAATATTTTTTTTTTT";
+		auto spacer_pos = spacer_finder.find_spacer(r1_line2);
+		BOOST_CHECK_EQUAL(spacer_pos.first, 8);
+		BOOST_CHECK_EQUAL(spacer_pos.second, 30);
+		BOOST_CHECK_EQUAL(spacer_finder.parse_cell_barcode(r1_line2, spacer_pos.first, spacer_pos.second), "TAGTCTAGTCATCCTT");
+	}
+
 
 BOOST_AUTO_TEST_SUITE_END()
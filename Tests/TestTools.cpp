@@ -1,15 +1,26 @@
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE tests
 
+#include <atomic>
 #include <iostream>
 #include <fstream>
+#include <thread>
 #include <boost/test/unit_test.hpp>
 #include <boost/unordered_map.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
 #include <Tools/ReadParameters.h>
 #include <Tools/GeneAnnotation/RefGenesContainer.h>
 
+#include "Tools/BinaryReadParams.h"
+#include "Tools/BlockingConcurrentQueue.h"
 #include "Tools/GeneAnnotation/GtfRecord.h"
+#include "Tools/GzCompressor.h"
+#include "Tools/PackedReadParameters.h"
 #include "Tools/Logs.h"
+#include "Tools/ParallelGzReader.h"
+#include "Tools/SequenceKernels.h"
 #include "Tools/GeneAnnotation/RefGenesContainer.h"
 #include "Tools/UtilFunctions.h"
 
@@ -51,6 +62,61 @@ BOOST_AUTO_TEST_SUITE(TestTools)
 		BOOST_CHECK_EQUAL(Tools::edit_distance("ATTTTCC", "ATTTGNC", false), 2);
 		BOOST_CHECK_EQUAL(Tools::edit_distance("ATTTTCC", "ATTTGTC"), 2);
 		BOOST_CHECK_EQUAL(Tools::edit_distance("ATTTTCC", "ATTTTCC"), 0);
+
+		BOOST_CHECK_EQUAL(Tools::edit_distance("ATTTTCCGA", 7, "ATTTGNCTT", 7), 1);
+		BOOST_CHECK_EQUAL(Tools::edit_distance("ATTTTCC", "TTTTCCA"), 2);
+		BOOST_CHECK_EQUAL(Tools::edit_distance("", "ACG"), 3);
+		BOOST_CHECK_GT(Tools::edit_distance("AAAAAAAA", "CCCCCCCC", true, 2), 2);
+
+		std::string long_seq(100, 'A'), long_seq2 = long_seq;
+		long_seq2[50] = 'C';
+		long_seq2.insert(10, "G");
+		BOOST_CHECK_EQUAL(Tools::edit_distance(long_seq.c_str(), long_seq2.c_str()), 2);
+		BOOST_CHECK_EQUAL(Tools::edit_distance(long_seq.c_str(), long_seq.c_str(), true, 0), 0);
+		BOOST_CHECK_GT(Tools::edit_distance(long_seq.c_str(), long_seq2.c_str(), true, 1), 1);
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testSequenceKernels, Fixture)
+	{
+		using namespace Tools::Kernels;
+		const Level supported = supported_level();
+		for (int cur_level = SCALAR; cur_level <= supported; ++cur_level)
+		{
+			set_level(Level(cur_level));
+
+			std::string seq = "ACGTNACGTTTGCAAXNGGC" + std::string(70, 'A') + "GT" + std::string(40, 'A') + "NANAA";
+			std::string rc_seq = seq;
+			reverse_complement(&rc_seq[0], rc_seq.length());
+			BOOST_CHECK_EQUAL(rc_seq, "TTNTN" + std::string(40, 'T') + "AC" + std::string(70, 'T') + "GCCNNTTGCAAACGTNACGT");
+
+			BOOST_CHECK_EQUAL(find_run(seq.data(), seq.length(), 'A', 8), 20);
+			BOOST_CHECK_EQUAL(find_run(seq.data(), seq.length(), 'A', 40), 20);
+			BOOST_CHECK_EQUAL(find_run(seq.data(), seq.length(), 'A', 70), 20);
+			BOOST_CHECK_EQUAL(find_run(seq.data(), seq.length(), 'A', 71), std::string::npos);
+			BOOST_CHECK_EQUAL(find_run(seq.data() + 90, seq.length() - 90, 'A', 33), 2);
+			BOOST_CHECK_EQUAL(find_run(seq.data(), 25, 'A', 8), std::string::npos);
+
+			BOOST_CHECK_EQUAL(trailing_run_length(seq.data(), seq.length(), 'A', 'N'), 45);
+			BOOST_CHECK_EQUAL(trailing_run_length(seq.data(), seq.length() - 45, 'A', 'N'), 0);
+			BOOST_CHECK_EQUAL(trailing_run_length(seq.data(), 90, 'A', 'N'), 70);
+
+			std::string quality(100, 'I');
+			quality[77] = '#';
+			BOOST_CHECK_EQUAL(min_value(quality.data(), quality.length()), '#');
+			BOOST_CHECK_EQUAL(min_value(quality.data(), 77), 'I');
+
+			std::string seq2 = seq;
+			seq2[3] = 'N';
+			seq2[50] = 'C';
+			seq2[120] = 'C';
+			BOOST_CHECK_EQUAL(hamming_distance(seq.data(), seq2.data(), seq.length(), true), 2);
+			BOOST_CHECK_EQUAL(hamming_distance(seq.data(), seq2.data(), seq.length(), false), 3);
+
+			BOOST_CHECK(contains_n(seq.data(), seq.length()));
+			BOOST_CHECK(!contains_n(seq.data() + 20, 70));
+		}
+
+		set_level(supported);
 	}
 
 	BOOST_FIXTURE_TEST_CASE(testReadParams, Fixture)
@@ -86,6 +152,43 @@ BOOST_AUTO_TEST_SUITE(TestTools)
 		BOOST_CHECK_THROW(ReadParameters::parse_encoded_id("ATTTG#ATAT"), std::runtime_error);
 	}
 
+	BOOST_FIXTURE_TEST_CASE(testPackedReadParams, Fixture)
+	{
+		boost::string_ref seq = "AAATTNTATAGCTTGG", qual = "QUALCBQUALCB#CCC"; // Quality is stored as views
+		PackedReadParameters params;
+		params.cell_barcode().append(seq.substr(0, 6), qual.substr(0, 6));
+		params.cell_barcode().append(seq.substr(6, 4), qual.substr(6, 4));
+		params.umi().append(seq.substr(12), qual.substr(12));
+		params.complete(0);
+
+		BOOST_CHECK(params.cell_barcode().packed());
+		BOOST_CHECK_EQUAL(params.cell_barcode().sequence(), "AAATTNTATA");
+		BOOST_CHECK_EQUAL(params.cell_barcode().base(5), 'N');
+
+		auto unpacked = params.unpack();
+		BOOST_CHECK_EQUAL(unpacked.cell_barcode_quality(), "QUALCBQUAL");
+		BOOST_CHECK_EQUAL(unpacked.umi(), "TTGG");
+
+		std::string text, encoded_id = "1111";
+		params.append_to(text, "ID");
+		params.append_encoded_id(encoded_id);
+		BOOST_CHECK_EQUAL(text, unpacked.to_string("ID"));
+		BOOST_CHECK_EQUAL(encoded_id, unpacked.encoded_id("1111"));
+
+		params.complete(int('#' - ReadParameters::quality_offset + 1));
+		BOOST_CHECK(!params.pass_quality_threshold());
+
+		std::string long_seq(PackedTag::max_packed_length, 'A');
+		params.clear();
+		BOOST_CHECK(params.is_empty());
+		params.cell_barcode().append(long_seq, long_seq);
+		params.cell_barcode().append("C.", "QQ");
+		BOOST_CHECK(!params.cell_barcode().packed());
+		BOOST_CHECK_EQUAL(params.cell_barcode().sequence(), long_seq + "C.");
+		BOOST_CHECK_EQUAL(params.cell_barcode().quality(), long_seq + "QQ");
+		BOOST_CHECK_THROW(params.complete(0), std::runtime_error);
+	}
+
 	BOOST_FIXTURE_TEST_CASE(testGeneMerge, Fixture)
 	{
 		IntervalsContainer<std::string> intervals;
@@ -295,6 +398,224 @@ BOOST_AUTO_TEST_SUITE(TestTools)
 		BOOST_CHECK_EQUAL(expand_relative_path(source_fname, abs_fname), abs_fname);
 	}
 
+	BOOST_FIXTURE_TEST_CASE(testParallelGzReader, Fixture)
+	{
+		std::ifstream gz_in(this->test_gtf_name, std::ios_base::in | std::ios_base::binary);
+		std::stringstream gz_data, expected;
+		gz_data << gz_in.rdbuf();
+
+		boost::iostreams::filtering_istream decompressed;
+		decompressed.push(boost::iostreams::gzip_decompressor());
+		decompressed.push(gz_data);
+		boost::iostreams::copy(decompressed, expected);
+
+		std::string multi_member_name = "test_multi_member.gz";
+		std::ofstream(multi_member_name, std::ios_base::out | std::ios_base::binary) << gz_data.str() << gz_data.str();
+
+		ParallelGzReader reader(multi_member_name, 4);
+		BOOST_CHECK_EQUAL(reader.format(), ParallelGzReader::GZIP);
+
+		std::string result;
+		char buffer[1000];
+		for (size_t read_size = reader.read(buffer, 1000); read_size != 0; read_size = reader.read(buffer, 1000))
+		{
+			result.append(buffer, read_size);
+		}
+
+		BOOST_CHECK_EQUAL(result, expected.str() + expected.str());
+		std::remove(multi_member_name.c_str());
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testBgzfCompressor, Fixture)
+	{
+		std::string text;
+		for (int i = 0; i < 20000; ++i)
+		{
+			text += "@read" + std::to_string(i) + "\nACGTTGCA" + std::to_string(i * 7919 % 1000) + "\n+\nIIIIIIII\n";
+		}
+
+		std::string compressed;
+		GzCompressor compressor(1, true);
+		compressor.compress(text.substr(0, 1000), compressed);
+		compressor.compress(text.substr(1000), compressed);
+		compressed += GzCompressor::bgzf_eof;
+
+		std::string bgzf_name = "test_bgzf.gz";
+		std::ofstream(bgzf_name, std::ios_base::out | std::ios_base::binary) << compressed;
+
+		for (size_t threads_num : {0, 3}) // Without threads, the blocks are inflated by the consumer
+		{
+			ParallelGzReader reader(bgzf_name, threads_num);
+			BOOST_CHECK_EQUAL(reader.format(), ParallelGzReader::BGZF);
+
+			std::string result;
+			char buffer[100000];
+			for (size_t read_size = reader.read(buffer, 100000); read_size != 0; read_size = reader.read(buffer, 100000))
+			{
+				result.append(buffer, read_size);
+			}
+
+			BOOST_CHECK(result == text);
+		}
+		std::remove(bgzf_name.c_str());
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testBgzfGzipConcatenation, Fixture)
+	{
+		std::ifstream gz_in(this->test_gtf_name, std::ios_base::in | std::ios_base::binary);
+		std::stringstream gz_data, gz_text;
+		gz_data << gz_in.rdbuf();
+
+		boost::iostreams::filtering_istream decompressed;
+		decompressed.push(boost::iostreams::gzip_decompressor());
+		decompressed.push(gz_data);
+		boost::iostreams::copy(decompressed, gz_text);
+
+		std::string bgzf_text;
+		for (int i = 0; i < 50000; ++i)
+		{
+			bgzf_text += "@read" + std::to_string(i) + "\nACGTTGCA\n+\nIIIIIIII\n";
+		}
+
+		// Not compressed BGZF blocks take several chunks of the reader, and a gzip member starts in the middle of a chunk
+		std::string bgzf_data;
+		GzCompressor(0, true).compress(bgzf_text, bgzf_data);
+		bgzf_data += GzCompressor::bgzf_eof;
+
+		std::string mixed_name = "test_mixed.gz";
+		std::ofstream(mixed_name, std::ios_base::out | std::ios_base::binary) << bgzf_data << gz_data.str() << bgzf_data;
+
+		for (size_t threads_num : {0, 4})
+		{
+			ParallelGzReader reader(mixed_name, threads_num);
+			BOOST_CHECK_EQUAL(reader.format(), ParallelGzReader::BGZF);
+
+			std::string result;
+			char buffer[100000];
+			for (size_t read_size = reader.read(buffer, 100000); read_size != 0; read_size = reader.read(buffer, 100000))
+			{
+				result.append(buffer, read_size);
+			}
+
+			BOOST_CHECK(result == bgzf_text + gz_text.str() + bgzf_text);
+			BOOST_CHECK_EQUAL(reader.input_bytes(), 2 * bgzf_data.size() + gz_data.str().size());
+		}
+		std::remove(mixed_name.c_str());
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testBlockingConcurrentQueue, Fixture)
+	{
+		BlockingConcurrentQueue<std::string> queue(10);
+		BOOST_CHECK(queue.push_wait("heavy", 15)); // Heavier than max_size, but the queue is empty
+		BOOST_CHECK_EQUAL(queue.size(), 15);
+
+		std::atomic<bool> pushed(false);
+		std::thread producer([&queue, &pushed]{
+			pushed = queue.push_wait("light", 1);
+		});
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		BOOST_CHECK(!pushed); // Waits while the heavy item is in the queue
+
+		std::string item;
+		BOOST_CHECK(queue.pop_wait(item));
+		BOOST_CHECK_EQUAL(item, "heavy");
+		producer.join();
+		BOOST_CHECK(pushed);
+		BOOST_CHECK_EQUAL(queue.size(), 1);
+
+		BOOST_CHECK(queue.push_wait("last", 9));
+		std::thread blocked_producer([&queue, &pushed]{
+			pushed = queue.push_wait("dropped", 1);
+		});
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		queue.close(); // Wakes up the blocked producer, but keeps the items
+		blocked_producer.join();
+		BOOST_CHECK(!pushed);
+		BOOST_CHECK(!queue.push_wait("after_close", 1));
+
+		BOOST_CHECK(queue.pop_wait(item));
+		BOOST_CHECK_EQUAL(item, "light");
+		BOOST_CHECK(queue.pop_wait(item));
+		BOOST_CHECK_EQUAL(item, "last");
+		BOOST_CHECK(!queue.pop_wait(item));
+		BOOST_CHECK(queue.empty());
+
+		BlockingConcurrentQueue<std::string> empty_queue(1);
+		std::atomic<bool> popped(true);
+		std::thread consumer([&empty_queue, &popped]{
+			std::string consumer_item;
+			popped = empty_queue.pop_wait(consumer_item);
+		});
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		empty_queue.close();
+		consumer.join();
+		BOOST_CHECK(!popped);
+	}
+
+	BOOST_FIXTURE_TEST_CASE(testBinaryReadParams, Fixture)
+	{
+		std::vector<std::string> cbs = {"AAACGTNTAC", "CCGGTTAA", "GTACN"}, umis = {"TTGGC", "NNACG", "AAAAA"};
+		std::vector<std::string> cb_quals = {"IIIII#IIII", "IIIIIIII", "55555"}, umi_quals = {"ABCDE", "##IIA", "IIIII"};
+		std::vector<long> read_numbers = {7, 3, 1000000007};
+
+		BinaryReadParams::BlockBuilder block;
+		for (size_t i = 0; i < cbs.size(); ++i)
+		{
+			PackedReadParameters params;
+			params.cell_barcode().append(cbs[i], cb_quals[i]);
+			params.umi().append(umis[i], umi_quals[i]);
+			params.complete(0);
+			if (i == 1)
+			{
+				params.correct_cell_barcode("CCGGTTAT");
+			}
+			block.add(read_numbers[i], params);
+		}
+		BOOST_CHECK_EQUAL(block.size(), 3);
+
+		std::string content = BinaryReadParams::file_header("ABCD"), compressed;
+		block.append_to(content);
+		GzCompressor(Z_DEFAULT_COMPRESSION, true).compress(content, compressed);
+		compressed += GzCompressor::bgzf_eof;
+
+		std::string file_name = "test_params.bin";
+		std::ofstream(file_name, std::ios_base::out | std::ios_base::binary) << compressed;
+		BOOST_CHECK(BinaryReadParams::is_binary_file(file_name));
+
+		BinaryReadParams::Reader reader(file_name, 2);
+		BOOST_CHECK_EQUAL(reader.read_name_prefix(), "ABCD");
+
+		std::vector<BinaryReadParams::Record> records;
+		BOOST_REQUIRE(reader.next_block(records));
+		BOOST_REQUIRE_EQUAL(records.size(), 3);
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			BOOST_CHECK_EQUAL(records[i].read_number, read_numbers[i]);
+			BOOST_CHECK_EQUAL(records[i].cell_barcode, (i == 1) ? "CCGGTTAT" : cbs[i]);
+			BOOST_CHECK_EQUAL(records[i].umi, umis[i]);
+			BOOST_CHECK_EQUAL(records[i].umi_quality, umi_quals[i]);
+			BOOST_CHECK_EQUAL(records[i].raw_cell_barcode, (i == 1) ? cbs[i] : "");
+
+			// The minimal cell barcode quality gives the same threshold check as the full quality string
+			for (int min_quality : {0, 2, 10, 20, 40})
+			{
+				auto expected = ReadParameters(records[i].cell_barcode, umis[i], cb_quals[i], umi_quals[i], min_quality);
+				BOOST_CHECK_EQUAL(records[i].parameters(min_quality).pass_quality_threshold(), expected.pass_quality_threshold());
+			}
+		}
+
+		BOOST_CHECK(!reader.next_block(records));
+		std::remove(file_name.c_str());
+
+		std::ofstream(file_name) << "@read1 AAAA CCCC IIII IIII\n";
+		BOOST_CHECK(!BinaryReadParams::is_binary_file(file_name));
+		BOOST_CHECK_THROW(BinaryReadParams::Reader(file_name, 1), std::runtime_error);
+		std::remove(file_name.c_str());
+	}
+
 //	BOOST_FIXTURE_TEST_CASE(testGtfPerformance, Fixture) //Uncomment to print performance
 //	{
 //		init_test_logs(boost::log::trivial::info);
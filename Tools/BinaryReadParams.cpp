@@ -0,0 +1,353 @@
+#include "BinaryReadParams.h"
+#include "SequenceKernels.h"
+
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+namespace Tools
+{
+	namespace
+	{
+		template<typename T>
+		void append_value(T value, std::string &out)
+		{
+			out.append(reinterpret_cast<const char*>(&value), sizeof(value)); // Little-endian, as the supported platforms
+		}
+
+		void append_varint(uint64_t value, std::string &out)
+		{
+			while (value >= 0x80)
+			{
+				out.push_back(char((value & 0x7f) | 0x80));
+				value >>= 7;
+			}
+			out.push_back(char(value));
+		}
+
+		void append_length(size_t length, std::string &out)
+		{
+			if (length > UCHAR_MAX)
+				throw std::runtime_error("Tag is too long for binary read parameters: " + std::to_string(length));
+
+			out.push_back(char(length));
+		}
+
+		int base_code(char base)
+		{
+			switch (base)
+			{
+				case 'A': return 0;
+				case 'C': return 1;
+				case 'G': return 2;
+				case 'T': return 3;
+				default: return -1;
+			}
+		}
+
+		// Sequential reading of a block with bounds checks
+		class BlockCursor
+		{
+		private:
+			const char *_data;
+			size_t _size;
+			size_t _pos;
+
+		public:
+			BlockCursor(const char *data, size_t size)
+				: _data(data)
+				, _size(size)
+				, _pos(0)
+			{}
+
+			const char* take(size_t size)
+			{
+				if (size > this->_size - this->_pos)
+					throw std::runtime_error("Binary read parameters block is corrupted");
+
+				const char *res = this->_data + this->_pos;
+				this->_pos += size;
+				return res;
+			}
+
+			uint64_t varint()
+			{
+				uint64_t value = 0;
+				for (int shift = 0; shift < 64; shift += 7)
+				{
+					auto byte = uint8_t(*this->take(1));
+					value |= uint64_t(byte & 0x7f) << shift;
+					if (!(byte & 0x80))
+						return value;
+				}
+
+				throw std::runtime_error("Binary read parameters block is corrupted");
+			}
+
+			bool finished() const
+			{
+				return this->_pos == this->_size;
+			}
+		};
+
+		// Unpacks bases of all reads of the column into the given member of records
+		void read_bases(BlockCursor &cursor, const std::vector<uint8_t> &lengths,
+		                std::vector<BinaryReadParams::Record> &records, std::string BinaryReadParams::Record::*field)
+		{
+			static const char bases[] = "ACGT";
+
+			size_t bases_num = 0;
+			for (auto length : lengths)
+			{
+				bases_num += length;
+			}
+
+			const char *packed = cursor.take((bases_num + 3) / 4);
+			size_t base_ind = 0;
+			for (size_t i = 0; i < records.size(); ++i)
+			{
+				std::string &out = records[i].*field;
+				out.resize(lengths[i]);
+				for (size_t pos = 0; pos < lengths[i]; ++pos, ++base_ind)
+				{
+					out[pos] = bases[(uint8_t(packed[base_ind / 4]) >> ((base_ind % 4) * 2)) & 3];
+				}
+			}
+
+			uint64_t exceptions_num = cursor.varint();
+			size_t exception_pos = 0, read_ind = 0, read_start = 0;
+			for (uint64_t i = 0; i < exceptions_num; ++i)
+			{
+				exception_pos += cursor.varint();
+				char symbol = *cursor.take(1);
+				while (read_ind < records.size() && exception_pos >= read_start + lengths[read_ind])
+				{
+					read_start += lengths[read_ind++];
+				}
+
+				if (read_ind == records.size())
+					throw std::runtime_error("Binary read parameters block is corrupted");
+
+				(records[read_ind].*field)[exception_pos - read_start] = symbol;
+			}
+		}
+	}
+
+	const std::string BinaryReadParams::magic = "DTRP";
+	const uint32_t BinaryReadParams::version;
+
+	std::string BinaryReadParams::file_header(const std::string &read_name_prefix)
+	{
+		std::string res = BinaryReadParams::magic;
+		append_value(BinaryReadParams::version, res);
+		append_value(uint32_t(read_name_prefix.length()), res);
+		res += read_name_prefix;
+		return res;
+	}
+
+	bool BinaryReadParams::is_binary_file(const std::string &filename)
+	{
+		ParallelGzReader reader(filename, 1);
+		std::string start(BinaryReadParams::magic.length(), '\0');
+		return reader.read(&start[0], start.length()) == start.length() && start == BinaryReadParams::magic;
+	}
+
+	ReadParameters BinaryReadParams::Record::parameters(int min_quality) const
+	{
+		bool pass_quality_threshold = true;
+		if (min_quality > 0)
+		{
+			const int min_value = min_quality + ReadParameters::quality_offset;
+			pass_quality_threshold = this->min_cell_barcode_quality >= min_value &&
+					Kernels::min_value(this->umi_quality.data(), this->umi_quality.length()) >= min_value;
+		}
+
+		return ReadParameters(this->cell_barcode, this->umi, "", this->umi_quality, pass_quality_threshold);
+	}
+
+	void BinaryReadParams::BlockBuilder::BasesColumn::add(const std::string &bases)
+	{
+		for (char base : bases)
+		{
+			if (this->bases_num % 4 == 0)
+			{
+				this->packed.push_back('\0');
+			}
+
+			int code = base_code(base);
+			if (code < 0)
+			{
+				append_varint(this->bases_num - this->last_exception_pos, this->exceptions);
+				this->exceptions.push_back(base);
+				this->last_exception_pos = this->bases_num;
+				this->exceptions_num++;
+				code = 0;
+			}
+
+			this->packed.back() |= char(code << ((this->bases_num % 4) * 2));
+			this->bases_num++;
+		}
+	}
+
+	void BinaryReadParams::BlockBuilder::BasesColumn::append_to(std::string &out) const
+	{
+		out += this->packed;
+		append_varint(this->exceptions_num, out);
+		out += this->exceptions;
+	}
+
+	BinaryReadParams::BlockBuilder::BlockBuilder()
+		: _reads_num(0)
+		, _last_read_number(0)
+	{}
+
+	void BinaryReadParams::BlockBuilder::add(long read_number, const PackedReadParameters &params)
+	{
+		// Zigzag encoding of the difference from the previous read
+		long diff = read_number - this->_last_read_number;
+		append_varint((uint64_t(diff) << 1) ^ uint64_t(diff >> (sizeof(long) * 8 - 1)), this->_read_numbers);
+		this->_last_read_number = read_number;
+
+		this->_buffer.clear();
+		params.cell_barcode().append_sequence_to(this->_buffer);
+		append_length(this->_buffer.length(), this->_cell_barcode_lengths);
+		this->_cell_barcodes.add(this->_buffer);
+
+		this->_buffer.clear();
+		params.umi().append_sequence_to(this->_buffer);
+		append_length(this->_buffer.length(), this->_umi_lengths);
+		this->_umis.add(this->_buffer);
+
+		this->_buffer.clear();
+		params.cell_barcode().append_quality_to(this->_buffer);
+		this->_min_cell_barcode_qualities.push_back(Kernels::min_value(this->_buffer.data(), this->_buffer.length()));
+
+		params.umi().append_quality_to(this->_umi_qualities);
+
+		append_length(params.raw_cell_barcode().length(), this->_raw_cell_barcode_lengths);
+		this->_raw_cell_barcodes += params.raw_cell_barcode();
+
+		this->_reads_num++;
+	}
+
+	void BinaryReadParams::BlockBuilder::append_to(std::string &out) const
+	{
+		if (this->_reads_num == 0)
+			return;
+
+		append_value(this->_reads_num, out);
+		size_t size_pos = out.size();
+		append_value(uint32_t(0), out); // Payload size, which is filled at the end
+
+		out += this->_read_numbers;
+		out += this->_cell_barcode_lengths;
+		out += this->_umi_lengths;
+		out += this->_raw_cell_barcode_lengths;
+		out += this->_min_cell_barcode_qualities;
+		this->_cell_barcodes.append_to(out);
+		this->_umis.append_to(out);
+		out += this->_umi_qualities;
+		out += this->_raw_cell_barcodes;
+
+		auto payload_size = uint32_t(out.size() - size_pos - sizeof(uint32_t));
+		std::memcpy(&out[size_pos], &payload_size, sizeof(payload_size));
+	}
+
+	uint32_t BinaryReadParams::BlockBuilder::size() const
+	{
+		return this->_reads_num;
+	}
+
+	BinaryReadParams::Reader::Reader(const std::string &filename, size_t threads_num)
+		: _filename(filename)
+		, _in_reader(filename, threads_num)
+	{
+		char header[12];
+		if (!this->read_exactly(header, sizeof(header)) ||
+				std::string(header, BinaryReadParams::magic.length()) != BinaryReadParams::magic)
+			throw std::runtime_error("File '" + filename + "' doesn't contain binary read parameters");
+
+		uint32_t file_version, prefix_length;
+		std::memcpy(&file_version, header + 4, sizeof(file_version));
+		std::memcpy(&prefix_length, header + 8, sizeof(prefix_length));
+		if (file_version > BinaryReadParams::version)
+			throw std::runtime_error("File '" + filename + "' has unsupported version of binary read parameters: " +
+			                         std::to_string(file_version));
+
+		this->_read_name_prefix.resize(prefix_length);
+		if (prefix_length > 0 && !this->read_exactly(&this->_read_name_prefix[0], prefix_length))
+			throw std::runtime_error("File '" + filename + "' ended prematurely");
+	}
+
+	bool BinaryReadParams::Reader::read_exactly(char *buffer, size_t size)
+	{
+		size_t read_size = this->_in_reader.read(buffer, size);
+		if (read_size == 0)
+			return false;
+
+		if (read_size != size)
+			throw std::runtime_error("File '" + this->_filename + "' ended prematurely");
+
+		return true;
+	}
+
+	const std::string& BinaryReadParams::Reader::read_name_prefix() const
+	{
+		return this->_read_name_prefix;
+	}
+
+	bool BinaryReadParams::Reader::next_block(std::vector<Record> &records)
+	{
+		char header[8];
+		if (!this->read_exactly(header, sizeof(header)))
+			return false;
+
+		uint32_t reads_num, payload_size;
+		std::memcpy(&reads_num, header, sizeof(reads_num));
+		std::memcpy(&payload_size, header + 4, sizeof(payload_size));
+
+		this->_block.resize(payload_size);
+		if (payload_size > 0 && !this->read_exactly(this->_block.data(), payload_size))
+			throw std::runtime_error("File '" + this->_filename + "' ended prematurely");
+
+		BlockCursor cursor(this->_block.data(), this->_block.size());
+		records.resize(reads_num);
+
+		long read_number = 0;
+		for (auto &record : records)
+		{
+			uint64_t zigzag = cursor.varint();
+			read_number += long(zigzag >> 1) ^ -long(zigzag & 1);
+			record.read_number = read_number;
+		}
+
+		std::vector<uint8_t> cb_lengths(reads_num), umi_lengths(reads_num), raw_cb_lengths(reads_num);
+		std::memcpy(cb_lengths.data(), cursor.take(reads_num), reads_num);
+		std::memcpy(umi_lengths.data(), cursor.take(reads_num), reads_num);
+		std::memcpy(raw_cb_lengths.data(), cursor.take(reads_num), reads_num);
+
+		const char *min_qualities = cursor.take(reads_num);
+		for (size_t i = 0; i < reads_num; ++i)
+		{
+			records[i].min_cell_barcode_quality = min_qualities[i];
+		}
+
+		read_bases(cursor, cb_lengths, records, &Record::cell_barcode);
+		read_bases(cursor, umi_lengths, records, &Record::umi);
+
+		for (size_t i = 0; i < reads_num; ++i)
+		{
+			records[i].umi_quality.assign(cursor.take(umi_lengths[i]), umi_lengths[i]);
+		}
+
+		for (size_t i = 0; i < reads_num; ++i)
+		{
+			records[i].raw_cell_barcode.assign(cursor.take(raw_cb_lengths[i]), raw_cb_lengths[i]);
+		}
+
+		if (!cursor.finished())
+			throw std::runtime_error("File '" + this->_filename + "': binary read parameters block is corrupted");
+
+		return true;
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "PackedReadParameters.h"
+#include "ParallelGzReader.h"
+#include "ReadParameters.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Tools
+{
+	// Versioned binary alternative to the text params file. Content is BGZF-compressed, so it's inflated on several
+	// threads. It starts with a header (magic, version and prefix of the read names), followed by blocks of reads.
+	// Each block stores its columns separately: read numbers, lengths, 2-bit packed barcodes and UMIs, minimal cell
+	// barcode quality (the only one, which is used after droptag), UMI qualities and raw cell barcodes.
+	class BinaryReadParams
+	{
+	public:
+		static const std::string magic;
+		static const uint32_t version = 1;
+
+		struct Record
+		{
+			long read_number;
+			std::string cell_barcode;
+			std::string umi;
+			std::string umi_quality;
+			std::string raw_cell_barcode;
+			char min_cell_barcode_quality;
+
+			ReadParameters parameters(int min_quality) const;
+		};
+
+		// Collects columns of reads of a single block
+		class BlockBuilder
+		{
+		private:
+			struct BasesColumn
+			{
+				std::string packed;
+				std::string exceptions; // Positions and symbols of non-ACGT bases
+				size_t bases_num = 0;
+				size_t exceptions_num = 0;
+				size_t last_exception_pos = 0;
+
+				void add(const std::string &bases);
+				void append_to(std::string &out) const;
+			};
+
+			uint32_t _reads_num;
+			long _last_read_number;
+			std::string _read_numbers;
+			std::string _cell_barcode_lengths;
+			std::string _umi_lengths;
+			std::string _raw_cell_barcode_lengths;
+			std::string _min_cell_barcode_qualities;
+			BasesColumn _cell_barcodes;
+			BasesColumn _umis;
+			std::string _umi_qualities;
+			std::string _raw_cell_barcodes;
+
+			std::string _buffer;
+
+		public:
+			BlockBuilder();
+
+			void add(long read_number, const PackedReadParameters &params);
+			void append_to(std::string &out) const;
+			uint32_t size() const;
+		};
+
+		class Reader
+		{
+		private:
+			const std::string _filename;
+			ParallelGzReader _in_reader;
+			std::string _read_name_prefix;
+			std::vector<char> _block;
+
+		private:
+			bool read_exactly(char *buffer, size_t size);
+
+		public:
+			Reader(const std::string &filename, size_t threads_num);
+
+			const std::string& read_name_prefix() const;
+			bool next_block(std::vector<Record> &records);
+		};
+
+	public:
+		static std::string file_header(const std::string &read_name_prefix);
+		static bool is_binary_file(const std::string &filename);
+	};
+}
@@ -1,66 +1,129 @@
 #pragma once
 
+#include <condition_variable>
 #include <cstddef>
 #include <queue>
 #include <mutex>
 #include <atomic>
+#include <utility>
 
 #include "Logs.h"
 
 namespace Tools
 {
+	// Multi-producer multi-consumer queue. Size of the queue is measured as the total weight of its items
+	// (by default, each item weights 1). push_wait() blocks while the queue is full and pop_wait() blocks while
+	// it's empty, until close() is called.
 	template <typename T>
 	class BlockingConcurrentQueue
 	{
 	private:
 		using mutex_t = std::mutex;
-		using lock_t = std::lock_guard<mutex_t>;
+		using lock_t = std::unique_lock<mutex_t>;
 
 	private:
-		std::queue<T> _queue;
-		std::mutex _lock;
+		std::queue<std::pair<T, size_t>> _queue;
+		mutex_t _lock;
+		std::condition_variable _not_empty;
+		std::condition_variable _not_full;
 
 		std::atomic<size_t> _size;
 		const size_t _max_size;
+		bool _closed;
 
 	public:
 		BlockingConcurrentQueue(size_t max_size)
 			: _queue()
 			, _size(0)
 			, _max_size(max_size)
+			, _closed(false)
 		{}
 
 		bool pop(T& item)
 		{
 			lock_t l(this->_lock);
 
-			if (this->_size == 0)
+			if (this->_queue.empty())
 				return false;
 
-			item = this->_queue.front();
-			this->_queue.pop();
-			this->_size--;
+			this->pop_unsafe(item);
+			l.unlock();
 
+			this->_not_full.notify_all();
 			return true;
 		}
 
-		void push(const T& item)
+		// Returns false if the queue is closed and empty
+		bool pop_wait(T& item)
 		{
 			lock_t l(this->_lock);
+			this->_not_empty.wait(l, [this]{ return this->_closed || !this->_queue.empty(); });
+
+			if (this->_queue.empty())
+				return false;
+
+			this->pop_unsafe(item);
+			l.unlock();
+
+			this->_not_full.notify_all();
+			return true;
+		}
+
+		void push(const T& item, size_t weight = 1)
+		{
+			lock_t l(this->_lock);
+
+			this->_queue.emplace(item, weight);
+			this->_size += weight;
+			l.unlock();
+
+			this->_not_empty.notify_one();
+		}
+
+		void push(T&& item, size_t weight = 1)
+		{
+			lock_t l(this->_lock);
+
+			this->_queue.emplace(std::move(item), weight);
+			this->_size += weight;
+			l.unlock();
 
-			this->_queue.push(item);
-			this->_size++;
+			this->_not_empty.notify_one();
 		}
 
-		void push(T&& item)
+		// Item is always accepted by an empty queue, so items heavier than max_size don't block forever.
+		// Returns false if the queue is closed.
+		bool push_wait(T&& item, size_t weight = 1)
 		{
 			lock_t l(this->_lock);
+			this->_not_full.wait(l, [this, weight]{
+				return this->_closed || this->_queue.empty() || this->_size + weight <= this->_max_size;
+			});
 
-			this->_queue.push(std::move(item));
-			this->_size++;
+			if (this->_closed)
+				return false;
+
+			this->_queue.emplace(std::move(item), weight);
+			this->_size += weight;
+			l.unlock();
+
+			this->_not_empty.notify_one();
+			return true;
 		}
 
-		bool full() const // shouldn't block the queue. It's just a suggested size.
+		// Wakes up all waiting threads. Items, which are already in the queue, still can be popped.
+		void close()
+		{
+			{
+				lock_t l(this->_lock);
+				this->_closed = true;
+			}
+
+			this->_not_empty.notify_all();
+			this->_not_full.notify_all();
+		}
+
+		bool full() const
 		{
 			return this->_size >= this->_max_size;
 		}
@@ -69,6 +132,19 @@ namespace Tools
 		{
 			return this->_size == 0;
 		}
+
+		// Total weight of the items
+		size_t size() const
+		{
+			return this->_size;
+		}
+
+	private:
+		void pop_unsafe(T& item)
+		{
+			item = std::move(this->_queue.front().first);
+			this->_size -= this->_queue.front().second;
+			this->_queue.pop();
+		}
 	};
 }
-
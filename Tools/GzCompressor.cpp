@@ -0,0 +1,107 @@
+#include "GzCompressor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace Tools
+{
+	const std::string GzCompressor::bgzf_eof("\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43\x02\x00\x1b\x00"
+	                                         "\x03\x00\x00\x00\x00\x00\x00\x00\x00\x00", 28);
+	const size_t GzCompressor::bgzf_max_input_size = 0xff00;
+	const size_t GzCompressor::bgzf_max_block_size = 0x10000;
+
+	GzCompressor::GzCompressor(int level, bool bgzf)
+		: _bgzf(bgzf)
+	{
+		std::memset(&this->_stream, 0, sizeof(this->_stream));
+		std::memset(&this->_stored_stream, 0, sizeof(this->_stored_stream));
+
+		if (deflateInit2(&this->_stream, level, Z_DEFLATED, bgzf ? -MAX_WBITS : MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			throw std::runtime_error("Can't initialize zlib with compression level " + std::to_string(level));
+
+		if (bgzf && deflateInit2(&this->_stored_stream, 0, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			deflateEnd(&this->_stream);
+			throw std::runtime_error("Can't initialize zlib");
+		}
+	}
+
+	GzCompressor::~GzCompressor()
+	{
+		deflateEnd(&this->_stream);
+		if (this->_bgzf)
+		{
+			deflateEnd(&this->_stored_stream);
+		}
+	}
+
+	bool GzCompressor::bgzf() const
+	{
+		return this->_bgzf;
+	}
+
+	void GzCompressor::deflate_all(z_stream &stream, const char *text, size_t size, std::string &out)
+	{
+		deflateReset(&stream);
+
+		size_t out_start = out.size();
+		size_t bound = deflateBound(&stream, uLong(size));
+		out.resize(out_start + bound);
+
+		stream.next_in = (Bytef*)text;
+		stream.avail_in = uInt(size);
+		stream.next_out = (Bytef*)&out[out_start];
+		stream.avail_out = uInt(bound);
+
+		if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+			throw std::runtime_error("Can't compress data with zlib");
+
+		out.resize(out_start + bound - stream.avail_out);
+	}
+
+	void GzCompressor::compress_bgzf_block(const char *text, size_t size, std::string &out)
+	{
+		// gzip member with 'BC' extra subfield, which stores the total block size minus 1
+		static const std::string header("\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43\x02\x00\x00\x00", 18);
+
+		size_t block_start = out.size();
+		out.append(header);
+
+		this->deflate_all(this->_stream, text, size, out);
+		if (out.size() - block_start + 8 > GzCompressor::bgzf_max_block_size)
+		{
+			out.resize(block_start + header.size());
+			this->deflate_all(this->_stored_stream, text, size, out);
+		}
+
+		uLong crc = crc32(crc32(0L, Z_NULL, 0), (const Bytef*)text, uInt(size));
+		for (int i = 0; i < 4; ++i)
+		{
+			out.push_back(char((crc >> (8 * i)) & 0xff));
+		}
+
+		for (int i = 0; i < 4; ++i)
+		{
+			out.push_back(char((size >> (8 * i)) & 0xff));
+		}
+
+		size_t block_size = out.size() - block_start - 1;
+		out[block_start + 16] = char(block_size & 0xff);
+		out[block_start + 17] = char((block_size >> 8) & 0xff);
+	}
+
+	void GzCompressor::compress(const std::string &text, std::string &out)
+	{
+		if (!this->_bgzf)
+		{
+			this->deflate_all(this->_stream, text.data(), text.size(), out);
+			return;
+		}
+
+		for (size_t start = 0; start < text.size(); start += GzCompressor::bgzf_max_input_size)
+		{
+			this->compress_bgzf_block(text.data() + start, std::min(GzCompressor::bgzf_max_input_size, text.size() - start), out);
+		}
+	}
+}
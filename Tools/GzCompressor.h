@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+#include <zlib.h>
+
+namespace Tools
+{
+	// Keeps deflate state between calls, so it's initialized only once.
+	// Each call produces either a single gzip member or a sequence of BGZF blocks. Both can be concatenated.
+	class GzCompressor
+	{
+	public:
+		static const std::string bgzf_eof;
+
+	private:
+		static const size_t bgzf_max_input_size;
+		static const size_t bgzf_max_block_size;
+
+		const bool _bgzf;
+		z_stream _stream;
+		z_stream _stored_stream; // Level 0 fallback for BGZF blocks, which can't be compressed enough
+
+	private:
+		void deflate_all(z_stream &stream, const char *text, size_t size, std::string &out);
+		void compress_bgzf_block(const char *text, size_t size, std::string &out);
+
+	public:
+		GzCompressor(int level = Z_DEFAULT_COMPRESSION, bool bgzf = false);
+		~GzCompressor();
+
+		GzCompressor(const GzCompressor&) = delete;
+		GzCompressor& operator=(const GzCompressor&) = delete;
+
+		void compress(const std::string &text, std::string &out);
+		bool bgzf() const;
+	};
+}
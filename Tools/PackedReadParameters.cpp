@@ -0,0 +1,325 @@
+#include "PackedReadParameters.h"
+#include "SequenceKernels.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Tools
+{
+	PackedTag::PackedTag()
+	{
+		this->clear();
+	}
+
+	int PackedTag::base_code(char base)
+	{
+		switch (base)
+		{
+			case 'A': return 0;
+			case 'C': return 1;
+			case 'G': return 2;
+			case 'T': return 3;
+			case 'N': return 4;
+			default: return -1;
+		}
+	}
+
+	void PackedTag::clear()
+	{
+		std::fill(std::begin(this->_key.bases), std::end(this->_key.bases), 0);
+		this->_key.n_mask = 0;
+		this->_key.length = 0;
+		this->_quality_parts_num = 0;
+		this->_packed = true;
+		this->_sequence_text.clear();
+		this->_quality_text.clear();
+	}
+
+	void PackedTag::unpack()
+	{
+		this->_sequence_text = this->sequence();
+		this->_quality_text = this->quality();
+		this->_packed = false;
+	}
+
+	bool PackedTag::can_pack(const boost::string_ref &sequence)
+	{
+		return std::all_of(sequence.begin(), sequence.end(), [](char c){ return PackedTag::base_code(c) >= 0; });
+	}
+
+	void PackedTag::pack(const boost::string_ref &sequence)
+	{
+		for (char c : sequence)
+		{
+			int code = PackedTag::base_code(c);
+			if (code == 4)
+			{
+				this->_key.n_mask |= uint64_t(1) << this->_key.length;
+			}
+			else
+			{
+				this->_key.bases[this->_key.length / 32] |= uint64_t(code) << (2 * (this->_key.length % 32));
+			}
+			this->_key.length++;
+		}
+	}
+
+	void PackedTag::append(const boost::string_ref &sequence, const boost::string_ref &quality)
+	{
+		if (this->_packed && (this->_key.length + sequence.length() > PackedTag::max_packed_length ||
+				this->_quality_parts_num == PackedTag::max_quality_parts || !PackedTag::can_pack(sequence)))
+		{
+			this->unpack();
+		}
+
+		if (!this->_packed)
+		{
+			this->_sequence_text.append(sequence.data(), sequence.length());
+			this->_quality_text.append(quality.data(), quality.length());
+			return;
+		}
+
+		this->pack(sequence);
+
+		if (!quality.empty())
+		{
+			this->_quality_parts[this->_quality_parts_num++] = quality;
+		}
+	}
+
+	void PackedTag::replace_sequence(const std::string &sequence)
+	{
+		if (sequence.length() != this->length())
+			throw std::runtime_error("Can't replace sequence '" + this->sequence() + "' with '" + sequence +
+			                         "' of different length");
+
+		if (this->_packed && PackedTag::can_pack(sequence))
+		{
+			std::fill(std::begin(this->_key.bases), std::end(this->_key.bases), 0);
+			this->_key.n_mask = 0;
+			this->_key.length = 0;
+			this->pack(sequence);
+			return;
+		}
+
+		if (this->_packed)
+		{
+			this->unpack();
+		}
+
+		this->_sequence_text = sequence;
+	}
+
+	bool PackedTag::Key::operator==(const Key &other) const
+	{
+		return this->length == other.length && this->n_mask == other.n_mask &&
+		       std::equal(std::begin(this->bases), std::end(this->bases), std::begin(other.bases));
+	}
+
+	char PackedTag::Key::base(size_t pos) const
+	{
+		static const char bases[] = "ACGT";
+		if ((this->n_mask >> pos) & 1)
+			return 'N';
+
+		return bases[(this->bases[pos / 32] >> (2 * (pos % 32))) & 3];
+	}
+
+	std::string PackedTag::Key::sequence() const
+	{
+		std::string res(this->length, 'N');
+		for (size_t pos = 0; pos < this->length; ++pos)
+		{
+			res[pos] = this->base(pos);
+		}
+
+		return res;
+	}
+
+	char PackedTag::base(size_t pos) const
+	{
+		if (!this->_packed)
+			return this->_sequence_text.at(pos);
+
+		return this->_key.base(pos);
+	}
+
+	size_t PackedTag::length() const
+	{
+		return this->_packed ? this->_key.length : this->_sequence_text.length();
+	}
+
+	bool PackedTag::empty() const
+	{
+		return this->length() == 0;
+	}
+
+	bool PackedTag::packed() const
+	{
+		return this->_packed;
+	}
+
+	const PackedTag::Key& PackedTag::key() const
+	{
+		return this->_key;
+	}
+
+	bool PackedTag::check_quality(int min_quality) const
+	{
+		const int min_value = min_quality + ReadParameters::quality_offset;
+		if (!this->_packed)
+			return Kernels::min_value(this->_quality_text.data(), this->_quality_text.length()) >= min_value;
+
+		for (size_t i = 0; i < this->_quality_parts_num; ++i)
+		{
+			if (Kernels::min_value(this->_quality_parts[i].data(), this->_quality_parts[i].length()) < min_value)
+				return false;
+		}
+
+		return true;
+	}
+
+	void PackedTag::append_sequence_to(std::string &out) const
+	{
+		if (!this->_packed)
+		{
+			out += this->_sequence_text;
+			return;
+		}
+
+		for (size_t i = 0; i < this->_key.length; ++i)
+		{
+			out.push_back(this->base(i));
+		}
+	}
+
+	void PackedTag::append_quality_to(std::string &out) const
+	{
+		if (!this->_packed)
+		{
+			out += this->_quality_text;
+			return;
+		}
+
+		for (size_t i = 0; i < this->_quality_parts_num; ++i)
+		{
+			out.append(this->_quality_parts[i].data(), this->_quality_parts[i].length());
+		}
+	}
+
+	std::string PackedTag::sequence() const
+	{
+		std::string res;
+		this->append_sequence_to(res);
+		return res;
+	}
+
+	std::string PackedTag::quality() const
+	{
+		std::string res;
+		this->append_quality_to(res);
+		return res;
+	}
+
+	PackedReadParameters::PackedReadParameters()
+		: _pass_quality_threshold(false)
+		, _is_empty(true)
+	{}
+
+	void PackedReadParameters::clear()
+	{
+		this->_cell_barcode.clear();
+		this->_umi.clear();
+		this->_raw_cell_barcode.clear();
+		this->_pass_quality_threshold = false;
+		this->_is_empty = true;
+	}
+
+	void PackedReadParameters::complete(int min_quality)
+	{
+		if (this->_cell_barcode.empty() || this->_umi.empty())
+			throw std::runtime_error("Wrong read parameters: '" + this->_cell_barcode.sequence() + "' '" +
+			                         this->_umi.sequence() + "'");
+
+		this->_pass_quality_threshold = min_quality <= 0 ||
+				(this->_cell_barcode.check_quality(min_quality) && this->_umi.check_quality(min_quality));
+		this->_is_empty = false;
+	}
+
+	void PackedReadParameters::correct_cell_barcode(const std::string &cell_barcode)
+	{
+		this->_raw_cell_barcode = this->_cell_barcode.sequence();
+		this->_cell_barcode.replace_sequence(cell_barcode);
+	}
+
+	const std::string& PackedReadParameters::raw_cell_barcode() const
+	{
+		return this->_raw_cell_barcode;
+	}
+
+	PackedTag& PackedReadParameters::cell_barcode()
+	{
+		return this->_cell_barcode;
+	}
+
+	PackedTag& PackedReadParameters::umi()
+	{
+		return this->_umi;
+	}
+
+	const PackedTag& PackedReadParameters::cell_barcode() const
+	{
+		return this->_cell_barcode;
+	}
+
+	const PackedTag& PackedReadParameters::umi() const
+	{
+		return this->_umi;
+	}
+
+	bool PackedReadParameters::pass_quality_threshold() const
+	{
+		return this->_pass_quality_threshold;
+	}
+
+	bool PackedReadParameters::is_empty() const
+	{
+		return this->_is_empty;
+	}
+
+	void PackedReadParameters::append_to(std::string &out, const std::string &read_name) const
+	{
+		out += read_name;
+		out += ' ';
+		this->_cell_barcode.append_sequence_to(out);
+		out += ' ';
+		this->_umi.append_sequence_to(out);
+		out += ' ';
+		this->_cell_barcode.append_quality_to(out);
+		out += ' ';
+		this->_umi.append_quality_to(out);
+
+		if (!this->_raw_cell_barcode.empty())
+		{
+			out += ' ';
+			out += this->_raw_cell_barcode;
+		}
+	}
+
+	void PackedReadParameters::append_encoded_id(std::string &out) const
+	{
+		out += '!';
+		this->_cell_barcode.append_sequence_to(out);
+		out += '#';
+		this->_umi.append_sequence_to(out);
+	}
+
+	ReadParameters PackedReadParameters::unpack() const
+	{
+		if (this->_is_empty)
+			return ReadParameters();
+
+		return ReadParameters(this->_cell_barcode.sequence(), this->_umi.sequence(), this->_cell_barcode.quality(),
+		                      this->_umi.quality(), this->_pass_quality_threshold);
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <boost/utility/string_ref.hpp>
+
+#include "ReadParameters.h"
+
+namespace Tools
+{
+	// Barcode sequence, packed 2 bits per base with a mask of Ns. Quality is stored as views into the source records,
+	// so the tag is valid only while the records are alive. Tags, which are too long, consist of too many parts or
+	// contain symbols other than ACGTN, are stored as plain text.
+	class PackedTag
+	{
+	public:
+		static const size_t max_packed_length = 64;
+		static const size_t max_quality_parts = 4;
+
+		// Packed sequence, which can be used as a hash key
+		struct Key
+		{
+			uint64_t bases[max_packed_length / 32];
+			uint64_t n_mask;
+			size_t length;
+
+			bool operator==(const Key &other) const;
+			char base(size_t pos) const;
+			std::string sequence() const;
+		};
+
+	private:
+		Key _key;
+
+		boost::string_ref _quality_parts[max_quality_parts];
+		size_t _quality_parts_num;
+
+		bool _packed;
+		std::string _sequence_text;
+		std::string _quality_text;
+
+	private:
+		static int base_code(char base);
+		static bool can_pack(const boost::string_ref &sequence);
+		void pack(const boost::string_ref &sequence);
+		void unpack();
+
+	public:
+		PackedTag();
+
+		void clear();
+		void append(const boost::string_ref &sequence, const boost::string_ref &quality);
+		void replace_sequence(const std::string &sequence); // Quality is kept, so the length must be the same
+
+		char base(size_t pos) const;
+		size_t length() const;
+		bool empty() const;
+		bool packed() const;
+		const Key& key() const; // Valid only for packed tags
+		bool check_quality(int min_quality) const;
+
+		void append_sequence_to(std::string &out) const;
+		void append_quality_to(std::string &out) const;
+		std::string sequence() const;
+		std::string quality() const;
+	};
+
+	// Compact alternative to ReadParameters, which is filled without heap allocations for typical barcodes.
+	// Text is built only for the output.
+	class PackedReadParameters
+	{
+	private:
+		PackedTag _cell_barcode;
+		PackedTag _umi;
+		std::string _raw_cell_barcode; // Set only if the cell barcode was corrected
+
+		bool _pass_quality_threshold;
+		bool _is_empty;
+
+	public:
+		PackedReadParameters();
+
+		void clear();
+		void complete(int min_quality); // Must be called after both tags are filled
+		void correct_cell_barcode(const std::string &cell_barcode);
+
+		PackedTag& cell_barcode();
+		PackedTag& umi();
+		const PackedTag& cell_barcode() const;
+		const PackedTag& umi() const;
+		const std::string& raw_cell_barcode() const;
+
+		bool pass_quality_threshold() const;
+		bool is_empty() const;
+
+		// Same format as ReadParameters::to_string. Raw cell barcode is appended as an extra column if it was corrected
+		void append_to(std::string &out, const std::string &read_name) const;
+		void append_encoded_id(std::string &out) const; // Suffix of ReadParameters::encoded_id
+		ReadParameters unpack() const;
+	};
+}
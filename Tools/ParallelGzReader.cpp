@@ -0,0 +1,485 @@
+#include "ParallelGzReader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace Tools
+{
+	const size_t ParallelGzReader::chunk_size = 1 << 20;
+	const size_t ParallelGzReader::header_size = 18;
+
+	ParallelGzReader::ParallelGzReader(const std::string &filename, size_t threads_num, size_t start_offset)
+		: _filename(filename)
+		, _in_file(filename, std::ios_base::in | std::ios_base::binary)
+		, _header(ParallelGzReader::header_size)
+		, _header_pos(0)
+		, _format(PLAIN)
+		, _max_chunks_in_flight(0)
+		, _input_bytes(0)
+		, _next_chunk_id(0)
+		, _next_read_chunk_id(0)
+		, _input_ended(false)
+		, _gzip_tail(false)
+		, _stopped(false)
+		, _current_pos(0)
+	{
+		if (!this->_in_file)
+			throw std::runtime_error("Can't open file '" + filename + "'");
+
+		if (start_offset > 0 && !this->_in_file.seekg(std::streamoff(start_offset)))
+			throw std::runtime_error("Can't seek to offset " + std::to_string(start_offset) + " of file '" + filename + "'");
+
+		this->_in_file.read(this->_header.data(), this->_header.size());
+		this->_header.resize(size_t(this->_in_file.gcount()));
+		this->_input_bytes = this->_header.size();
+		this->_format = ParallelGzReader::detect_format(this->_header);
+
+		if (this->_format == PLAIN)
+			return;
+
+		if (this->_format == GZIP)
+		{
+			threads_num = 1;
+		}
+
+		this->_max_chunks_in_flight = 2 * threads_num + 2;
+		for (size_t thread_ind = 0; thread_ind < threads_num; ++thread_ind)
+		{
+			if (this->_format == BGZF)
+			{
+				this->_threads.emplace_back([this]{ this->run_bgzf_thread(); });
+			}
+			else
+			{
+				this->_threads.emplace_back([this]{ this->run_gzip_thread(); });
+			}
+		}
+	}
+
+	ParallelGzReader::~ParallelGzReader()
+	{
+		{
+			lock_t lock(this->_mutex);
+			this->_stopped = true;
+		}
+		this->_chunk_consumed.notify_all();
+
+		for (auto &thread : this->_threads)
+		{
+			thread.join();
+		}
+	}
+
+	ParallelGzReader::Format ParallelGzReader::format() const
+	{
+		return this->_format;
+	}
+
+	size_t ParallelGzReader::input_bytes() const
+	{
+		return this->_input_bytes;
+	}
+
+	ParallelGzReader::Format ParallelGzReader::detect_format(const std::vector<char> &header)
+	{
+		if (header.size() < 2 || (unsigned char)header[0] != 0x1f || (unsigned char)header[1] != 0x8b)
+			return PLAIN;
+
+		size_t extra_length;
+		if (ParallelGzReader::bgzf_block_size((const unsigned char*)header.data(), header.size(), extra_length) != 0)
+			return BGZF;
+
+		return GZIP;
+	}
+
+	size_t ParallelGzReader::bgzf_block_size(const unsigned char *header, size_t header_length, size_t &extra_length)
+	{
+		// gzip member header with FEXTRA flag, which contains 'BC' subfield with the total block size minus 1
+		if (header_length < 12 || header[0] != 0x1f || header[1] != 0x8b || header[2] != 8 || !(header[3] & 4))
+			return 0;
+
+		extra_length = header[10] | (size_t(header[11]) << 8);
+		if (header_length < 12 + extra_length)
+			return 0;
+
+		for (size_t pos = 12; pos + 4 <= 12 + extra_length;)
+		{
+			size_t subfield_length = header[pos + 2] | (size_t(header[pos + 3]) << 8);
+			if (header[pos] == 'B' && header[pos + 1] == 'C' && subfield_length == 2 && pos + 6 <= 12 + extra_length)
+				return (header[pos + 4] | (size_t(header[pos + 5]) << 8)) + 1;
+
+			pos += 4 + subfield_length;
+		}
+
+		return 0;
+	}
+
+	size_t ParallelGzReader::read_input(char *buffer, size_t size)
+	{
+		size_t read_size = std::min(size, this->_header.size() - this->_header_pos);
+		std::copy(this->_header.begin() + this->_header_pos, this->_header.begin() + this->_header_pos + read_size, buffer);
+		this->_header_pos += read_size;
+
+		if (read_size < size)
+		{
+			this->_in_file.read(buffer + read_size, size - read_size);
+			read_size += size_t(this->_in_file.gcount());
+			this->_input_bytes += size_t(this->_in_file.gcount());
+		}
+
+		return read_size;
+	}
+
+	bool ParallelGzReader::read_bgzf_blocks_unsafe(std::vector<char> &compressed)
+	{
+		compressed.clear();
+		while (compressed.size() < ParallelGzReader::chunk_size)
+		{
+			size_t block_start = compressed.size();
+			compressed.resize(block_start + 12);
+			size_t read_size = this->read_input(compressed.data() + block_start, 12);
+			if (read_size == 0)
+			{
+				compressed.resize(block_start);
+				break;
+			}
+
+			if (read_size != 12)
+				throw std::runtime_error("File '" + this->_filename + "': BGZF block is truncated");
+
+			size_t extra_length = (unsigned char)compressed[block_start + 10] | (size_t((unsigned char)compressed[block_start + 11]) << 8);
+			compressed.resize(block_start + 12 + extra_length);
+			read_size += this->read_input(compressed.data() + block_start + 12, extra_length);
+
+			size_t block_size = ParallelGzReader::bgzf_block_size((const unsigned char*)compressed.data() + block_start,
+			                                                      read_size, extra_length);
+			if (block_size == 0)
+			{
+				// Not a BGZF block. The bytes are returned to the input, which is inflated as plain gzip from here
+				this->_header.assign(compressed.begin() + block_start, compressed.begin() + block_start + read_size);
+				this->_header_pos = 0;
+				this->_gzip_tail = true;
+				compressed.resize(block_start);
+				break;
+			}
+
+			if (block_size < 12 + extra_length + 8)
+				throw std::runtime_error("File '" + this->_filename + "': malformed BGZF block");
+
+			compressed.resize(block_start + block_size);
+			read_size += this->read_input(compressed.data() + block_start + read_size, block_size - read_size);
+			if (read_size != block_size)
+				throw std::runtime_error("File '" + this->_filename + "': BGZF block is truncated");
+		}
+
+		return !compressed.empty();
+	}
+
+	void ParallelGzReader::inflate_bgzf_blocks(const std::vector<char> &compressed, std::vector<char> &out,
+	                                           z_stream &stream) const
+	{
+		out.clear();
+		const unsigned char *data = (const unsigned char*)compressed.data();
+		for (size_t block_start = 0; block_start < compressed.size();)
+		{
+			size_t extra_length = 0;
+			size_t block_size = ParallelGzReader::bgzf_block_size(data + block_start, compressed.size() - block_start,
+			                                                      extra_length);
+			const unsigned char *trailer = data + block_start + block_size - 8;
+			uLong crc = trailer[0] | (uLong(trailer[1]) << 8) | (uLong(trailer[2]) << 16) | (uLong(trailer[3]) << 24);
+			size_t out_size = trailer[4] | (size_t(trailer[5]) << 8) | (size_t(trailer[6]) << 16) | (size_t(trailer[7]) << 24);
+
+			size_t out_start = out.size();
+			out.resize(out_start + out_size);
+
+			inflateReset(&stream);
+			stream.next_in = (Bytef*)(data + block_start + 12 + extra_length);
+			stream.avail_in = uInt(block_size - 12 - extra_length - 8);
+			stream.next_out = (Bytef*)(out.data() + out_start);
+			stream.avail_out = uInt(out_size);
+
+			if (inflate(&stream, Z_FINISH) != Z_STREAM_END || stream.avail_out != 0)
+				throw std::runtime_error("File '" + this->_filename + "': can't inflate BGZF block");
+
+			if (crc32(crc32(0L, Z_NULL, 0), (const Bytef*)(out.data() + out_start), uInt(out_size)) != crc)
+				throw std::runtime_error("File '" + this->_filename + "': BGZF block has wrong checksum");
+
+			block_start += block_size;
+		}
+	}
+
+	bool ParallelGzReader::wait_for_free_slot(lock_t &lock)
+	{
+		this->_chunk_consumed.wait(lock, [this]{
+			return this->_stopped || this->_input_ended ||
+					this->_next_chunk_id - this->_next_read_chunk_id < this->_max_chunks_in_flight;
+		});
+
+		return !this->_stopped && !this->_input_ended;
+	}
+
+	void ParallelGzReader::push_chunk(size_t chunk_id, std::vector<char> &&chunk)
+	{
+		{
+			lock_t lock(this->_mutex);
+			this->_ready_chunks[chunk_id] = std::move(chunk);
+		}
+		this->_chunk_ready.notify_all();
+	}
+
+	void ParallelGzReader::finish_input()
+	{
+		{
+			lock_t lock(this->_mutex);
+			this->_input_ended = true;
+		}
+		this->_chunk_ready.notify_all();
+		this->_chunk_consumed.notify_all();
+	}
+
+	void ParallelGzReader::set_error(const std::exception_ptr &error)
+	{
+		{
+			lock_t lock(this->_mutex);
+			if (!this->_error)
+			{
+				this->_error = error;
+			}
+			this->_stopped = true;
+		}
+		this->_chunk_ready.notify_all();
+		this->_chunk_consumed.notify_all();
+	}
+
+	void ParallelGzReader::run_bgzf_thread()
+	{
+		z_stream stream;
+		std::memset(&stream, 0, sizeof(stream));
+		if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+		{
+			this->set_error(std::make_exception_ptr(std::runtime_error("Can't initialize zlib")));
+			return;
+		}
+
+		bool inflate_gzip_tail = false;
+		try
+		{
+			std::vector<char> compressed;
+			while (!inflate_gzip_tail)
+			{
+				size_t chunk_id;
+				{
+					lock_t lock(this->_mutex);
+					if (!this->wait_for_free_slot(lock) || this->_gzip_tail) // The tail is inflated by another thread
+						break;
+
+					bool has_blocks = this->read_bgzf_blocks_unsafe(compressed);
+					inflate_gzip_tail = this->_gzip_tail;
+					if (!has_blocks)
+					{
+						if (inflate_gzip_tail)
+							break;
+
+						lock.unlock();
+						this->finish_input();
+						break;
+					}
+
+					chunk_id = this->_next_chunk_id++;
+				}
+
+				std::vector<char> chunk;
+				this->inflate_bgzf_blocks(compressed, chunk, stream);
+				this->push_chunk(chunk_id, std::move(chunk));
+			}
+		}
+		catch (...)
+		{
+			this->set_error(std::current_exception());
+			inflate_gzip_tail = false;
+		}
+
+		inflateEnd(&stream);
+
+		// Chunks of the tail get ids after all BGZF chunks, as the ids are taken in the order of reading
+		if (inflate_gzip_tail)
+		{
+			this->run_gzip_thread();
+		}
+	}
+
+	void ParallelGzReader::run_gzip_thread()
+	{
+		z_stream stream;
+		std::memset(&stream, 0, sizeof(stream));
+		if (inflateInit2(&stream, MAX_WBITS + 16) != Z_OK)
+		{
+			this->set_error(std::make_exception_ptr(std::runtime_error("Can't initialize zlib")));
+			return;
+		}
+
+		try
+		{
+			std::vector<char> in(ParallelGzReader::chunk_size);
+			bool member_ended = false, file_ended = false;
+			while (!file_ended)
+			{
+				{
+					lock_t lock(this->_mutex);
+					if (!this->wait_for_free_slot(lock))
+						break;
+				}
+
+				std::vector<char> chunk(ParallelGzReader::chunk_size);
+				stream.next_out = (Bytef*)chunk.data();
+				stream.avail_out = uInt(chunk.size());
+				while (stream.avail_out > 0)
+				{
+					if (stream.avail_in == 0)
+					{
+						stream.avail_in = uInt(this->read_input(in.data(), in.size()));
+						stream.next_in = (Bytef*)in.data();
+						if (stream.avail_in == 0)
+						{
+							file_ended = true;
+							break;
+						}
+					}
+
+					if (member_ended) // Multi-member gzip
+					{
+						inflateReset(&stream);
+						member_ended = false;
+					}
+
+					int res = inflate(&stream, Z_NO_FLUSH);
+					if (res == Z_STREAM_END)
+					{
+						member_ended = true;
+					}
+					else if (res != Z_OK)
+						throw std::runtime_error("File '" + this->_filename + "': can't inflate gzip data");
+				}
+
+				if (file_ended && !member_ended)
+					throw std::runtime_error("File '" + this->_filename + "': gzip data is truncated");
+
+				chunk.resize(chunk.size() - stream.avail_out);
+				if (!chunk.empty())
+				{
+					size_t chunk_id;
+					{
+						lock_t lock(this->_mutex);
+						chunk_id = this->_next_chunk_id++;
+					}
+					this->push_chunk(chunk_id, std::move(chunk));
+				}
+			}
+
+			if (file_ended)
+			{
+				this->finish_input();
+			}
+		}
+		catch (...)
+		{
+			this->set_error(std::current_exception());
+		}
+
+		inflateEnd(&stream);
+	}
+
+	bool ParallelGzReader::inflate_next_chunk()
+	{
+		std::vector<char> compressed;
+		if (this->_gzip_tail || !this->read_bgzf_blocks_unsafe(compressed))
+		{
+			this->_current_chunk.clear();
+			return false;
+		}
+
+		z_stream stream;
+		std::memset(&stream, 0, sizeof(stream));
+		if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+			throw std::runtime_error("Can't initialize zlib");
+
+		try
+		{
+			this->inflate_bgzf_blocks(compressed, this->_current_chunk, stream);
+		}
+		catch (...)
+		{
+			inflateEnd(&stream);
+			throw;
+		}
+
+		inflateEnd(&stream);
+		return true;
+	}
+
+	bool ParallelGzReader::next_chunk()
+	{
+		this->_current_pos = 0;
+		if (this->_format == PLAIN)
+		{
+			this->_current_chunk.resize(ParallelGzReader::chunk_size);
+			this->_current_chunk.resize(this->read_input(this->_current_chunk.data(), this->_current_chunk.size()));
+			return !this->_current_chunk.empty();
+		}
+
+		if (this->_threads.empty())
+		{
+			if (this->inflate_next_chunk())
+				return true;
+
+			if (!this->_gzip_tail)
+				return false;
+
+			// The rest of the file isn't BGZF, so it's inflated by a thread as in the parallel mode
+			this->_threads.emplace_back([this]{ this->run_gzip_thread(); });
+		}
+
+		{
+			lock_t lock(this->_mutex);
+			this->_chunk_ready.wait(lock, [this]{
+				return this->_error || this->_ready_chunks.count(this->_next_read_chunk_id) != 0 ||
+						(this->_input_ended && this->_next_read_chunk_id == this->_next_chunk_id);
+			});
+
+			if (this->_error)
+				std::rethrow_exception(this->_error);
+
+			auto chunk_it = this->_ready_chunks.find(this->_next_read_chunk_id);
+			if (chunk_it == this->_ready_chunks.end())
+			{
+				this->_current_chunk.clear();
+				return false;
+			}
+
+			this->_current_chunk.swap(chunk_it->second);
+			this->_ready_chunks.erase(chunk_it);
+			this->_next_read_chunk_id++;
+		}
+
+		this->_chunk_consumed.notify_all();
+		return true;
+	}
+
+	size_t ParallelGzReader::read(char *buffer, size_t size)
+	{
+		size_t read_size = 0;
+		while (read_size < size)
+		{
+			if (this->_current_pos == this->_current_chunk.size() && !this->next_chunk())
+				break;
+
+			size_t copy_size = std::min(size - read_size, this->_current_chunk.size() - this->_current_pos);
+			std::memcpy(buffer + read_size, this->_current_chunk.data() + this->_current_pos, copy_size);
+			this->_current_pos += copy_size;
+			read_size += copy_size;
+		}
+
+		return read_size;
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+namespace Tools
+{
+	// Returns decompressed content of a plain or gzipped file in the original order.
+	// BGZF blocks are inflated in parallel by a pool of threads. Other gzip files can't be split without inflating,
+	// so they're inflated by a single thread, which reads ahead of the consumer. If a BGZF file is followed by other
+	// gzip members (e.g. a concatenation of outputs of different tools), the rest of it is inflated by a single thread.
+	// With zero threads, BGZF blocks are inflated by the consumer in read().
+	class ParallelGzReader
+	{
+	public:
+		enum Format
+		{
+			PLAIN,
+			GZIP,
+			BGZF
+		};
+
+	private:
+		using lock_t = std::unique_lock<std::mutex>;
+
+		static const size_t chunk_size;
+		static const size_t header_size;
+
+		const std::string _filename;
+		std::ifstream _in_file;
+		std::vector<char> _header; // Bytes, which were read from the file to detect the format, but aren't consumed yet
+		size_t _header_pos;
+		Format _format;
+		size_t _max_chunks_in_flight;
+		std::atomic<size_t> _input_bytes;
+
+		std::mutex _mutex;
+		std::condition_variable _chunk_ready;
+		std::condition_variable _chunk_consumed;
+		std::map<size_t, std::vector<char>> _ready_chunks;
+		size_t _next_chunk_id;
+		size_t _next_read_chunk_id;
+		bool _input_ended;
+		bool _gzip_tail; // A gzip member without BGZF header was met, so the rest of the file isn't BGZF
+		bool _stopped;
+		std::exception_ptr _error;
+
+		std::vector<char> _current_chunk;
+		size_t _current_pos;
+
+		std::vector<std::thread> _threads;
+
+	private:
+		static Format detect_format(const std::vector<char> &header);
+		static size_t bgzf_block_size(const unsigned char *header, size_t header_length, size_t &extra_length);
+
+		size_t read_input(char *buffer, size_t size);
+		bool read_bgzf_blocks_unsafe(std::vector<char> &compressed);
+		void inflate_bgzf_blocks(const std::vector<char> &compressed, std::vector<char> &out, z_stream &stream) const;
+
+		bool wait_for_free_slot(lock_t &lock);
+		void push_chunk(size_t chunk_id, std::vector<char> &&chunk);
+		void finish_input();
+		void set_error(const std::exception_ptr &error);
+
+		void run_bgzf_thread();
+		void run_gzip_thread();
+		bool inflate_next_chunk();
+		bool next_chunk();
+
+	public:
+		// Reading can start from an offset in the file, e.g. from a BGZF block
+		ParallelGzReader(const std::string &filename, size_t threads_num, size_t start_offset = 0);
+		~ParallelGzReader();
+
+		size_t read(char *buffer, size_t size);
+		Format format() const;
+		size_t input_bytes() const; // Number of bytes, which were read from the file. Can be called from any thread
+	};
+}
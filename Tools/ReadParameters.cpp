@@ -1,4 +1,5 @@
 #include "ReadParameters.h"
+#include "SequenceKernels.h"
 
 namespace Tools
 {
@@ -70,7 +71,7 @@ namespace Tools
 			start_pos = end_pos + 1;
 		}
 
-		parsed.push_back(params_string.substr(start_pos));
+		parsed.push_back(params_string.substr(start_pos, params_string.find(' ', start_pos) - start_pos)); // Extra columns are ignored
 
 		if (parsed[0][0] == '@')
 		{
@@ -120,19 +121,9 @@ namespace Tools
 		if (min_quality <= 0)
 			return true;
 
-		for (char qual : this->_cell_barcode_quality)
-		{
-			if (qual < min_quality + Tools::ReadParameters::quality_offset)
-				return false;
-		}
-
-		for (char qual : this->_umi_quality)
-		{
-			if (qual < min_quality + Tools::ReadParameters::quality_offset)
-				return false;
-		}
-
-		return true;
+		const int min_value = min_quality + Tools::ReadParameters::quality_offset;
+		return Kernels::min_value(this->_cell_barcode_quality.data(), this->_cell_barcode_quality.length()) >= min_value &&
+		       Kernels::min_value(this->_umi_quality.data(), this->_umi_quality.length()) >= min_value;
 	}
 
 	bool ReadParameters::pass_quality_threshold() const
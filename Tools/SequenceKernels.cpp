@@ -0,0 +1,475 @@
+#include "SequenceKernels.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || __GNUC__ >= 5)
+#define TOOLS_KERNELS_X86
+#include <immintrin.h>
+#define TARGET_SSE42 __attribute__((target("sse4.2,popcnt")))
+#define TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#endif
+
+namespace Tools
+{
+namespace Kernels
+{
+	namespace
+	{
+		struct Complements
+		{
+			char values[256];
+
+			Complements()
+			{
+				std::fill(std::begin(this->values), std::end(this->values), 'N');
+				this->values[(unsigned char)'A'] = 'T';
+				this->values[(unsigned char)'C'] = 'G';
+				this->values[(unsigned char)'G'] = 'C';
+				this->values[(unsigned char)'T'] = 'A';
+			}
+
+			char operator()(char base) const
+			{
+				return this->values[(unsigned char)base];
+			}
+		};
+
+		const Complements complement;
+
+		void reverse_complement_scalar(char *sequence, size_t length)
+		{
+			for (size_t i = 0, j = length; i < j; ++i)
+			{
+				--j;
+				char front = sequence[i];
+				sequence[i] = complement(sequence[j]);
+				sequence[j] = complement(front);
+			}
+		}
+
+		// Continues search of a run over the sequence tail. 'run' is the length of the run, which ends at 'start'
+		size_t find_run_tail(const char *sequence, size_t start, size_t length, char base, size_t run_length, size_t run)
+		{
+			if (run_length == 0)
+				return 0;
+
+			for (size_t i = start; i < length; ++i)
+			{
+				run = (sequence[i] == base) ? run + 1 : 0;
+				if (run >= run_length)
+					return i + 1 - run;
+			}
+
+			return std::string::npos;
+		}
+
+		size_t find_run_scalar(const char *sequence, size_t length, char base, size_t run_length)
+		{
+			return find_run_tail(sequence, 0, length, base, run_length, 0);
+		}
+
+		size_t trailing_run_length_scalar(const char *sequence, size_t length, char base1, char base2)
+		{
+			size_t end = length;
+			while (end > 0 && (sequence[end - 1] == base1 || sequence[end - 1] == base2))
+			{
+				--end;
+			}
+
+			return length - end;
+		}
+
+		char min_value_scalar(const char *values, size_t length)
+		{
+			char res = CHAR_MAX;
+			for (size_t i = 0; i < length; ++i)
+			{
+				res = std::min(res, values[i]);
+			}
+
+			return res;
+		}
+
+		unsigned hamming_distance_scalar(const char *s1, const char *s2, size_t length, bool skip_n)
+		{
+			unsigned res = 0;
+			for (size_t i = 0; i < length; ++i)
+			{
+				if (s1[i] != s2[i] && !(skip_n && (s1[i] == 'N' || s2[i] == 'N')))
+				{
+					++res;
+				}
+			}
+
+			return res;
+		}
+
+		bool contains_n_scalar(const char *sequence, size_t length)
+		{
+			return length > 0 && std::memchr(sequence, 'N', length) != nullptr;
+		}
+
+#ifdef TOOLS_KERNELS_X86
+		// Processes mask of a 32 symbols block, which starts at 'block_start'. Returns true if the run is found
+		inline bool find_run_in_block(uint32_t mask, size_t block_start, size_t run_length, size_t &run, size_t &pos)
+		{
+			if (mask == UINT32_MAX)
+			{
+				run += 32;
+				if (run < run_length)
+					return false;
+
+				pos = block_start + 32 - run;
+				return true;
+			}
+
+			size_t leading = size_t(__builtin_ctz(~mask));
+			if (run + leading >= run_length)
+			{
+				pos = block_start - run;
+				return true;
+			}
+
+			if (run_length <= 32)
+			{
+				// Bit i remains set if bits [i, i + run_length) are set
+				uint32_t starts = mask;
+				for (size_t len = 1; len < run_length; )
+				{
+					size_t step = std::min(len, run_length - len);
+					starts &= starts >> step;
+					len += step;
+				}
+
+				if (starts != 0)
+				{
+					pos = block_start + size_t(__builtin_ctz(starts));
+					return true;
+				}
+			}
+
+			run = size_t(__builtin_clz(~mask));
+			return false;
+		}
+
+		TARGET_SSE42 inline __m128i reverse_complement_sse(__m128i seq)
+		{
+			const __m128i lut = _mm_setr_epi8('N', 'T', 'N', 'G', 'A', 'N', 'N', 'C', 'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N');
+			const __m128i low_bits = _mm_set1_epi8(0x0F);
+			const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+			// Low 4 bits are unique for ACGTN. Symbols, which don't give themselves after a double complement, become N
+			__m128i comp = _mm_shuffle_epi8(lut, _mm_and_si128(seq, low_bits));
+			__m128i valid = _mm_cmpeq_epi8(_mm_shuffle_epi8(lut, _mm_and_si128(comp, low_bits)), seq);
+			comp = _mm_blendv_epi8(_mm_set1_epi8('N'), comp, valid);
+			return _mm_shuffle_epi8(comp, reverse);
+		}
+
+		TARGET_SSE42 void reverse_complement_sse42(char *sequence, size_t length)
+		{
+			size_t i = 0;
+			for (; length - 2 * i >= 32; i += 16)
+			{
+				char *back = sequence + length - i - 16;
+				__m128i front_block = _mm_loadu_si128((const __m128i*)(sequence + i));
+				__m128i back_block = _mm_loadu_si128((const __m128i*)back);
+				_mm_storeu_si128((__m128i*)(sequence + i), reverse_complement_sse(back_block));
+				_mm_storeu_si128((__m128i*)back, reverse_complement_sse(front_block));
+			}
+
+			reverse_complement_scalar(sequence + i, length - 2 * i);
+		}
+
+		TARGET_SSE42 inline uint32_t eq_mask_sse(const char *block, __m128i value)
+		{
+			uint32_t low = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)block), value)));
+			uint32_t high = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(block + 16)), value)));
+			return low | (high << 16);
+		}
+
+		TARGET_SSE42 size_t find_run_sse42(const char *sequence, size_t length, char base, size_t run_length)
+		{
+			if (run_length == 0)
+				return 0;
+
+			const __m128i base_vec = _mm_set1_epi8(base);
+			size_t run = 0, pos = 0, i = 0;
+			for (; i + 32 <= length; i += 32)
+			{
+				if (find_run_in_block(eq_mask_sse(sequence + i, base_vec), i, run_length, run, pos))
+					return pos;
+			}
+
+			return find_run_tail(sequence, i, length, base, run_length, run);
+		}
+
+		TARGET_SSE42 size_t trailing_run_length_sse42(const char *sequence, size_t length, char base1, char base2)
+		{
+			const __m128i base1_vec = _mm_set1_epi8(base1), base2_vec = _mm_set1_epi8(base2);
+			size_t end = length;
+			for (; end >= 16; end -= 16)
+			{
+				__m128i block = _mm_loadu_si128((const __m128i*)(sequence + end - 16));
+				uint32_t mask = uint32_t(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, base1_vec),
+				                                                         _mm_cmpeq_epi8(block, base2_vec))));
+				if (mask != 0xFFFF)
+					return length - end + size_t(__builtin_clz(~mask << 16));
+			}
+
+			return length - end + trailing_run_length_scalar(sequence, end, base1, base2);
+		}
+
+		TARGET_SSE42 char min_value_sse42(const char *values, size_t length)
+		{
+			__m128i min_vec = _mm_set1_epi8(CHAR_MAX);
+			size_t i = 0;
+			for (; i + 16 <= length; i += 16)
+			{
+				min_vec = _mm_min_epi8(min_vec, _mm_loadu_si128((const __m128i*)(values + i)));
+			}
+
+			char block_mins[16];
+			_mm_storeu_si128((__m128i*)block_mins, min_vec);
+			return std::min(min_value_scalar(block_mins, 16), min_value_scalar(values + i, length - i));
+		}
+
+		TARGET_SSE42 unsigned hamming_distance_sse42(const char *s1, const char *s2, size_t length, bool skip_n)
+		{
+			const __m128i n_vec = _mm_set1_epi8('N');
+			unsigned res = 0;
+			size_t i = 0;
+			for (; i + 16 <= length; i += 16)
+			{
+				__m128i block1 = _mm_loadu_si128((const __m128i*)(s1 + i));
+				__m128i block2 = _mm_loadu_si128((const __m128i*)(s2 + i));
+				__m128i equal = _mm_cmpeq_epi8(block1, block2);
+				if (skip_n)
+				{
+					equal = _mm_or_si128(equal, _mm_or_si128(_mm_cmpeq_epi8(block1, n_vec), _mm_cmpeq_epi8(block2, n_vec)));
+				}
+
+				res += unsigned(__builtin_popcount(~uint32_t(_mm_movemask_epi8(equal)) & 0xFFFF));
+			}
+
+			return res + hamming_distance_scalar(s1 + i, s2 + i, length - i, skip_n);
+		}
+
+		TARGET_SSE42 bool contains_n_sse42(const char *sequence, size_t length)
+		{
+			const __m128i n_vec = _mm_set1_epi8('N');
+			size_t i = 0;
+			for (; i + 16 <= length; i += 16)
+			{
+				if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(sequence + i)), n_vec)) != 0)
+					return true;
+			}
+
+			return contains_n_scalar(sequence + i, length - i);
+		}
+
+		TARGET_AVX2 inline __m256i reverse_complement_avx(__m256i seq)
+		{
+			const __m256i lut = _mm256_setr_epi8('N', 'T', 'N', 'G', 'A', 'N', 'N', 'C', 'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N',
+			                                     'N', 'T', 'N', 'G', 'A', 'N', 'N', 'C', 'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N');
+			const __m256i low_bits = _mm256_set1_epi8(0x0F);
+			const __m256i reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+			                                         15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+			__m256i comp = _mm256_shuffle_epi8(lut, _mm256_and_si256(seq, low_bits));
+			__m256i valid = _mm256_cmpeq_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(comp, low_bits)), seq);
+			comp = _mm256_blendv_epi8(_mm256_set1_epi8('N'), comp, valid);
+			comp = _mm256_shuffle_epi8(comp, reverse); // Shuffle works within 128-bit lanes, so the lanes are swapped after
+			return _mm256_permute2x128_si256(comp, comp, 1);
+		}
+
+		TARGET_AVX2 void reverse_complement_avx2(char *sequence, size_t length)
+		{
+			size_t i = 0;
+			for (; length - 2 * i >= 64; i += 32)
+			{
+				char *back = sequence + length - i - 32;
+				__m256i front_block = _mm256_loadu_si256((const __m256i*)(sequence + i));
+				__m256i back_block = _mm256_loadu_si256((const __m256i*)back);
+				_mm256_storeu_si256((__m256i*)(sequence + i), reverse_complement_avx(back_block));
+				_mm256_storeu_si256((__m256i*)back, reverse_complement_avx(front_block));
+			}
+
+			reverse_complement_sse42(sequence + i, length - 2 * i);
+		}
+
+		TARGET_AVX2 size_t find_run_avx2(const char *sequence, size_t length, char base, size_t run_length)
+		{
+			if (run_length == 0)
+				return 0;
+
+			const __m256i base_vec = _mm256_set1_epi8(base);
+			size_t run = 0, pos = 0, i = 0;
+			for (; i + 32 <= length; i += 32)
+			{
+				__m256i block = _mm256_loadu_si256((const __m256i*)(sequence + i));
+				uint32_t mask = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, base_vec)));
+				if (find_run_in_block(mask, i, run_length, run, pos))
+					return pos;
+			}
+
+			return find_run_tail(sequence, i, length, base, run_length, run);
+		}
+
+		TARGET_AVX2 size_t trailing_run_length_avx2(const char *sequence, size_t length, char base1, char base2)
+		{
+			const __m256i base1_vec = _mm256_set1_epi8(base1), base2_vec = _mm256_set1_epi8(base2);
+			size_t end = length;
+			for (; end >= 32; end -= 32)
+			{
+				__m256i block = _mm256_loadu_si256((const __m256i*)(sequence + end - 32));
+				uint32_t mask = uint32_t(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, base1_vec),
+				                                                               _mm256_cmpeq_epi8(block, base2_vec))));
+				if (mask != UINT32_MAX)
+					return length - end + size_t(__builtin_clz(~mask));
+			}
+
+			return length - end + trailing_run_length_sse42(sequence, end, base1, base2);
+		}
+
+		TARGET_AVX2 char min_value_avx2(const char *values, size_t length)
+		{
+			__m256i min_vec = _mm256_set1_epi8(CHAR_MAX);
+			size_t i = 0;
+			for (; i + 32 <= length; i += 32)
+			{
+				min_vec = _mm256_min_epi8(min_vec, _mm256_loadu_si256((const __m256i*)(values + i)));
+			}
+
+			char block_mins[32];
+			_mm256_storeu_si256((__m256i*)block_mins, min_vec);
+			return std::min(min_value_scalar(block_mins, 32), min_value_sse42(values + i, length - i));
+		}
+
+		TARGET_AVX2 unsigned hamming_distance_avx2(const char *s1, const char *s2, size_t length, bool skip_n)
+		{
+			const __m256i n_vec = _mm256_set1_epi8('N');
+			unsigned res = 0;
+			size_t i = 0;
+			for (; i + 32 <= length; i += 32)
+			{
+				__m256i block1 = _mm256_loadu_si256((const __m256i*)(s1 + i));
+				__m256i block2 = _mm256_loadu_si256((const __m256i*)(s2 + i));
+				__m256i equal = _mm256_cmpeq_epi8(block1, block2);
+				if (skip_n)
+				{
+					equal = _mm256_or_si256(equal, _mm256_or_si256(_mm256_cmpeq_epi8(block1, n_vec),
+					                                               _mm256_cmpeq_epi8(block2, n_vec)));
+				}
+
+				res += unsigned(__builtin_popcount(~uint32_t(_mm256_movemask_epi8(equal))));
+			}
+
+			return res + hamming_distance_sse42(s1 + i, s2 + i, length - i, skip_n);
+		}
+
+		TARGET_AVX2 bool contains_n_avx2(const char *sequence, size_t length)
+		{
+			const __m256i n_vec = _mm256_set1_epi8('N');
+			size_t i = 0;
+			for (; i + 32 <= length; i += 32)
+			{
+				if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(sequence + i)), n_vec)) != 0)
+					return true;
+			}
+
+			return contains_n_sse42(sequence + i, length - i);
+		}
+#endif
+
+		struct Implementation
+		{
+			void (*reverse_complement)(char*, size_t);
+			size_t (*find_run)(const char*, size_t, char, size_t);
+			size_t (*trailing_run_length)(const char*, size_t, char, char);
+			char (*min_value)(const char*, size_t);
+			unsigned (*hamming_distance)(const char*, const char*, size_t, bool);
+			bool (*contains_n)(const char*, size_t);
+		};
+
+		const Implementation implementations[] = {
+				{reverse_complement_scalar, find_run_scalar, trailing_run_length_scalar, min_value_scalar,
+				 hamming_distance_scalar, contains_n_scalar},
+#ifdef TOOLS_KERNELS_X86
+				{reverse_complement_sse42, find_run_sse42, trailing_run_length_sse42, min_value_sse42,
+				 hamming_distance_sse42, contains_n_sse42},
+				{reverse_complement_avx2, find_run_avx2, trailing_run_length_avx2, min_value_avx2,
+				 hamming_distance_avx2, contains_n_avx2}
+#endif
+		};
+
+		Level& current_level()
+		{
+			static Level level = supported_level();
+			return level;
+		}
+
+		const Implementation& implementation()
+		{
+			return implementations[current_level()];
+		}
+	}
+
+	Level supported_level()
+	{
+#ifdef TOOLS_KERNELS_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+			return AVX2;
+
+		if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+			return SSE42;
+#endif
+		return SCALAR;
+	}
+
+	Level level()
+	{
+		return current_level();
+	}
+
+	void set_level(Level level)
+	{
+		current_level() = std::min(level, supported_level());
+	}
+
+	void reverse_complement(char *sequence, size_t length)
+	{
+		implementation().reverse_complement(sequence, length);
+	}
+
+	size_t find_run(const char *sequence, size_t length, char base, size_t run_length)
+	{
+		return implementation().find_run(sequence, length, base, run_length);
+	}
+
+	size_t trailing_run_length(const char *sequence, size_t length, char base1, char base2)
+	{
+		return implementation().trailing_run_length(sequence, length, base1, base2);
+	}
+
+	char min_value(const char *values, size_t length)
+	{
+		return implementation().min_value(values, length);
+	}
+
+	unsigned hamming_distance(const char *s1, const char *s2, size_t length, bool skip_n)
+	{
+		return implementation().hamming_distance(s1, s2, length, skip_n);
+	}
+
+	bool contains_n(const char *sequence, size_t length)
+	{
+		return implementation().contains_n(sequence, length);
+	}
+}
+}
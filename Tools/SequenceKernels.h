@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Tools
+{
+	// Vectorized loops over nucleotide and quality strings. Implementation (AVX2, SSE4.2 or plain loops) is chosen
+	// on the first call according to the CPU. Results don't depend on it.
+	namespace Kernels
+	{
+		enum Level
+		{
+			SCALAR = 0,
+			SSE42,
+			AVX2
+		};
+
+		Level supported_level();
+		Level level();
+		void set_level(Level level); // Is capped by supported_level(). Not thread-safe, used mostly in tests
+
+		void reverse_complement(char *sequence, size_t length); // In-place. Symbols other than ACGTN become N
+		size_t find_run(const char *sequence, size_t length, char base, size_t run_length); // std::string::npos if not found
+		size_t trailing_run_length(const char *sequence, size_t length, char base1, char base2);
+		char min_value(const char *values, size_t length); // CHAR_MAX for empty input
+		unsigned hamming_distance(const char *s1, const char *s2, size_t length, bool skip_n);
+		bool contains_n(const char *sequence, size_t length);
+	}
+}
@@ -1,7 +1,11 @@
 #include "UtilFunctions.h"
+#include "SequenceKernels.h"
 
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <vector>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/path.hpp>
 
@@ -27,56 +31,134 @@ namespace Tools
 		return result;
 	}
 
-	unsigned edit_distance(const char *s1, const char *s2, bool skip_n, unsigned max_ed)
+	static unsigned edit_distance_dp(const char *s1, size_t s1_len, const char *s2, size_t s2_len, bool skip_n,
+	                                 unsigned max_ed)
 	{
-		int olddiag;
-		int s1len = strlen(s1);
-		int s2len = strlen(s2);
-		int column[s1len + 1];
-		for (int s1_ind = 0; s1_ind <= s1len; s1_ind++)
+		std::vector<unsigned> column(s1_len + 1);
+		for (size_t s1_ind = 0; s1_ind <= s1_len; s1_ind++)
 		{
-			column[s1_ind] = s1_ind;
+			column[s1_ind] = unsigned(s1_ind);
 		}
 
-		for (int s2_ind = 1; s2_ind <= s2len; s2_ind++)
+		for (size_t s2_ind = 1; s2_ind <= s2_len; s2_ind++)
 		{
-			int lower_index = std::max(0, s2_ind - int(max_ed));
-			int upper_index = std::min(s1len, s2_ind + int(max_ed));
-			int lastdiag = column[lower_index];
-			column[lower_index] = s2_ind;
-			int min_ed = s2_ind;
-			for (int s1_ind = lower_index + 1; s1_ind <= upper_index; s1_ind++)
+			unsigned lastdiag = column[0];
+			column[0] = unsigned(s2_ind);
+			unsigned min_ed = column[0];
+			for (size_t s1_ind = 1; s1_ind <= s1_len; s1_ind++)
 			{
-				olddiag = column[s1_ind];
+				unsigned olddiag = column[s1_ind];
 				bool is_match = (s1[s1_ind - 1] == s2[s2_ind - 1]) || (skip_n && (s1[s1_ind - 1] == 'N' || s2[s2_ind - 1] == 'N'));
-				int new_ed = MIN3(column[s1_ind] + 1, column[s1_ind - 1] + 1, lastdiag + int(!is_match));
-				min_ed = std::min(min_ed, new_ed + std::abs(s1_ind - s2_ind));
-				column[s1_ind] = new_ed;
+				column[s1_ind] = MIN3(column[s1_ind] + 1, column[s1_ind - 1] + 1, lastdiag + unsigned(!is_match));
+				min_ed = std::min(min_ed, column[s1_ind]);
 				lastdiag = olddiag;
 			}
 
+			// Any alignment passes through the current column
 			if (min_ed > max_ed)
-				return unsigned(min_ed);
+				return min_ed;
 		}
 
-		return unsigned(column[s1len]);
+		return column[s1_len];
 	}
 
-	unsigned hamming_distance(const std::string &s1, const std::string &s2, bool skip_n)
+	unsigned edit_distance(const char *s1, size_t s1_len, const char *s2, size_t s2_len, bool skip_n, unsigned max_ed)
 	{
-		if (s1.size() != s2.size())
-			throw std::runtime_error("Strings should have equal length");
+		// Myers' bit-vector algorithm, where s1 is the pattern. Distance is symmetric, so the shorter string is used.
+		if (s1_len > s2_len)
+		{
+			std::swap(s1, s2);
+			std::swap(s1_len, s2_len);
+		}
 
-		unsigned ed = 0;
-		for (std::string::size_type i = 0; i < s1.size(); ++i)
+		if (s1_len == 0)
+			return unsigned(s2_len);
+
+		if (s1_len > 64)
+			return edit_distance_dp(s1, s1_len, s2, s2_len, skip_n, max_ed);
+
+		if (s2_len - s1_len > max_ed)
+			return unsigned(s2_len - s1_len);
+
+		uint64_t peq[4] = {0, 0, 0, 0}, n_mask = 0; // Masks of A, C, G, T and N positions
+		for (size_t i = 0; i < s1_len; ++i)
 		{
-			if (s1[i] != s2[i] && !(skip_n && (s1[i] == 'N' || s2[i] == 'N')))
+			switch (s1[i])
+			{
+				case 'A': peq[0] |= uint64_t(1) << i; break;
+				case 'C': peq[1] |= uint64_t(1) << i; break;
+				case 'G': peq[2] |= uint64_t(1) << i; break;
+				case 'T': peq[3] |= uint64_t(1) << i; break;
+				case 'N': n_mask |= uint64_t(1) << i; break;
+				default: break;
+			}
+		}
+
+		const uint64_t last_bit = uint64_t(1) << (s1_len - 1);
+		uint64_t pv = ~uint64_t(0), mv = 0;
+		unsigned score = unsigned(s1_len);
+		for (size_t s2_ind = 0; s2_ind < s2_len; ++s2_ind)
+		{
+			uint64_t eq;
+			switch (s2[s2_ind])
+			{
+				case 'A': eq = peq[0]; break;
+				case 'C': eq = peq[1]; break;
+				case 'G': eq = peq[2]; break;
+				case 'T': eq = peq[3]; break;
+				case 'N': eq = skip_n ? ~uint64_t(0) : n_mask; break;
+				default:
+					eq = 0;
+					for (size_t i = 0; i < s1_len; ++i)
+					{
+						eq |= uint64_t(s1[i] == s2[s2_ind]) << i;
+					}
+			}
+
+			if (skip_n)
+			{
+				eq |= n_mask;
+			}
+
+			uint64_t xv = eq | mv;
+			uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+			uint64_t ph = mv | ~(xh | pv);
+			uint64_t mh = pv & xh;
+
+			if (ph & last_bit)
 			{
-				++ed;
+				score++;
 			}
+			else if (mh & last_bit)
+			{
+				score--;
+			}
+
+			ph = (ph << 1) | 1;
+			mh <<= 1;
+			pv = mh | ~(xv | ph);
+			mv = ph & xv;
+
+			// Each of the remaining symbols can decrease the distance at most by one
+			size_t symbols_left = s2_len - s2_ind - 1;
+			if (score > max_ed + symbols_left)
+				return unsigned(score - symbols_left);
 		}
 
-		return ed;
+		return score;
+	}
+
+	unsigned edit_distance(const char *s1, const char *s2, bool skip_n, unsigned max_ed)
+	{
+		return edit_distance(s1, strlen(s1), s2, strlen(s2), skip_n, max_ed);
+	}
+
+	unsigned hamming_distance(const std::string &s1, const std::string &s2, bool skip_n)
+	{
+		if (s1.size() != s2.size())
+			throw std::runtime_error("Strings should have equal length");
+
+		return Kernels::hamming_distance(s1.data(), s2.data(), s1.size(), skip_n);
 	}
 
 	RInside* init_r()
@@ -92,23 +174,10 @@ namespace Tools
 		return r;
 	}
 
-	ReverseComplement::ReverseComplement()
-	{
-		this->complements['A'] = 'T';
-		this->complements['T'] = 'A';
-		this->complements['G'] = 'C';
-		this->complements['C'] = 'G';
-		this->complements['N'] = 'N';
-	}
-
 	std::string ReverseComplement::rc(const std::string &s) const
 	{
 		std::string res = s;
-		for (int i = 0; i < s.length(); i++)
-		{
-			res[i] = this->complements[s[s.length() - i - 1]];
-		}
-
+		Kernels::reverse_complement(&res[0], res.length());
 		return res;
 	}
 
@@ -9,11 +9,8 @@ namespace Tools
 {
 	class ReverseComplement
 	{
-	private:
-		char complements[std::numeric_limits<char>::max()];
 	public:
-		ReverseComplement();
-		std::string rc(const std::string &s) const;
+		std::string rc(const std::string &s) const; // Symbols other than ACGTN are replaced with N
 	};
 
 	class PairHash
@@ -40,7 +37,10 @@ namespace Tools
 		}
 	};
 
+	// Distance is exact if it doesn't exceed max_ed. Otherwise, some value larger than max_ed is returned
 	unsigned edit_distance(const char *s1, const char *s2, bool skip_n = true, unsigned max_ed=10000);
+	unsigned edit_distance(const char *s1, size_t s1_len, const char *s2, size_t s2_len, bool skip_n = true,
+	                       unsigned max_ed=10000);
 	unsigned hamming_distance(const std::string &s1, const std::string &s2, bool skip_n = true);
 	double fpow(double base, long exp);
 	RInside* init_r();
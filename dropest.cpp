@@ -43,6 +43,7 @@ struct Params
 	std::string gene_match_level = UMI::Mark::DEFAULT_CODE;
 	int max_cells_number = -1;
 	int min_genes_after_merge = -1;
+	int threads_num = 1;
 };
 
 static void check_files_existence(const Params &params, const vector<string> &bam_files)
@@ -92,6 +93,7 @@ static void usage()
 	cerr << "\t-r, --read-params filenames: file or files with serialized params from tags search step. If there are several files"
 	     << ", they should be provided in quotes, separated by space: \"file1.params.gz file2.params.gz file3.params.gz\"" << endl;
 	cerr << "\t-R, --reads-output: print count matrix for reads and don't use UMI statistics\n";
+	cerr << "\t-t, --threads number: number of threads, which parse BAM files concurrently, decompress them and annotate the alignments. Default: 1\n";
 	cerr << "\t-u, --merge-umi: apply 'directional' correction of UMI errors. This option prevents output of 'reads_per_umi_per_cell'. If you want to apply more advanced UMI correction, don’t use '-u', but use follow up R analysis.\n";
 	cerr << "\t-V, --velocyto : save separate count matrices for exons, introns and exon/intron spanning reads\n";
 	cerr << "\t-w, --write-mtx : write out matrix in MatrixMarket format\n";
@@ -122,12 +124,13 @@ static Params parse_cmd_params(int argc, char **argv)
 			{"pseudoaligner",   no_argument, 0, 'P'},
 			{"quiet",         no_argument,       0, 'q'},
 			{"reads-output",     no_argument, 		0, 'R'},
+			{"threads",     required_argument, 		0, 't'},
 			{"validation-stats", no_argument,       0, 'S'},
 			{"velocyto",     no_argument,       0, 'V'},
 			{"write-mtx",     no_argument,       0, 'w'},
 			{0, 0,                                 0, 0}
 	};
-	while ((c = getopt_long(argc, argv, "bc:C:fFg:G:hl:L:mMno:r:PqRSuVw", long_options, &option_index)) != -1)
+	while ((c = getopt_long(argc, argv, "bc:C:fFg:G:hl:L:mMno:r:PqRSt:uVw", long_options, &option_index)) != -1)
 	{
 		switch (c)
 		{
@@ -186,6 +189,9 @@ static Params parse_cmd_params(int argc, char **argv)
 			case 'S' :
 				params.stats_for_validation = true;
 				break;
+			case 't' :
+				params.threads_num = int(strtol(optarg, nullptr, 10));
+				break;
 			case 'V' :
 				params.velocyto_matrices = true;
 				break;
@@ -226,6 +232,12 @@ static Params parse_cmd_params(int argc, char **argv)
 		params.cant_parse = true;
 	}
 
+	if (params.threads_num < 1)
+	{
+		cerr << SCRIPT_NAME << ": number of threads must be positive" << endl;
+		params.cant_parse = true;
+	}
+
 	if (params.output_name.empty())
 	{
 		params.output_name = "cell.counts.rds";
@@ -298,7 +310,9 @@ int main(int argc, char **argv)
 
 		BamProcessing::BamController bam_controller(BamProcessing::BamTags(estimation_config), params.filled_bam,
 		                                            params.read_params_filenames, params.genes_filename,
-		                                            params.pseudoaligner, estimation_config.get<int>("Other.min_barcode_quality", 0));
+		                                            params.pseudoaligner, estimation_config.get<int>("Other.min_barcode_quality", 0),
+		                                            size_t(params.threads_num),
+		                                            estimation_config.get<bool>("Other.split_sorted_bam", true));
 		CellsDataContainer container = get_cells_container(files, params, estimation_config, bam_controller);
 
 		if (params.filtered_bam_output)
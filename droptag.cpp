@@ -1,9 +1,11 @@
+#include <fstream>
 #include <iostream>
 #include <iomanip>
 #include <vector>
 #include <algorithm>
 #include <getopt.h>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 #include <boost/filesystem/path.hpp>
@@ -16,6 +18,8 @@
 #include "TagsSearch/IndropV3TagsFinder.h"
 #include <TagsSearch/ConcurrentGzWriter.h>
 #include <TagsSearch/IClipTagsFinder.h>
+#include <TagsSearch/PipelineMetrics.h>
+#include <TagsSearch/UnalignedBamEncoder.h>
 #include "Tools/Logs.h"
 
 using namespace std;
@@ -35,16 +39,20 @@ struct Params
 	bool save_reads_params = false;
 	bool quiet = false;
 	bool save_stats = false;
+	bool save_stats_tsv = false;
 	int num_of_threads = 1;
         int reads_per_out_file = -1;
 	string base_name = "";
+	string output_stream = "";
 	string config_file_name = "";
 	string log_prefix = "";
 	string lib_tag = "";
+	string metrics_file = "";
 	vector<string> read_files = vector<string>();
 };
 
-void save_stats(const string &out_filename, const shared_ptr<TagsFinderBase> &tags_finder);
+void save_stats(const string &out_filename, const shared_ptr<TagsFinderBase> &tags_finder, size_t output_ind);
+void save_stats_tsv(const string &out_filename, const shared_ptr<TagsFinderBase> &tags_finder, size_t output_ind);
 
 static void usage()
 {
@@ -57,12 +65,20 @@ static void usage()
 	cerr << "\t-c, --config filename: xml file with " << SCRIPT_NAME << " parameters\n";
 	cerr << "\t-h, --help: show this info\n";
 	cerr << "\t-l, --log-prefix prefix: logs prefix\n";
+	cerr << "\t-m, --metrics filename: periodically write throughput, time and queue depth of each pipeline stage to the file "
+	     << "as JSON lines (interval is set by Processing/metrics_interval). The last line contains totals of the run\n";
 	cerr << "\t-n, --name name: alternative output base name\n";
-	cerr << "\t-p, --parallel number: number of threads\n";
-	cerr << "\t-s, --save-reads-params : serialize reads parameters to save quality info\n";
+	cerr << "\t-o, --output-stream path: write uncompressed reads to the path ('-' for stdout), e.g. a named pipe read by an aligner, "
+	     << "instead of gzipped files. Reads per out file limit is ignored\n";
+	cerr << "\t-p, --parallel number: number of threads for parsing and for compression of each output file\n";
+	cerr << "\t-s, --save-reads-params : serialize reads parameters to save quality info (params.gz, or params.bin "
+	     << "with Processing/params_format 'binary')\n";
 	cerr << "\t-S, --save-stats : save stats to rds file\n";
+	cerr << "\t-T, --save-stats-tsv : save number of reads per cell barcode to tsv file. Doesn't require R\n";
 	cerr << "\t-r, --reads-per-out-file : maximum number of reads per output file; (0 - unlimited). Overrides corresponding xml parameter.\n";
-	cerr << "\t-t, --lib-tag library tag : (for IndropV3 with library tag only)\n";
+	cerr << "\t-t, --lib-tag library tag : (for IndropV3 with library tag only). Several comma-separated tags split the reads "
+	     << "into one output per library in a single pass (names are '<base name>.<tag>'), and reads without a unique tag "
+	     << "go to '<base name>.unassigned'\n";
 	cerr << "\t-q, --quiet : disable logs\n";
 }
 
@@ -85,12 +101,29 @@ shared_ptr<TagsFinderBase> get_tags_finder(const Params &params, const ptree &pt
 	if (protocol_type.empty())
 		throw std::runtime_error("Protocol is empty. Please, specify it in the config (TagsSearch/protocol)");
 
-	auto const &processing_config = pt.get_child(PROCESSING_CONFIG_PATH, ptree());
-	
-	
+	auto processing_config = pt.get_child(PROCESSING_CONFIG_PATH, ptree());
+	auto barcodes_filename = Tools::expand_tilde_in_path(Tools::ltrim(processing_config.get<std::string>("barcodes_file", "")));
+	processing_config.put("barcodes_file", Tools::expand_relative_path(params.config_file_name, barcodes_filename));
+
 	size_t max_records_per_file = params.reads_per_out_file;
 	if(max_records_per_file==-1) max_records_per_file = processing_config.get<size_t>("reads_per_out_file", 0);
-	auto writer = std::make_shared<ConcurrentGzWriter>(params.base_name, "fastq.gz", max_records_per_file);
+
+	auto output_format = processing_config.get<std::string>("output_format", "fastq");
+	if (output_format != "fastq" && output_format != "bam")
+		throw std::runtime_error("Unknown output format: '" + output_format + "'");
+
+	auto params_format = processing_config.get<std::string>("params_format", "text");
+	if (params_format != "binary" && params_format != "text")
+		throw std::runtime_error("Unknown read parameters format: '" + params_format + "'");
+
+	const bool bam_output = (output_format == "bam");
+	const bool bgzf_output = bam_output || (params.output_stream.empty() && processing_config.get<bool>("bgzf_output", false));
+	auto make_writer = [&](const std::string &base_name) {
+		return std::make_shared<ConcurrentGzWriter>(base_name, bam_output ? "bam" : "fastq.gz", max_records_per_file,
+		                                            processing_config.get<int>("compression_level", Z_DEFAULT_COMPRESSION),
+		                                            bgzf_output, bam_output ? UnalignedBamEncoder::header() : "",
+		                                            params.output_stream);
+	};
 
 	const std::string input_files_num_error_text = "Unexpected number of read files: " +
 			std::to_string(params.read_files.size()) +
@@ -103,9 +136,35 @@ shared_ptr<TagsFinderBase> get_tags_finder(const Params &params, const ptree &pt
 			if (params.lib_tag.empty())
 				throw std::runtime_error("For IndropV3 with library tag, tag (-t option) should be specified");
 
+			std::vector<std::string> library_tags;
+			boost::split(library_tags, params.lib_tag, boost::is_any_of(","));
+
+			// A single library keeps the plain output names and skips reads of other libraries
+			std::vector<shared_ptr<ConcurrentGzWriter>> writers;
+			shared_ptr<ConcurrentGzWriter> unassigned_writer;
+			if (library_tags.size() == 1)
+			{
+				writers.push_back(make_writer(params.base_name));
+			}
+			else
+			{
+				if (!params.output_stream.empty())
+					throw std::runtime_error("Output stream can't be used with several library tags");
+
+				for (auto const &tag : library_tags)
+				{
+					if (tag.empty())
+						throw std::runtime_error("Empty library tag in '" + params.lib_tag + "'");
+
+					writers.push_back(make_writer(params.base_name + "." + tag));
+				}
+				unassigned_writer = make_writer(params.base_name + ".unassigned");
+			}
+
 			return shared_ptr<TagsFinderBase>(
-					new IndropV3LibsTagsFinder(params.read_files, params.lib_tag, pt.get_child(BARCODES_CONFIG_PATH),
-					                           processing_config, writer, params.save_stats, params.save_reads_params));
+					new IndropV3LibsTagsFinder(params.read_files, library_tags, pt.get_child(BARCODES_CONFIG_PATH),
+					                           processing_config, writers, unassigned_writer,
+					                           params.save_stats || params.save_stats_tsv, params.save_reads_params));
 		}
 
 		if (params.read_files.size() != 3)
@@ -113,7 +172,7 @@ shared_ptr<TagsFinderBase> get_tags_finder(const Params &params, const ptree &pt
 
 		return shared_ptr<TagsFinderBase>(
 				new IndropV3TagsFinder(params.read_files, pt.get_child(BARCODES_CONFIG_PATH), processing_config,
-				                       writer, params.save_stats, params.save_reads_params));
+				                       make_writer(params.base_name), params.save_stats || params.save_stats_tsv, params.save_reads_params));
 	}
 
 	if (protocol_type == "10x") // 10x has the same format of files as indrop v3
@@ -123,7 +182,7 @@ shared_ptr<TagsFinderBase> get_tags_finder(const Params &params, const ptree &pt
 
 		return shared_ptr<TagsFinderBase>(
 				new IndropV3TagsFinder(params.read_files, pt.get_child(BARCODES_CONFIG_PATH), processing_config,
-				                       writer, params.save_stats, params.save_reads_params));
+				                       make_writer(params.base_name), params.save_stats || params.save_stats_tsv, params.save_reads_params));
 	}
 
 	if (protocol_type == "indrop")
@@ -134,11 +193,11 @@ shared_ptr<TagsFinderBase> get_tags_finder(const Params &params, const ptree &pt
 		if (!pt.get<std::string>(SPACER_CONFIG_PATH + ".barcode_mask", "").empty())
 			return shared_ptr<TagsFinderBase>(
 					new FixPosSpacerTagsFinder(params.read_files, pt.get_child(SPACER_CONFIG_PATH), processing_config,
-					                           writer, params.save_stats, params.save_reads_params));
+					                           make_writer(params.base_name), params.save_stats || params.save_stats_tsv, params.save_reads_params));
 
 		return shared_ptr<TagsFinderBase>(
 				new IndropV1TagsFinder(params.read_files, pt.get_child(SPACER_CONFIG_PATH), processing_config,
-				                       writer, params.save_stats, params.save_reads_params));
+				                       make_writer(params.base_name), params.save_stats || params.save_stats_tsv, params.save_reads_params));
 	}
 
 	if (protocol_type == "iclip")
@@ -148,7 +207,7 @@ shared_ptr<TagsFinderBase> get_tags_finder(const Params &params, const ptree &pt
 
 		return shared_ptr<TagsFinderBase>(
 				new IClipTagsFinder(params.read_files, pt.get_child(BARCODES_CONFIG_PATH), processing_config,
-				                    writer, params.save_stats, params.save_reads_params));
+				                    make_writer(params.base_name), params.save_stats || params.save_stats_tsv, params.save_reads_params));
 	}
 }
 
@@ -161,18 +220,21 @@ Params parse_cmd_params(int argc, char **argv)
 			{"config",     required_argument, 0, 'c'},
 			{"help", no_argument, 0, 'h'},
 			{"log-prefix", required_argument, 0, 'l'},
+			{"metrics",    required_argument, 0, 'm'},
 			{"name",       required_argument, 0, 'n'},
+			{"output-stream", required_argument, 0, 'o'},
 			{"parallel",   required_argument, 0, 'p'},
 			{"reads-per-out-file",   required_argument, 0, 'r'},
 			{"save-reads-params",    no_argument,       0, 's'},
 			{"save-stats",    required_argument,       0, 'S'},
+			{"save-stats-tsv",    no_argument,       0, 'T'},
 			{"lib-tag",    required_argument, 0, 't'},
 			{"quiet",    no_argument,       0, 'q'},
 			{0, 0,                            0, 0}
 	};
 
 	Params params;
-	while ((c = getopt_long(argc, argv, "c:hl:n:p:r:sSt:q", long_options, &option_index)) != -1)
+	while ((c = getopt_long(argc, argv, "c:hl:m:n:o:p:r:sSTt:q", long_options, &option_index)) != -1)
 	{
 		switch (c)
 		{
@@ -185,9 +247,15 @@ Params parse_cmd_params(int argc, char **argv)
 			case 'h' :
 				usage();
 				exit(0);
+			case 'm' :
+				params.metrics_file = string(optarg);
+				break;
 			case 'n' :
 				params.base_name = string(optarg);
 				break;
+			case 'o' :
+				params.output_stream = (string(optarg) == "-") ? "/dev/stdout" : string(optarg);
+				break;
 			case 'p' :
 				params.num_of_threads = int(strtol(optarg, nullptr, 10));
 				break;
@@ -200,6 +268,9 @@ Params parse_cmd_params(int argc, char **argv)
 			case 'S' :
 				params.save_stats = true;
 				break;
+			case 'T' :
+				params.save_stats_tsv = true;
+				break;
 			case 't' :
 				params.lib_tag= string(optarg);
 				break;
@@ -241,7 +312,7 @@ Params parse_cmd_params(int argc, char **argv)
 	return params;
 }
 
-void save_stats(const string &out_filename, const shared_ptr<TagsFinderBase> &tags_finder)
+void save_stats(const string &out_filename, const shared_ptr<TagsFinderBase> &tags_finder, size_t output_ind)
 {
 	using namespace Rcpp;
 
@@ -249,12 +320,32 @@ void save_stats(const string &out_filename, const shared_ptr<TagsFinderBase> &ta
 	RInside *R = Tools::init_r();
 
 	(*R)["d"] = List::create(
-		_["reads_per_cb"] = wrap(tags_finder->num_reads_per_cb())
+		_["reads_per_cb"] = wrap(tags_finder->num_reads_per_cb(output_ind))
 	);
 
 	R->parseEvalQ("saveRDS(d, '" + out_filename + "')");
 }
 
+void save_stats_tsv(const string &out_filename, const shared_ptr<TagsFinderBase> &tags_finder, size_t output_ind)
+{
+	Tools::trace_time("Writing stats to " + out_filename);
+
+	auto const &reads_per_cb = tags_finder->num_reads_per_cb(output_ind);
+	vector<pair<string, int>> counts(reads_per_cb.begin(), reads_per_cb.end());
+	sort(counts.begin(), counts.end(), [](const pair<string, int> &a, const pair<string, int> &b)
+			{ return a.second > b.second || (a.second == b.second && a.first < b.first); });
+
+	std::ofstream out(out_filename);
+	if (out.fail())
+		throw std::runtime_error("Can't open file for stats: '" + out_filename + "'");
+
+	out << "cell_barcode\treads\n";
+	for (auto const &cb_count : counts)
+	{
+		out << cb_count.first << '\t' << cb_count.second << '\n';
+	}
+}
+
 int main(int argc, char **argv)
 {
 	std::string command_line;
@@ -286,15 +377,28 @@ int main(int argc, char **argv)
 	try
 	{
 		shared_ptr<TagsFinderBase> finder = get_tags_finder(params, pt);
+		if (!params.metrics_file.empty())
+		{
+			finder->set_metrics(make_shared<PipelineMetrics>(params.metrics_file,
+			                                                 pt.get<double>(PROCESSING_CONFIG_PATH + ".metrics_interval", 10)));
+		}
 
 		Tools::trace_time("Run");
 
 		finder->run(params.num_of_threads);
 
 		Tools::trace_time("All done");
-		if (params.save_stats)
+		for (size_t output_ind = 0; output_ind < finder->outputs_num(); ++output_ind)
 		{
-			save_stats(params.base_name + ".rds", finder);
+			if (params.save_stats)
+			{
+				save_stats(finder->output_name(output_ind) + ".rds", finder, output_ind);
+			}
+
+			if (params.save_stats_tsv)
+			{
+				save_stats_tsv(finder->output_name(output_ind) + ".reads_per_cb.tsv", finder, output_ind);
+			}
 		}
 	}
 	catch (std::runtime_error &err)